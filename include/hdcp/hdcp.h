@@ -3,5 +3,9 @@
 #include "../../src/usb_async.h"
 #include "../../src/tcp_server.h"
 #include "../../src/tcp_client.h"
+#include "../../src/loopback.h"
+#include "../../src/shm.h"
+#include "../../src/local_socket.h"
+#include "../../src/uring.h"
 #include "../../src/master.h"
 #include "../../src/slave.h"
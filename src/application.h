@@ -8,10 +8,53 @@
 namespace hdcp {
 
 constexpr std::chrono::milliseconds connecting_timeout_(1000);
-constexpr std::chrono::milliseconds command_timeout_(1000);
+constexpr std::chrono::milliseconds command_timeout_(1000); // initial rto before any rtt sample
+constexpr std::chrono::milliseconds min_command_timeout(20);
+constexpr std::chrono::milliseconds max_command_timeout(8000);
+constexpr std::chrono::milliseconds request_time_base(10);
 constexpr std::chrono::milliseconds keepalive_timeout(3000);
 constexpr std::chrono::milliseconds keepalive_interval(1000);
 constexpr uint max_connection_attempts = 3;
+constexpr uint32_t max_ack_range = 64; // ids spanned by a range of batched command acks
+constexpr size_t cmd_cache_size = 256;                      // executed commands remembered
+constexpr std::chrono::milliseconds cmd_cache_ttl(30000);   // outlives every master retry
+constexpr size_t data_ring_size = 1024; // data packets kept by the slave for retransmission
+constexpr size_t data_ring_bytes = 16 << 20; // bounds the ring whatever the frame size
+constexpr uint max_nack_retry   = 3;
+constexpr size_t sequence_window = 1024; // received ids remembered to detect duplicates
+constexpr size_t max_message_size = 16 << 20; // largest block sent in fragments
+constexpr std::chrono::milliseconds reassembly_timeout(2000); // since the last fragment
+constexpr size_t max_reassembly_messages = 16;       // reassembled at the same time
+constexpr size_t max_reassembly_bytes    = 64 << 20; // buffered by the messages reassembled
+constexpr size_t fragment_window         = 8; // fragments of a command sent ahead of the acks
+constexpr size_t bulk_window       = 32; // bulk chunks sent ahead of the acks
+constexpr size_t bulk_ack_interval = 8;  // chunks received in order between two bulk acks
+constexpr uint   max_bulk_retry    = 5;  // timeouts without progress before interrupting
+constexpr size_t max_bulk_transfers = 16; // incomplete ones the slave can resume
+constexpr std::chrono::seconds bulk_idle_timeout(300); // before forgetting an incomplete one
+constexpr size_t max_channels      = 16; // logical data channels, 0 being the default one
+
+/// Optional protocol features, negotiated during the hip/dip handshake
+using Features = uint32_t;
+enum Feature: Features {
+    passive_keepalive = 1 << 0, // any valid packet refreshes liveness, ka only sent when idle
+    cmd_batching      = 1 << 1, // several commands per packet, range acks
+    cmd_response      = 1 << 2, // command responses carried in the acks
+    reliable_data     = 1 << 3, // lost data packets are nacked and sent again
+    extended_id       = 1 << 4, // v2 packets with 32 bit ids after the handshake
+    large_frames      = 1 << 5, // v2 frames above Packet::max_size, requires extended_id
+    array_blocks      = 1 << 6, // data may carry Packet::make_array blocks
+    subscriptions     = 1 << 7, // the master selects the data block types it receives
+    fragmentation     = 1 << 8, // blocks too large for a packet are sent in fragments
+    bulk_transfer     = 1 << 9, // windowed bulk packets from the master, cumulative acks
+    channels          = 1 << 10, // data packets tagged with a logical channel
+};
+constexpr Features supported_features = Feature::passive_keepalive | Feature::cmd_batching |
+                                        Feature::cmd_response | Feature::reliable_data |
+                                        Feature::extended_id | Feature::large_frames |
+                                        Feature::array_blocks | Feature::subscriptions |
+                                        Feature::fragmentation | Feature::bulk_transfer |
+                                        Feature::channels;
 
 struct Identification
 {
@@ -16,6 +16,10 @@ std::string ErrorCategory::message(int e) const
     case Errc::data_too_big:              return "data too big";
     case Errc::write_while_disconnected:  return "writing is not permitted while disconnected";
     case Errc::connection_failed:         return "connection failed";
+    case Errc::invalid_block_size:        return "block size invalid for its type";
+    case Errc::feature_not_negotiated:    return "feature not negotiated with the peer";
+    case Errc::invalid_channel:           return "invalid channel";
+    case Errc::reserved_block_type:       return "block type reserved to the protocol";
     default:                              return "unknown error code";
     }
 }
@@ -13,7 +13,11 @@ enum class Errc {
     invalid_cmd_ack_format,
     data_too_big,
     write_while_disconnected,
-    connection_failed
+    connection_failed,
+    invalid_block_size,
+    feature_not_negotiated,
+    invalid_channel,
+    reserved_block_type,
 };
 
 struct ErrorCategory: public std::error_category
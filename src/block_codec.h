@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+
+namespace hdcp {
+
+/*
+ * Wire format of the values carried in blocks. Trivially copyable types are sent as they lie
+ * in memory; other types, or packed layouts, are described by specializing BlockCodec with
+ * FieldCodec:
+ *
+ *     template<> struct hdcp::BlockCodec<Sample>:
+ *         hdcp::FieldCodec<Sample, &Sample::time, &Sample::x, &Sample::y> {};
+ */
+template<typename T>
+struct BlockCodec
+{
+    static_assert(std::is_trivially_copyable_v<T>, "describe T with a FieldCodec");
+
+    static constexpr size_t size = sizeof(T);
+
+    static void encode(const T& v, char * out) {std::memcpy(out, &v, size);}
+    static void decode(const char * in, T& v)  {std::memcpy(&v, in, size);}
+};
+
+/// Trivially copyable members laid end to end, without padding, in the given order
+template<typename T, auto... Members>
+struct FieldCodec
+{
+private:
+    template<typename M> struct member;
+    template<typename M> struct member<M T::*> {using type = M;};
+    template<auto M> using member_t = typename member<decltype(M)>::type;
+
+    static_assert((std::is_trivially_copyable_v<member_t<Members>> && ...));
+
+    static constexpr std::array<size_t, sizeof...(Members)> sizes = {sizeof(member_t<Members>)...};
+
+public:
+    static constexpr size_t size = (sizeof(member_t<Members>) + ... + 0);
+
+    /// Offset of each member in the encoded value
+    static constexpr std::array<size_t, sizeof...(Members)> offsets = []{
+        std::array<size_t, sizeof...(Members)> o {};
+        size_t at = 0;
+        for (size_t i = 0; i < o.size(); i++) {
+            o[i] = at;
+            at  += sizes[i];
+        }
+        return o;
+    }();
+
+    static void encode(const T& v, char * out)
+    {
+        size_t i = 0;
+        ((std::memcpy(out + offsets[i++], &(v.*Members), sizeof(member_t<Members>))), ...);
+    }
+    static void decode(const char * in, T& v)
+    {
+        size_t i = 0;
+        ((std::memcpy(&(v.*Members), in + offsets[i++], sizeof(member_t<Members>))), ...);
+    }
+};
+
+/// One value encoded in place, a Packet::BlockView of it is sent without allocation
+template<typename T>
+class EncodedBlock
+{
+public:
+    using Codec = BlockCodec<T>;
+
+    EncodedBlock(uint16_t type, const T& v): type_(type) {Codec::encode(v, data_.data());}
+
+    uint16_t         type() const {return type_;}
+    std::string_view data() const {return std::string_view(data_.data(), data_.size());}
+
+private:
+    uint16_t                         type_;
+    std::array<char, Codec::size>    data_;
+};
+
+/// Values of type T encoded end to end in a packet, decoded on access
+template<typename T>
+class TypedView
+{
+public:
+    using Codec = BlockCodec<T>;
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = T;
+
+        iterator(const char * p, size_t stride): p_(p), stride_(stride) {}
+        T operator*() const {T v; Codec::decode(p_, v); return v;}
+        iterator& operator++() {p_ += stride_; return *this;}
+        bool operator==(const iterator& o) const {return p_ == o.p_;}
+        bool operator!=(const iterator& o) const {return p_ != o.p_;}
+
+    private:
+        const char * p_;
+        size_t       stride_;
+    };
+
+    TypedView() = default;
+    /// stride is the distance between values, Codec::size unless they are array elements
+    TypedView(const char * data, size_t count, size_t stride = Codec::size):
+        data_(data), count_(count), stride_(stride) {}
+
+    size_t   size()  const {return count_;}
+    bool     empty() const {return count_ == 0;}
+    T operator[](size_t i) const {T v; Codec::decode(data_ + i * stride_, v); return v;}
+    iterator begin() const {return iterator(data_, stride_);}
+    iterator end()   const {return iterator(data_ + count_ * stride_, stride_);}
+
+private:
+    const char * data_   = nullptr;
+    size_t       count_  = 0;
+    size_t       stride_ = Codec::size;
+};
+
+} /* namespace hdcp */
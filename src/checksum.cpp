@@ -0,0 +1,151 @@
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "checksum.h"
+
+namespace hdcp {
+namespace checksum {
+
+namespace {
+
+constexpr uint32_t crc32c_poly = 0x82f63b78; // reflected Castagnoli polynomial
+
+// slicing-by-8 tables, table[0] is the classic byte-wise one
+using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr Tables make_tables()
+{
+    Tables t {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ crc32c_poly : crc >> 1;
+        t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (size_t s = 1; s < t.size(); s++)
+            t[s][i] = (t[s-1][i] >> 8) ^ t[0][t[s-1][i] & 0xff];
+    return t;
+}
+
+constexpr Tables tables = make_tables();
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(std::string_view v, uint32_t crc)
+{
+    auto p = reinterpret_cast<const uint8_t*>(v.data());
+    size_t n = v.size();
+    uint64_t c = ~crc;
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+    }
+    uint32_t c32 = c;
+    for (; n; n--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return ~c32;
+}
+
+bool has_crc32c_hw()
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(__aarch64__)
+
+__attribute__((target("+crc")))
+uint32_t crc32c_hw(std::string_view v, uint32_t crc)
+{
+    auto p = reinterpret_cast<const uint8_t*>(v.data());
+    size_t n = v.size();
+    uint32_t c = ~crc;
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        c = __crc32cd(c, w);
+    }
+    for (; n; n--)
+        c = __crc32cb(c, *p++);
+    return ~c;
+}
+
+bool has_crc32c_hw()
+{
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+}
+
+#else
+
+uint32_t crc32c_hw(std::string_view v, uint32_t crc)
+{
+    return crc32c_software(v, crc);
+}
+
+bool has_crc32c_hw()
+{
+    return false;
+}
+
+#endif
+
+// resolved once, the cpu does not change under our feet
+const bool hw_available = has_crc32c_hw();
+
+} /* namespace */
+
+uint16_t fletcher16(std::string_view v)
+{
+    uint8_t CRCA = 0, CRCB = 0;
+
+    for (const auto& c: v) {
+        CRCA = CRCA + *reinterpret_cast<const uint8_t*>(&c);
+        CRCB = CRCB + CRCA;
+    }
+
+    return CRCA << 8 | CRCB;
+}
+
+uint32_t crc32c_software(std::string_view v, uint32_t crc)
+{
+    auto p = reinterpret_cast<const uint8_t*>(v.data());
+    size_t n = v.size();
+    uint32_t c = ~crc;
+    // little endian words, as laid out in the packets
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, sizeof(lo));
+        std::memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= c;
+        c = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^
+            tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24] ^
+            tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff] ^
+            tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24];
+    }
+    for (; n; n--)
+        c = (c >> 8) ^ tables[0][(c ^ *p++) & 0xff];
+    return ~c;
+}
+
+uint32_t crc32c(std::string_view v, uint32_t crc)
+{
+    return hw_available ? crc32c_hw(v, crc) : crc32c_software(v, crc);
+}
+
+bool crc32c_hardware()
+{
+    return hw_available;
+}
+
+} /* namespace checksum */
+} /* namespace hdcp */
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace hdcp {
+namespace checksum {
+
+/// Byte-wise Fletcher-16, the historical packet checksum
+uint16_t fletcher16(std::string_view v);
+
+/// CRC32C (Castagnoli), on the SSE4.2 or ARMv8 CRC instructions when the cpu has them
+uint32_t crc32c(std::string_view v, uint32_t crc = 0);
+/// Table driven implementation, always available
+uint32_t crc32c_software(std::string_view v, uint32_t crc = 0);
+bool     crc32c_hardware();
+
+} /* namespace checksum */
+} /* namespace hdcp */
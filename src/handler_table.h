@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "packet.h"
+#include "application_error.h"
+
+namespace hdcp {
+
+/// Runs a command block, the returned data is the response sent in the command ack
+using CommandHandler = std::function<std::string(const Packet::BlockView&)>;
+/// Runs on a data block, or on an array block of its elements
+using DataHandler    = std::function<void(const Packet::BlockView&)>;
+
+/*
+ * Handlers indexed by block type. The table is dense over the 16 bit types, in pages of 256
+ * entries allocated on first registration so that a few handlers cost a few KiB. Lookups are
+ * two loads, registrations must be done before the table is used.
+ */
+template<typename Handler>
+class HandlerTable
+{
+public:
+    /// Replaces the handler of type, an empty handler erases it. Throws reserved_block_type
+    /// for a type the protocol reads itself
+    void set(Packet::BlockType type, Handler handler)
+    {
+        if (Packet::is_reserved(type))
+            throw application_error(appli::Errc::reserved_block_type, fmt::format("{:#x}", type));
+        if (!handler) {
+            erase(type);
+            return;
+        }
+        auto& page = pages_[type >> 8];
+        if (!page)
+            page = std::make_unique<Page>();
+        auto& entry = (*page)[type & 0xff];
+        if (!entry)
+            size_++;
+        entry = std::move(handler);
+    }
+    void erase(Packet::BlockType type)
+    {
+        auto& page = pages_[type >> 8];
+        if (page && (*page)[type & 0xff]) {
+            (*page)[type & 0xff] = nullptr;
+            size_--;
+        }
+    }
+    /// nullptr if no handler is registered for type
+    const Handler * find(Packet::BlockType type) const
+    {
+        auto& page = pages_[type >> 8];
+        if (!page || !(*page)[type & 0xff])
+            return nullptr;
+        return &(*page)[type & 0xff];
+    }
+    bool   empty() const {return size_ == 0;}
+    size_t size()  const {return size_;}
+
+private:
+    using Page = std::array<Handler, 256>;
+
+    std::array<std::unique_ptr<Page>, 256> pages_;
+    size_t                                 size_ = 0;
+};
+
+/// Block type of the commands or data carried as a T, T::block_type by default
+template<typename T>
+constexpr Packet::BlockType block_type_of = T::block_type;
+
+/// Throws invalid_block_size if the block is too short for a T, or not exactly one if exact
+template<typename T>
+void check_block_size(size_t size, bool exact = false)
+{
+    if (size < BlockCodec<T>::size || (exact && size != BlockCodec<T>::size))
+        throw application_error(appli::Errc::invalid_block_size,
+                                fmt::format("{} bytes read as a {} bytes value", size,
+                                            BlockCodec<T>::size));
+}
+
+/// Decode the argument of f from the command block, encode what it returns as the response.
+/// Throws invalid_block_size, as a data handler, if the block is not exactly one T
+template<typename T, typename F>
+CommandHandler make_command_handler(F&& f)
+{
+    return [f = std::forward<F>(f)](const Packet::BlockView& b) -> std::string {
+        check_block_size<T>(b.data.size(), true);
+        T arg;
+        BlockCodec<T>::decode(b.data.data(), arg);
+        using R = std::invoke_result_t<const F&, const T&>;
+        if constexpr (std::is_void_v<R>) {
+            f(arg);
+            return std::string();
+        } else if constexpr (std::is_convertible_v<R, std::string>) {
+            return f(arg);
+        } else {
+            std::string response(BlockCodec<R>::size, '\0');
+            BlockCodec<R>::encode(f(arg), response.data());
+            return response;
+        }
+    };
+}
+
+/// Call f with a TypedView<T> of the block, or with each value if it takes a T. Throws
+/// invalid_block_size, as a command handler, if the block is not made of whole T values
+template<typename T, typename F>
+DataHandler make_data_handler(F&& f)
+{
+    return [f = std::forward<F>(f)](const Packet::BlockView& b) {
+        TypedView<T> values;
+        Packet::ArrayView array;
+        if (Packet::parse_array(b, array)) {
+            check_block_size<T>(array.elem_size);
+            values = TypedView<T>(array.data, array.count, array.elem_size);
+        } else {
+            if (b.data.size() % BlockCodec<T>::size)
+                throw application_error(appli::Errc::invalid_block_size,
+                                        fmt::format("{} bytes read as {} bytes values",
+                                                    b.data.size(), BlockCodec<T>::size));
+            values = TypedView<T>(b.data.data(), b.data.size() / BlockCodec<T>::size);
+        }
+        if constexpr (std::is_invocable_v<const F&, const TypedView<T>&>) {
+            f(values);
+        } else {
+            for (auto v: values)
+                f(v);
+        }
+    };
+}
+
+} /* namespace hdcp */
@@ -0,0 +1,379 @@
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "local_socket.h"
+
+namespace hdcp {
+namespace transport {
+namespace local {
+
+namespace {
+
+std::system_error system_error(const std::string& what)
+{
+    return std::system_error(errno, std::system_category(), what);
+}
+
+sockaddr_un address(const std::string& path)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::system_error(ENAMETOOLONG, std::system_category(), path);
+    path.copy(addr.sun_path, path.size());
+    return addr;
+}
+
+union Control {
+    cmsghdr align;
+    char    buf[CMSG_SPACE(sizeof(int))];
+};
+
+void set_timeout(int fd, int option)
+{
+    timeval tv {};
+    tv.tv_usec = std::chrono::duration_cast<std::chrono::microseconds>(time_base_ms).count();
+    ::setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+} /* namespace */
+
+Endpoint::Endpoint(common::Logger logger, std::string_view path):
+    SocketEndpoint(logger), path_(path), batch_(max_batch), batch_fds_(max_batch, -1)
+{
+}
+
+Endpoint::~Endpoint()
+{
+    stop();
+    release();
+}
+
+void Endpoint::write(Packet&& p, Priority prio)
+{
+    if (!connected_)
+        throw transport_error(Errc::write_while_closed);
+    if (!enqueue_write(std::move(p), prio))
+        throw transport_error(Errc::write_queue_full);
+    flush();
+}
+
+void Endpoint::write(Packet&& p, int fd)
+{
+    if (!connected_)
+        throw transport_error(Errc::write_while_closed);
+    // the copy travels in the batch, the caller may close fd at once
+    int copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (copy < 0)
+        throw system_error("cannot pass descriptor");
+
+    std::unique_lock<std::mutex> lk(send_mutex_);
+    // a full socket buffer holds the writer back for up to a time base
+    send_queued();
+    // the packets queued before it go first, held back or not
+    while (batched_ < max_batch && dequeue_write(batch_[batched_]))
+        batched_++;
+    if (batched_ == max_batch) {
+        unsent_ = true;
+        ::close(copy);
+        throw transport_error(Errc::write_queue_full);
+    }
+    batch_[batched_]     = std::move(p);
+    batch_fds_[batched_] = copy;
+    batched_++;
+    send_queued();
+
+    lk.unlock();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (write_queue_size() > 0)
+        flush();
+}
+
+int Endpoint::take_fd(Packet::Id id)
+{
+    std::lock_guard<std::mutex> lk(fds_mutex_);
+    auto it = fds_.find(id);
+    if (it == fds_.end())
+        return -1;
+    int fd = it->second;
+    fds_.erase(it);
+    return fd;
+}
+
+void Endpoint::attach(int fd)
+{
+    set_timeout(fd, SO_RCVTIMEO);
+    set_timeout(fd, SO_SNDTIMEO);
+    SocketEndpoint::attach(fd);
+}
+
+void Endpoint::flush()
+{
+    // the writer taking the socket also sends what the others queue meanwhile; it is not held
+    // back again by a full socket buffer, the thread retries
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (send_mutex_.try_lock()) {
+        send_queued();
+        send_mutex_.unlock();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (unsent_ || write_queue_size() == 0)
+            return;
+    }
+}
+
+void Endpoint::send_queued()
+{
+    std::array<mmsghdr, max_batch> msgs;
+    std::array<iovec, max_batch>   iov;
+    std::array<Control, max_batch> control;
+    for (;;) {
+        size_t n = batched_;
+        while (n < max_batch && dequeue_write(batch_[n]))
+            n++;
+        if (n == 0)
+            break;
+        for (size_t i = 0; i < n; i++) {
+            iov[i]  = {const_cast<char*>(batch_[i].data()), batch_[i].size()};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (batch_fds_[i] < 0)
+                continue;
+            control[i] = {};
+            msgs[i].msg_hdr.msg_control    = control[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+            auto cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_RIGHTS;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &batch_fds_[i], sizeof(int));
+        }
+        size_t sent = 0;
+        const int err = send(msgs.data(), n, sent);
+        if (err == EMSGSIZE) {
+            // only this frame cannot be sent, the next ones can
+            log_error(logger_, "frame dropped: {} bytes above the socket buffer",
+                      batch_[sent].size());
+            sent++;
+        } else if (err && err != EAGAIN && err != EWOULDBLOCK) {
+            // the connection is closed
+            sent = n;
+        }
+        batched_ = n;
+        pop_batch(sent);
+        if (err && err != EMSGSIZE)
+            break;
+    }
+    unsent_ = batched_ > 0;
+}
+
+void Endpoint::pop_batch(size_t n)
+{
+    if (n == 0)
+        return;
+    // the peer holds its own copies of the descriptors sent
+    for (size_t i = 0; i < n; i++) {
+        if (batch_fds_[i] >= 0)
+            ::close(batch_fds_[i]);
+    }
+    std::move(batch_.begin() + n, batch_.begin() + batched_, batch_.begin());
+    std::move(batch_fds_.begin() + n, batch_fds_.begin() + batched_, batch_fds_.begin());
+    std::fill(batch_fds_.begin() + batched_ - n, batch_fds_.begin() + batched_, -1);
+    batched_ -= n;
+}
+
+int Endpoint::send(mmsghdr * msgs, size_t n, size_t& sent)
+{
+    const int fd = fd_;
+    if (fd < 0)
+        return ENOTCONN;
+    while (sent < n) {
+        int r = ::sendmmsg(fd, msgs + sent, n - sent, MSG_NOSIGNAL);
+        if (r >= 0) {
+            sent += r;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        const int err = errno;
+        // timed out on a full socket buffer or a frame above it, the connection stays
+        if (err == EAGAIN || err == EWOULDBLOCK || err == EMSGSIZE)
+            return err;
+        errc_ = std::error_code(err, std::system_category());
+        log_error(logger_, "{}", errc_.message());
+        close();
+        return err;
+    }
+    return 0;
+}
+
+void Endpoint::release()
+{
+    {
+        std::lock_guard<std::mutex> send_lk(send_mutex_);
+        std::lock_guard<std::mutex> lk(fd_mutex_);
+        connected_ = false;
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+        // what was held back went with the connection
+        pop_batch(batched_);
+        unsent_ = false;
+    }
+    // the descriptors not taken went with the connection
+    std::lock_guard<std::mutex> lk(fds_mutex_);
+    for (auto& [id, fd]: fds_)
+        ::close(fd);
+    fds_.clear();
+}
+
+void Endpoint::run()
+{
+    notify_running();
+
+    // a slot per message of the largest frame, the session may grow while receiving; only
+    // the pages written are backed
+    constexpr size_t slot = Packet::max_frame_size;
+    auto buffer = static_cast<char*>(::mmap(nullptr, max_batch * slot, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    if (buffer == MAP_FAILED) {
+        errc_ = std::error_code(errno, std::system_category());
+        log_error(logger_, "cannot map the receive buffer: {}", errc_.message());
+        return;
+    }
+    std::array<mmsghdr, max_batch> msgs;
+    std::array<iovec, max_batch>   iov;
+    std::array<Control, max_batch> control;
+
+    while (is_running()) {
+        const int fd = fd_;
+        if (fd < 0) {
+            connect();
+            continue;
+        }
+        for (size_t i = 0; i < max_batch; i++) {
+            iov[i]  = {buffer + i * slot, slot};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov        = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen     = 1;
+            msgs[i].msg_hdr.msg_control    = control[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+        }
+
+        // packets held back by a full socket buffer, or by a writer finding the socket taken
+        if (unsent_ || write_queue_size() > 0)
+            flush();
+
+        int r = ::recvmmsg(fd, msgs.data(), max_batch, MSG_WAITFORONE | MSG_CMSG_CLOEXEC, nullptr);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+            errc_ = std::error_code(errno, std::system_category());
+            log_error(logger_, "{}", errc_.message());
+            close();
+            release();
+            continue;
+        }
+
+        bool eof = false;
+        for (int i = 0; i < r && !eof; i++) {
+            auto& hdr = msgs[i].msg_hdr;
+            int passed = -1;
+            for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                    std::memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+            }
+            // no frame is empty, a message of 0 bytes is the end of the connection
+            if (msgs[i].msg_len == 0) {
+                eof = true;
+            } else if (hdr.msg_flags & MSG_TRUNC) {
+                log_error(logger_, "frame dropped: larger than {} bytes", slot);
+            } else {
+                try {
+                    Packet p(std::string_view(buffer + i * slot, msgs[i].msg_len));
+                    if (passed >= 0) {
+                        std::lock_guard<std::mutex> lk(fds_mutex_);
+                        auto& slot = fds_.try_emplace(p.id(), -1).first->second;
+                        if (slot >= 0)
+                            ::close(slot);
+                        slot   = passed;
+                        passed = -1;
+                    }
+                    if (!read_queue_.try_enqueue(std::move(p)))
+                        throw transport_error(Errc::read_queue_full);
+                } catch (std::exception& e) {
+                    log_error(logger_, "{}", e.what());
+                }
+            }
+            if (passed >= 0)
+                ::close(passed);
+        }
+        if (eof) {
+            log_info(logger_, "connection closed by the peer");
+            close();
+            release();
+        }
+    }
+    ::munmap(buffer, max_batch * slot);
+    release();
+}
+
+Server::Server(common::Logger logger, std::string_view path):
+    Endpoint(logger, path)
+{
+    const auto addr = address(path_);
+    listen_fd_ = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+        throw system_error("socket");
+    // a socket file left by a previous run
+    ::unlink(path_.c_str());
+    if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, 1) < 0) {
+        auto e = system_error(path_);
+        ::close(listen_fd_);
+        throw e;
+    }
+}
+
+Server::~Server()
+{
+    stop();
+    ::close(listen_fd_);
+    ::unlink(path_.c_str());
+}
+
+Client::Client(common::Logger logger, std::string_view path):
+    Endpoint(logger, path)
+{
+}
+
+Client::~Client()
+{
+    stop();
+}
+
+void Client::open()
+{
+    if (is_open())
+        return;
+    log_debug(logger_, "opening transport...");
+    const auto addr = address(path_);
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw system_error("socket");
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        auto e = system_error(path_);
+        ::close(fd);
+        throw e;
+    }
+    attach(fd);
+}
+
+} /* namespace local */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "socket_endpoint.h"
+
+namespace hdcp {
+namespace transport {
+namespace local {
+
+/*
+ * Unix domain SOCK_SEQPACKET connection: each frame is one message whose boundaries the kernel
+ * keeps, there is no stream to resynchronize. The writer holding the socket drains the write
+ * lanes in batches of one sendmmsg, packets queued meanwhile by other threads go with the
+ * next one; those a full socket buffer held back are sent again by the thread. A thread
+ * receives up to a batch per recvmmsg. A descriptor, e.g. the memfd of a bulk buffer, can
+ * travel with a packet.
+ */
+class Endpoint: public SocketEndpoint
+{
+public:
+    ~Endpoint();
+
+    using Transport::write;
+    /// A full socket buffer holds the writer back, for up to a time base per batch
+    void write(Packet&& p, Priority prio) override;
+    /// Send a copy of fd along with p, after the packets already queued; held back by a full
+    /// socket buffer, it goes with them
+    void write(Packet&& p, int fd);
+    /// Descriptor received with packet id, -1 if none; the caller then owns it
+    int  take_fd(Packet::Id id);
+
+protected:
+    static constexpr size_t max_batch = 32;
+
+    std::string path_;
+
+    Endpoint(common::Logger logger, std::string_view path);
+
+    void attach(int fd) override;
+
+private:
+    std::mutex                       send_mutex_; // owns the socket for writing
+    std::vector<Packet>              batch_;      // sent by the writer owning the socket
+    std::vector<int>                 batch_fds_;  // passed with batch_, -1 if none
+    size_t                           batched_ = 0; // front of batch_ not sent yet
+    std::atomic_bool                 unsent_  = false; // batched_, for the thread to retry
+    std::mutex                       fds_mutex_;
+    std::unordered_map<Packet::Id, int> fds_;     // received, not taken yet
+
+    void flush();
+    /// Keeps what a full socket buffer held back in batch_
+    void send_queued();
+    /// Drop the first n messages of batch_, closing their descriptors
+    void pop_batch(size_t n);
+    /// 0 or the errno of the failure, sent is the number of messages sent
+    int  send(struct mmsghdr * msgs, size_t n, size_t& sent);
+    void release();
+    void run() override;
+};
+
+/// Listens on path from construction, accepting one connection at a time, the next one once
+/// the peer left
+class Server: public Endpoint
+{
+public:
+    /// Throws std::system_error if path cannot be bound
+    Server(common::Logger logger, std::string_view path);
+    ~Server();
+
+    /// The thread accepts the connection
+    void open() override {}
+
+private:
+    int listen_fd_ = -1;
+
+    void connect() override {accept(listen_fd_);}
+};
+
+class Client: public Endpoint
+{
+public:
+    Client(common::Logger logger, std::string_view path);
+    ~Client();
+
+    /// Throws std::system_error if nobody listens on path
+    void open() override;
+};
+
+} /* namespace local */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,214 @@
+#include <deque>
+
+#include "loopback.h"
+
+namespace hdcp {
+namespace transport {
+namespace loopback {
+
+struct Link
+{
+    std::shared_mutex          mutex;  // exclusive to detach an end
+    std::array<Endpoint *, 2>  ends {};
+    std::array<std::mutex, 2>  rx_mutex; // the read queues have a single producer
+};
+
+std::pair<std::unique_ptr<Endpoint>, std::unique_ptr<Endpoint>>
+make_pair(common::Logger logger, const Shaping& first, const Shaping& second)
+{
+    auto a = std::make_unique<Endpoint>(logger, first);
+    auto b = std::make_unique<Endpoint>(logger, second);
+    auto link = std::make_shared<Link>();
+    link->ends = {a.get(), b.get()};
+    a->link_ = link;
+    b->link_ = link;
+    b->side_ = 1;
+    return {std::move(a), std::move(b)};
+}
+
+Endpoint::Endpoint(common::Logger logger, const Shaping& shaping):
+    Log(logger), shaping_(shaping)
+{
+}
+
+Endpoint::~Endpoint()
+{
+    stop();
+    if (link_) {
+        std::unique_lock<std::shared_mutex> lk(link_->mutex);
+        link_->ends[side_] = nullptr;
+    }
+}
+
+void Endpoint::write(Packet&& p, Priority prio)
+{
+    if (!open_)
+        throw transport_error(Errc::write_while_closed);
+    counters_[static_cast<uint8_t>(p.type())]++;
+    if (lost()) {
+        dropped_++;
+        return;
+    }
+    if (!shaped()) {
+        deliver(std::move(p));
+        return;
+    }
+    if (!enqueue_write(std::move(p), prio))
+        throw transport_error(Errc::write_queue_full);
+    std::lock_guard<std::mutex> lk(mutex_);
+    cv_.notify_one();
+}
+
+void Endpoint::start()
+{
+    if (is_running() || open_)
+        return;
+    log_debug(logger_, "starting transport...");
+    open();
+    if (shaped())
+        common::Thread::start(true);
+    log_debug(logger_, "transport started");
+}
+
+void Endpoint::stop()
+{
+    if (!open_ && !is_running())
+        return;
+    log_debug(logger_, "stopping transport...");
+    close();
+    if (is_running()) {
+        common::Thread::stop();
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            cv_.notify_one();
+        }
+        if (joinable())
+            join();
+    }
+    log_debug(logger_, "transport stopped");
+}
+
+bool Endpoint::is_open()
+{
+    if (!open_ || !link_)
+        return false;
+    std::shared_lock<std::shared_mutex> lk(link_->mutex);
+    auto peer = link_->ends[!side_];
+    return peer && peer->open_;
+}
+
+void Endpoint::open()
+{
+    open_ = true;
+}
+
+void Endpoint::close()
+{
+    open_ = false;
+    std::lock_guard<std::mutex> lk(room_mutex_);
+    room_cv_.notify_all();
+}
+
+bool Endpoint::read(Packet& p)
+{
+    if (!Transport::read(p))
+        return false;
+    if (room_waiters_) {
+        std::lock_guard<std::mutex> lk(room_mutex_);
+        room_cv_.notify_all();
+    }
+    return true;
+}
+
+void Endpoint::reset_counters()
+{
+    for (auto& c: counters_)
+        c = 0;
+    dropped_ = 0;
+}
+
+bool Endpoint::lost()
+{
+    const double loss = loss_;
+    if (loss <= 0)
+        return false;
+    std::lock_guard<std::mutex> lk(loss_mutex_);
+    return std::bernoulli_distribution(loss)(loss_rng_);
+}
+
+void Endpoint::deliver(Packet&& p)
+{
+    std::shared_lock<std::shared_mutex> lk(link_->mutex);
+    auto peer = link_->ends[!side_];
+    // lost with the connection, as on a socket
+    if (!peer || !peer->open_)
+        return;
+    std::lock_guard<std::mutex> rx_lk(link_->rx_mutex[!side_]);
+    if (peer->read_queue_.try_enqueue(std::move(p)))
+        return;
+
+    // a slow reader holds the writer back, up to a time base; it notifies once a writer
+    // waits, which is checked again under the lock so that no notification is missed
+    const auto deadline = Clock::now() + time_base_ms;
+    std::unique_lock<std::mutex> room_lk(peer->room_mutex_);
+    peer->room_waiters_++;
+    bool queued;
+    while (!(queued = peer->read_queue_.try_enqueue(std::move(p))) && peer->open_) {
+        if (peer->room_cv_.wait_until(room_lk, deadline) == std::cv_status::timeout) {
+            queued = peer->read_queue_.try_enqueue(std::move(p));
+            break;
+        }
+    }
+    peer->room_waiters_--;
+    if (!queued && peer->open_)
+        throw transport_error(Errc::read_queue_full);
+}
+
+void Endpoint::run()
+{
+    notify_running();
+    std::uniform_int_distribution<int64_t> jitter(0, shaping_.jitter.count());
+    std::deque<InFlight> in_flight;
+    Clock::time_point link_free = Clock::now();
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (is_running()) {
+        auto now = Clock::now();
+        // the link takes the next packet, by priority, once the previous one is serialized
+        Packet p;
+        if (now >= link_free && dequeue_write(p)) {
+            if (shaping_.bandwidth > 0)
+                link_free = now + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(p.size() / shaping_.bandwidth));
+            else
+                link_free = now;
+            auto arrival = link_free + shaping_.latency + std::chrono::microseconds(jitter(rng_));
+            if (!in_flight.empty())
+                arrival = std::max(arrival, in_flight.back().arrival);
+            in_flight.push_back({arrival, std::move(p)});
+            continue;
+        }
+        if (!in_flight.empty() && in_flight.front().arrival <= now) {
+            lk.unlock();
+            try {
+                deliver(std::move(in_flight.front().packet));
+            } catch (transport_error& e) {
+                log_warn(logger_, "packet dropped: {}", e.what());
+            }
+            lk.lock();
+            in_flight.pop_front();
+            continue;
+        }
+
+        auto wakeup = now + time_base_ms;
+        if (!in_flight.empty())
+            wakeup = std::min(wakeup, in_flight.front().arrival);
+        if (now < link_free)
+            wakeup = std::min(wakeup, link_free);
+        cv_.wait_until(lk, wakeup);
+    }
+}
+
+} /* namespace loopback */
+} /* namespace transport */
+} /* namespace hdcp */
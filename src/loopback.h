@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <random>
+#include <shared_mutex>
+
+#include "common/thread.h"
+
+#include "transport.h"
+
+namespace hdcp {
+namespace transport {
+namespace loopback {
+
+/// Link model of the packets written to one end, none by default
+struct Shaping
+{
+    std::chrono::microseconds latency {0};   // one way, once the packet is serialized
+    std::chrono::microseconds jitter  {0};   // uniform extra delay, the order is kept
+    double                    bandwidth = 0; // bytes/s, unlimited if 0
+};
+
+struct Link;
+
+/*
+ * One end of an in-process transport: the packets written are moved to the read queue of the
+ * other end, without syscall nor io thread. With shaping, a thread of the end serializes them
+ * on the link in priority order and delivers them once delayed. An end is open as long as
+ * both are, reopening one end reconnects them. A writer finding the read queue of the other
+ * end full waits for its reader. The packets written are counted by type, lost ones included.
+ */
+class Endpoint: public common::Log, private common::Thread, public Transport
+{
+public:
+    Endpoint(common::Logger logger, const Shaping& shaping = {});
+    ~Endpoint();
+
+    using Transport::write;
+    void write(Packet&& p, Priority prio) override;
+    void start()   override;
+    void stop()    override;
+    bool is_open() override;
+    void open()    override;
+    void close()   override;
+    bool read(Packet& p) override;
+    size_t max_frame_size() const override {return Packet::max_frame_size;}
+
+    /// Probability of losing a packet written, none by default
+    void     set_loss(double probability) {loss_ = probability;}
+    uint64_t count(Packet::Type t) const {return counters_[static_cast<uint8_t>(t)];}
+    /// Packets lost, see set_loss()
+    uint64_t dropped() const {return dropped_;}
+    void     reset_counters();
+
+private:
+    using common::Thread::start;
+    using Clock = std::chrono::steady_clock;
+
+    struct InFlight
+    {
+        Clock::time_point arrival;
+        Packet            packet;
+    };
+
+    std::shared_ptr<Link>   link_;
+    size_t                  side_ = 0;
+    Shaping                 shaping_;
+    std::atomic_bool        open_ = false;
+    std::mt19937            rng_ {std::random_device()()};
+    // wakes the shaping thread on write
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    // wakes the writers of the other end once the read queue has room
+    std::mutex              room_mutex_;
+    std::condition_variable room_cv_;
+    std::atomic<int>        room_waiters_ = 0;
+    std::atomic<double>     loss_ = 0;
+    std::mutex              loss_mutex_;
+    std::mt19937            loss_rng_ {std::random_device()()};
+    std::atomic<uint64_t>   dropped_ = 0;
+    std::array<std::atomic<uint64_t>, 256> counters_ {};
+
+    bool shaped() const
+    {
+        return shaping_.latency.count() || shaping_.jitter.count() || shaping_.bandwidth > 0;
+    }
+    bool lost();
+    void deliver(Packet&& p);
+    void run() override;
+
+    friend std::pair<std::unique_ptr<Endpoint>, std::unique_ptr<Endpoint>>
+    make_pair(common::Logger, const Shaping&, const Shaping&);
+};
+
+/// Connected ends, e.g. for a Master and a Slave in one process; shaping applies to the
+/// packets written to the first end, then to the second one
+std::pair<std::unique_ptr<Endpoint>, std::unique_ptr<Endpoint>>
+make_pair(common::Logger logger, const Shaping& first = {}, const Shaping& second = {});
+
+} /* namespace loopback */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "lz.h"
+
+namespace hdcp {
+namespace lz {
+
+namespace {
+
+constexpr size_t min_match  = 4;
+constexpr size_t max_offset = 0xffff;
+constexpr int    hash_bits  = 12;
+constexpr size_t run_mask   = 0x0f;
+
+uint32_t load32(const uint8_t * p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - hash_bits);
+}
+
+// lengths above the token nibble continue in 255 valued bytes
+uint8_t * write_length(uint8_t * op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+bool read_length(const uint8_t *& ip, const uint8_t * iend, size_t& len)
+{
+    uint8_t b;
+    do {
+        if (ip >= iend)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// a sequence without match (match_len 0) is the last one
+uint8_t * write_sequence(uint8_t * op, const uint8_t * oend, const uint8_t * literals,
+                         size_t lit_len, size_t offset, size_t match_len)
+{
+    const size_t worst = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    if (worst > static_cast<size_t>(oend - op))
+        return nullptr;
+
+    uint8_t * token = op++;
+    *token = std::min(lit_len, run_mask) << 4;
+    if (lit_len >= run_mask)
+        op = write_length(op, lit_len - run_mask);
+    std::memcpy(op, literals, lit_len);
+    op += lit_len;
+    if (match_len == 0)
+        return op;
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    size_t ml = match_len - min_match;
+    *token |= std::min(ml, run_mask);
+    if (ml >= run_mask)
+        op = write_length(op, ml - run_mask);
+    return op;
+}
+
+} /* namespace */
+
+size_t compress(std::string_view src, char * dst, size_t dst_size)
+{
+    auto in   = reinterpret_cast<const uint8_t*>(src.data());
+    auto op   = reinterpret_cast<uint8_t*>(dst);
+    auto oend = op + dst_size;
+    const size_t n = src.size();
+
+    // positions + 1, 0 is an empty slot
+    std::array<uint32_t, 1 << hash_bits> table {};
+    size_t anchor = 0;
+    size_t ip     = 0;
+    while (ip + min_match <= n) {
+        uint32_t seq = load32(in + ip);
+        uint32_t h   = hash(seq);
+        size_t   ref = table[h];
+        table[h] = ip + 1;
+        if (!ref || ip - (ref - 1) > max_offset || load32(in + ref - 1) != seq) {
+            ip++;
+            continue;
+        }
+        size_t m   = ref - 1;
+        size_t len = min_match;
+        while (ip + len < n && in[m + len] == in[ip + len])
+            len++;
+        if (!(op = write_sequence(op, oend, in + anchor, ip - anchor, ip - m, len)))
+            return 0;
+        ip    += len;
+        anchor = ip;
+    }
+    if (!(op = write_sequence(op, oend, in + anchor, n - anchor, 0, 0)))
+        return 0;
+    return op - reinterpret_cast<uint8_t*>(dst);
+}
+
+bool decompress(std::string_view src, char * dst, size_t dst_size)
+{
+    auto ip   = reinterpret_cast<const uint8_t*>(src.data());
+    auto iend = ip + src.size();
+    auto out  = reinterpret_cast<uint8_t*>(dst);
+    auto op   = out;
+    auto oend = out + dst_size;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == run_mask && !read_length(ip, iend, lit_len))
+            return false;
+        if (lit_len > static_cast<size_t>(iend - ip) || lit_len > static_cast<size_t>(oend - op))
+            return false;
+        std::memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - out))
+            return false;
+        size_t match_len = token & run_mask;
+        if (match_len == run_mask && !read_length(ip, iend, match_len))
+            return false;
+        match_len += min_match;
+        if (match_len > static_cast<size_t>(oend - op))
+            return false;
+        const uint8_t * m = op - offset;
+        if (offset >= match_len) {
+            std::memcpy(op, m, match_len);
+        } else {
+            // overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < match_len; i++)
+                op[i] = m[i];
+        }
+        op += match_len;
+    }
+    return op == oend;
+}
+
+} /* namespace lz */
+} /* namespace hdcp */
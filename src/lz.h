@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace hdcp {
+namespace lz {
+
+/*
+ * Byte oriented LZ77 codec in the spirit of LZ4: sequences of literals followed by a match
+ * of at least 4 bytes within the previous 64 KiB. Greedy single-probe matching favours speed
+ * over ratio, the payloads are small and the links slow.
+ */
+
+/// Worst case size of n compressed bytes
+constexpr size_t max_compressed_size(size_t n) {return n + n / 255 + 16;}
+
+/// Compressed size written in dst, 0 if it does not fit in dst_size
+size_t compress(std::string_view src, char * dst, size_t dst_size);
+/// Fill exactly dst_size bytes, false if src is malformed or does not match dst_size
+bool   decompress(std::string_view src, char * dst, size_t dst_size);
+
+} /* namespace lz */
+} /* namespace hdcp */
@@ -1,9 +1,25 @@
+#include <unordered_set>
+
 #include "master.h"
 #include "application_error.h"
 
 namespace hdcp {
 namespace appli {
 
+/// A command sent in fragments, known by the handle of its first one
+struct Master::Fragmented
+{
+    std::mutex                          mutex;
+    std::vector<Packet::Block>          fragments;
+    Request::Callback                   cb;
+    CommandOptions                      opts;
+    Request::Handle                     handle = 0;
+    size_t                              next   = 0; // first fragment not sent
+    size_t                              acked  = 0;
+    std::unordered_set<Request::Handle> in_flight;
+    bool                                done   = false;
+};
+
 Master::Master(common::Logger logger, const Identification& master_id,
                std::unique_ptr<Transport> transport):
     common::Log(logger),
@@ -11,8 +27,13 @@ Master::Master(common::Logger logger, const Identification& master_id,
     transport_(std::move(transport)),
     request_manager_(logger, transport_.get(),
                      std::bind(&Master::timeout_cb, this, std::placeholders::_1)),
-    master_id_(master_id)
+    master_id_(master_id),
+    bulk_([this](const Packet::BulkChunk& chunk) {request_manager_.send_bulk(chunk);},
+          [this] {return request_manager_.rtt_stats().rto;}),
+    channels_(logger)
 {
+    requested_.max_frame_size = transport_->max_frame_size();
+    requested_.checksums      = default_checksums;
     statemachine_.set_transition_handler(
         [this] (const common::Statemachine<State>::State * p,
                 const common::Statemachine<State>::State * c)
@@ -39,6 +60,7 @@ void Master::start()
         return;
     log_debug(logger_, "starting application...");
     transport_->start();
+    channels_.start();
     statemachine_.reinit();
     common::Thread::start(true);
     log_debug(logger_, "application started");
@@ -54,16 +76,153 @@ void Master::stop()
     if (joinable())
         join();
     request_manager_.stop();
+    channels_.stop();
     transport_->stop();
     log_debug(logger_, "application stopped");
 }
 
-void Master::send_command(Packet::BlockType id, const std::string& data, Request::Callback cb)
+Request::Handle Master::send_command(Packet::BlockType id, const std::string& data,
+                                     Request::Callback cb, const CommandOptions& opts)
 {
     if (state() != State::connected)
         throw hdcp::application_error(Errc::write_while_disconnected);
+    if (Packet::is_reserved(id))
+        throw hdcp::application_error(Errc::reserved_block_type, fmt::format("{:#x}", id));
+
+    const size_t max_pl_size = session_.max_frame_size - Packet::max_header_size;
+    if (session_.features & Feature::fragmentation &&
+        data.size() + Packet::block_header_size(session_.version) > max_pl_size)
+        return send_fragments(id, data, cb, opts);
+    return request_manager_.send_command(id, data, cb, opts);
+}
+
+Request::Handle Master::send_fragments(Packet::BlockType id, const std::string& data,
+                                       Request::Callback cb, const CommandOptions& opts)
+{
+    Packet::BlockView b;
+    b.type = id;
+    b.data = data;
+    auto f = std::make_shared<Fragmented>();
+    f->fragments = Packet::make_fragments(b, message_id_++,
+                                          session_.max_frame_size - Packet::max_header_size,
+                                          session_.version);
+    f->cb   = cb;
+    f->opts = opts;
+
+    // acks wait for the lock, the command is known by its handle before the first one
+    std::lock_guard<std::mutex> lk(f->mutex);
+    send_fragments(f);
+    std::lock_guard<std::mutex> flk(fragmented_mutex_);
+    fragmented_.emplace(f->handle, f);
+    return f->handle;
+}
+
+void Master::send_fragments(const std::shared_ptr<Fragmented>& f)
+{
+    while (f->next < f->fragments.size() && f->in_flight.size() < fragment_window) {
+        auto& fragment = f->fragments[f->next++];
+        auto handle = request_manager_.send_command(fragment.type, fragment.data,
+                                                    [this, f](Request& r) {fragment_cb(f, r);},
+                                                    f->opts);
+        if (f->next == 1)
+            f->handle = handle;
+        f->in_flight.insert(handle);
+    }
+}
+
+void Master::fragment_cb(const std::shared_ptr<Fragmented>& f, Request& r)
+{
+    // the command completes with its last fragment, or fails with the first one
+    std::vector<Request::Handle> in_flight;
+    {
+        std::lock_guard<std::mutex> lk(f->mutex);
+        f->in_flight.erase(r.get_handle());
+        if (f->done)
+            return;
+        if (r.get_status() == Request::Status::fulfilled &&
+            ++f->acked < f->fragments.size()) {
+            send_fragments(f);
+            return;
+        }
+        f->done = true;
+        in_flight.assign(f->in_flight.begin(), f->in_flight.end());
+    }
+    {
+        std::lock_guard<std::mutex> lk(fragmented_mutex_);
+        fragmented_.erase(f->handle);
+    }
+    for (auto h: in_flight)
+        request_manager_.cancel(h);
+    if (f->cb)
+        f->cb(r);
+}
+
+bool Master::cancel(Request::Handle handle)
+{
+    std::shared_ptr<Fragmented> f;
+    {
+        std::lock_guard<std::mutex> lk(fragmented_mutex_);
+        auto it = fragmented_.find(handle);
+        if (it == fragmented_.end())
+            return request_manager_.cancel(handle);
+        f = it->second;
+    }
+    // the first fragment cancelled fails the command, which cancels the others
+    std::vector<Request::Handle> in_flight;
+    {
+        std::lock_guard<std::mutex> lk(f->mutex);
+        if (f->done)
+            return false;
+        f->next = f->fragments.size();
+        in_flight.assign(f->in_flight.begin(), f->in_flight.end());
+    }
+    bool cancelled = false;
+    for (auto h: in_flight)
+        cancelled |= request_manager_.cancel(h);
+    return cancelled;
+}
+
+master::BulkResult Master::send_bulk(Packet::BlockType type, master::BulkSource& source,
+                                     const master::BulkOptions& opts)
+{
+    if (state() != State::connected)
+        throw hdcp::application_error(Errc::write_while_disconnected);
+    if (!(session_.features & Feature::bulk_transfer))
+        throw hdcp::application_error(Errc::feature_not_negotiated, "bulk transfer");
+
+    const size_t max_pl_size = session_.max_frame_size - Packet::max_header_size;
+    return bulk_.send(type, source, Packet::bulk_chunk_size(max_pl_size, session_.version), opts);
+}
+
+std::vector<Request::Handle> Master::send_commands(std::vector<Command>& cmds,
+                                                   const CommandOptions& opts)
+{
+    if (state() != State::connected)
+        throw hdcp::application_error(Errc::write_while_disconnected);
+    for (auto& c: cmds) {
+        if (Packet::is_reserved(c.type))
+            throw hdcp::application_error(Errc::reserved_block_type, fmt::format("{:#x}", c.type));
+    }
+
+    return request_manager_.send_commands(cmds, opts, session_.features & Feature::cmd_batching);
+}
+
+Request::Handle Master::subscribe(const std::vector<Packet::Subscription>& subscriptions,
+                                  Request::Callback cb)
+{
+    std::lock_guard<std::mutex> lk(subscriptions_mutex_);
+    subscriptions_ = subscriptions;
+    if (state() != State::connected)
+        return 0;
+    return send_subscriptions(cb);
+}
 
-    request_manager_.send_command(id, data, cb, command_timeout_);
+Request::Handle Master::send_subscriptions(Request::Callback cb)
+{
+    if (!(session_.features & Feature::subscriptions))
+        return 0;
+    auto b = Packet::make_subscribe(subscriptions_);
+    return request_manager_.send_command(b.type, b.data, cb);
 }
 
 void Master::async_connect()
@@ -106,6 +265,11 @@ common::transition_status Master::handler_state_disconnected()
 {
     if (statemachine_.nb_loop_in_current_state() == 1) {
         slave_id_ = Identification();
+        session_  = Session();
+        transport_->set_session(session_);
+        data_recovery_.clear();
+        reassembler_.clear();
+        bulk_.interrupt();
         request_manager_.stop();
     }
 
@@ -126,7 +290,10 @@ common::transition_status Master::handler_state_connecting()
     if (connection_attempts_== 0 || evt_mngr_.erase(Event::dip_timeout)) {
         connection_attempts_++;
         log_info(logger_, "connection attempt {}", connection_attempts_);
-        request_manager_.send_hip(master_id_, connecting_timeout_);
+        // only advertise capabilities when some features are requested, as old masters did
+        request_manager_.send_hip(master_id_,
+                                  requested_.features ? requested_.encode() : std::string(),
+                                  connecting_timeout_);
     }
 
     Packet p;
@@ -138,7 +305,7 @@ common::transition_status Master::handler_state_connecting()
     case Packet::Type::dip:
         if (p.id() != 1)
             log_warn(logger_, "dip id should be 1");
-        received_packet_id_ = p.id();
+        rx_sequence_.reset(p.id());
         set_slave_id(p);
         request_manager_.ack_dip();
         evt_mngr_.notify(Event::dip_received);
@@ -154,38 +321,154 @@ common::transition_status Master::handler_state_connecting()
 common::transition_status Master::handler_state_connected()
 {
     if (statemachine_.nb_loop_in_current_state() == 1) {
-        request_manager_.start_keepalive_management(keepalive_interval, keepalive_timeout);
+        request_manager_.start_keepalive_management(keepalive_interval, keepalive_timeout,
+                                                    session_.features & Feature::passive_keepalive);
+        channels_.reset();
+        std::lock_guard<std::mutex> lk(subscriptions_mutex_);
+        if (!subscriptions_.empty())
+            send_subscriptions({});
     }
 
+    const bool reliable_data = session_.features & Feature::reliable_data;
+    reassembler_.expire(Reassembler::Clock::now());
     Packet p;
-    if (!transport_->read(p))
+    if (!transport_->read(p)) {
+        if (reliable_data)
+            send_nacks();
         return common::transition_status::stay_curr_state;
+    }
+    if (!session_.accepts(p)) {
+        log_warn(logger_, "packet {} dropped: checksum {} not agreed", p.id(),
+                 static_cast<int>(p.checksum()));
+        return common::transition_status::stay_curr_state;
+    }
+    if (p.compressed()) {
+        try {
+            p.decompress(session_.max_frame_size);
+        } catch (packet_error& e) {
+            log_warn(logger_, "packet {} dropped: {}", p.id(), e.what());
+            return common::transition_status::stay_curr_state;
+        }
+    }
 
     log_trace(logger_, "{}", p);
-    if (++received_packet_id_ != p.id()) {
-        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), received_packet_id_);
-        received_packet_id_ = p.id();
+    // with reliable_data the slave numbers its data packets apart, they alone make a sequence
+    SequenceTracker::Result seq {SequenceTracker::Status::in_order, p.id()};
+    if (!reliable_data || p.type() == Packet::Type::data)
+        seq = rx_sequence_.update(p.id());
+    switch (seq.status) {
+    case SequenceTracker::Status::gap:
+        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), seq.expected);
+        if (reliable_data)
+            data_recovery_.add_gap(seq.expected, p.id());
+        break;
+    case SequenceTracker::Status::late:
+        if (reliable_data && data_recovery_.recover(p)) {
+            // retransmitted data is delivered as soon as received, out of the id sequence
+            receive_data(p);
+            send_nacks();
+            return common::transition_status::stay_curr_state;
+        }
+        break;
+    case SequenceTracker::Status::duplicate:
+        if (p.type() == Packet::Type::data) {
+            log_debug(logger_, "duplicate data packet {} dropped", p.id());
+            return common::transition_status::stay_curr_state;
+        }
+        break;
+    default:
+        break;
     }
+
+    // any valid packet proves the slave is alive
+    if (session_.features & Feature::passive_keepalive)
+        request_manager_.refresh_keepalive();
+
     switch (p.type()) {
     case Packet::Type::cmd_ack:
         request_manager_.ack_command(p);
         break;
     case Packet::Type::data:
-        if (data_cb_)
-            data_cb_(p);
+        receive_data(p);
         break;
     case Packet::Type::ka_ack:
         request_manager_.ack_keepalive();
         break;
+    case Packet::Type::bulk_ack:
+    {
+        uint32_t transfer;
+        uint64_t offset;
+        auto blocks = p.blocks();
+        if (blocks.size() == 1 && Packet::parse_bulk_ack(blocks[0], transfer, offset))
+            bulk_.ack(transfer, offset);
+        else
+            log_warn(logger_, "invalid bulk ack {}", p.id());
+        break;
+    }
     default:
         log_warn(logger_,
                  "you should not receive this packet type ({:#x}) while connected", p.type());
         break;
     }
 
+    if (reliable_data)
+        send_nacks();
+
     return common::transition_status::stay_curr_state;
 }
 
+void Master::receive_data(Packet& p)
+{
+    if (!(session_.features & Feature::channels) || !channels_.dispatch(p))
+        deliver(p);
+}
+
+void Master::deliver(const Packet& p)
+{
+    const bool fragmentation = session_.features & Feature::fragmentation;
+    if (!data_handlers_.empty() || fragmentation) {
+        p.for_each_block([&](const Packet::BlockView& b) {
+            Packet::Fragment fragment;
+            if (!fragmentation || !Packet::parse_fragment(b, fragment)) {
+                deliver(p, b);
+                return;
+            }
+            if (auto message = reassembler_.add(fragment, Reassembler::Clock::now())) {
+                auto whole = message->block();
+                if (data_handlers_.find(whole.type))
+                    deliver(p, whole);
+                else if (block_cb_)
+                    block_cb_(whole);
+            }
+        });
+    }
+    if (data_cb_)
+        data_cb_(p);
+}
+
+void Master::deliver(const Packet& p, const Packet::BlockView& b)
+{
+    // array blocks go to the handler of their elements
+    Packet::ArrayView array;
+    auto type = Packet::parse_array(b, array) ? array.type : b.type;
+    if (auto handler = data_handlers_.find(type)) {
+        try {
+            (*handler)(b);
+        } catch (std::exception& e) {
+            log_error(logger_, "failed to handle data {}: {}", p.id(), e.what());
+        }
+    }
+}
+
+void Master::send_nacks()
+{
+    // holes are nacked again once the retransmission had time to come back
+    auto missing = data_recovery_.due(master::DataRecovery::Clock::now(),
+                                      request_manager_.rtt_stats().rto, rx_sequence_.last());
+    if (!missing.empty())
+        request_manager_.send_nack(missing);
+}
+
 common::transition_status Master::check_true()
 {
     return common::transition_status::goto_next_state;
@@ -261,6 +544,8 @@ void Master::run()
 
 void Master::set_slave_id(const Packet& p)
 {
+    // old slaves do not answer with capabilities: nothing is turned on
+    Capabilities accepted;
     for (auto& b: p.blocks()) {
         switch (b.type) {
         case Packet::ReservedBlockType::name:
@@ -275,13 +560,25 @@ void Master::set_slave_id(const Packet& p)
         case Packet::ReservedBlockType::sw_version:
             slave_id_.sw_version = b.data;
             break;
+        case Packet::ReservedBlockType::capabilities:
+            accepted = Capabilities::decode(b.data);
+            break;
         default:
-            log_warn(logger_,
-                     "you should not received this block type ({:#x}) in an identification packet",
-                     b.type);
+            // newer slaves may add blocks, they are not a reason to fail the handshake
+            log_debug(logger_, "ignoring block type {:#x} in an identification packet", b.type);
         }
     }
+    session_ = Session(requested_.agree(accepted));
+    // the dip is the last v1 packet, both ends switch right after it
+    request_manager_.set_session(session_);
+    transport_->set_session(session_);
+    if (session_.features & Feature::reliable_data)
+        rx_sequence_.reset(0, session_.version);
+    else
+        rx_sequence_.set_version(session_.version);
+    data_recovery_.set_session(session_);
     log_debug(logger_, "device {}", slave_id_);
+    log_debug(logger_, "{} (requested features {:#x})", session_, requested_.features);
 }
 
 void Master::timeout_cb(master::RequestManager::TimeoutType timeout_type)
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "common/log.h"
 #include "common/statemachine.h"
 #include "common/thread.h"
 #include "common/event_mngr.h"
 
 #include "master_request.h"
+#include "master_recovery.h"
+#include "master_bulk.h"
+#include "master_channel.h"
+#include "sequence.h"
+#include "reassembly.h"
+#include "handler_table.h"
 #include "transport.h"
 #include "application.h"
 
@@ -22,6 +31,8 @@ public:
         connected
     };
     using DataCallback   = std::function<void(const Packet&)>;
+    /// Blocks received in fragments, the view is valid during the call
+    using BlockCallback  = std::function<void(const Packet::BlockView&)>;
     using StatusCallback = std::function<void(State, const std::error_code&)>;
 
     Master(common::Logger logger, const Identification& id, std::unique_ptr<Transport> transport);
@@ -30,15 +41,102 @@ public:
     State state() const {return statemachine_.curr_state();};
     const Identification& master_id() const {return master_id_;}
     const Identification& slave_id()  const {return slave_id_;}
+    Features              features()  const {return session_.features;}
+    /// Largest frame agreed with the slave, Packet::max_size without Feature::large_frames
+    size_t                max_frame_size() const {return session_.max_frame_size;}
+    const Session&        session()   const {return session_;}
+    RttStats              rtt_stats() const {return request_manager_.rtt_stats();}
+    master::DataRecoveryStats data_recovery_stats() const {return data_recovery_.stats();}
+    /// Loss, reordering and duplicates of the packets received from the slave, of the data
+    /// packets only with Feature::reliable_data
+    SequenceStats         rx_stats()  const {return rx_sequence_.stats();}
+    /// Data blocks received in fragments, Feature::fragmentation
+    ReassemblyStats       reassembly_stats() const {return reassembler_.stats();}
 
     void start();
     void stop() override;
+    /// Called with every data packet, after the handlers of its blocks
     void set_data_cb(DataCallback&& cb)     {data_cb_   = std::forward<DataCallback>(cb);}
+    /**
+     * Queue the data packets of a logical channel apart, to be set before start() with
+     * Feature::channels requested. They are passed to opts.cb on a thread of the channel or
+     * pulled with read(), instead of going through the data callback and handlers. Throws
+     * invalid_channel once started.
+     */
+    void open_channel(uint16_t channel, const master::ChannelOptions& opts = {})
+    {
+        channels_.open(channel, opts);
+    }
+    /// Wait for a packet of a channel opened without callback, one reader per channel
+    bool read(uint16_t channel, Packet& p, std::chrono::milliseconds timeout)
+    {
+        return channels_.read(channel, p, timeout);
+    }
+    master::ChannelStats channel_stats(uint16_t channel) const {return channels_.stats(channel);}
+    /// Called with each data block reassembled from fragments, if it has no handler
+    void set_block_cb(BlockCallback&& cb)   {block_cb_  = std::forward<BlockCallback>(cb);}
+    /// Handle the data blocks of one type, or array blocks of its elements, before start();
+    /// not a reserved type
+    void on_data(Packet::BlockType type, DataHandler&& handler)
+    {
+        data_handlers_.set(type, std::forward<DataHandler>(handler));
+    }
+    /// handler takes each decoded T, or a TypedView<T> of all the values of a block
+    template<typename T, typename F>
+    void on_data(Packet::BlockType type, F&& handler)
+    {
+        data_handlers_.set(type, make_data_handler<T>(std::forward<F>(handler)));
+    }
+    template<typename T, typename F>
+    void on_data(F&& handler) {on_data<T>(block_type_of<T>, std::forward<F>(handler));}
     void set_status_cb(StatusCallback&& cb) {status_cb_ = std::forward<StatusCallback>(cb);}
+    /// Features to request at the next connection, the slave may refuse some of them
+    void set_requested_features(Features f) {requested_.features = f;}
+    /// Largest frame requested with Feature::large_frames, the slave may lower it; that of the
+    /// transport by default and at most
+    void set_max_frame_size(size_t size)
+    {
+        requested_.max_frame_size = std::clamp(size, Packet::max_size,
+                                               transport_->max_frame_size());
+    }
+    /// Codecs the slave may compress data with, none by default
+    void set_requested_codecs(Codecs c) {requested_.codecs = c;}
+    /// Pad data blocks so that they can be read in place as arrays, 8, 16 or 32 with
+    /// Feature::extended_id, not padded by default
+    void set_requested_alignment(size_t a) {requested_.alignment = a;}
+    /// Everything advertised in the hip, capabilities the slave does not know are dropped
+    void set_requested_capabilities(const Capabilities& c) {requested_ = c;}
+    /// Derive command timeouts from measured rtt (default) or use a fixed command_timeout_,
+    /// CommandOptions::timeout overrides both
+    void set_adaptive_command_timeout(bool enable) {request_manager_.set_adaptive_timeout(enable);}
     void async_connect();
     void async_disconnect();
     void connect();
-    void send_command(Packet::BlockType id, const std::string& data, Request::Callback cb);
+    /// Data too large for a packet is sent in fragments with Feature::fragmentation, at most
+    /// fragment_window of them unacked; the callback is then called once, on the first
+    /// failure or the last fragment acked, and the handle cancels every fragment.
+    /// Throws reserved_block_type for a type of the protocol, see Packet::is_reserved()
+    Request::Handle send_command(Packet::BlockType id, const std::string& data,
+                                 Request::Callback cb, const CommandOptions& opts = {});
+    /// Commands are packed in as few packets as possible if cmd_batching has been negotiated
+    std::vector<Request::Handle> send_commands(std::vector<Command>& cmds,
+                                               const CommandOptions& opts = {});
+    /**
+     * Only receive the data blocks of these types, each one every decimation, an empty list
+     * restores every type. Kept and sent again at each connection, Feature::subscriptions must
+     * be requested. Returns 0 when only kept, for lack of connection or feature.
+     */
+    Request::Handle subscribe(const std::vector<Packet::Subscription>& subscriptions,
+                              Request::Callback cb = {});
+    /**
+     * Send the data of source in bulk chunks, blocks until the slave received all of it or
+     * the transfer is interrupted. An interrupted transfer is resumed, once reconnected, by
+     * passing its id in opts. Feature::bulk_transfer must be negotiated.
+     */
+    master::BulkResult send_bulk(Packet::BlockType type, master::BulkSource& source,
+                                 const master::BulkOptions& opts = {});
+    /// Drop a pending command, its callback is called with a cancelled status
+    bool cancel(Request::Handle handle);
 
 private:
     using common::Thread::start;
@@ -96,15 +194,40 @@ private:
     master::RequestManager        request_manager_;
     Identification                master_id_;
     Identification                slave_id_;
-    Packet::Id                    received_packet_id_;
+    SequenceTracker               rx_sequence_;
+    master::DataRecovery          data_recovery_;
+    master::BulkSender            bulk_;
+    master::ChannelDemux          channels_;
     uint                          connection_attempts_;
+    Capabilities                  requested_; // set by the constructor
+    Session                       session_;
 
     DataCallback                  data_cb_;
+    BlockCallback                 block_cb_;
+    Reassembler                   reassembler_;
+    std::atomic<uint32_t>         message_id_ = 0;
+    struct Fragmented;
+    // commands being sent in fragments, by handle
+    std::unordered_map<Request::Handle, std::shared_ptr<Fragmented>> fragmented_;
+    std::mutex                    fragmented_mutex_;
+    HandlerTable<DataHandler>     data_handlers_;
+    std::vector<Packet::Subscription> subscriptions_;
+    // kept with the sending so that a reconnection does not send an older list last
+    std::mutex                    subscriptions_mutex_;
     StatusCallback                status_cb_;
     std::error_code               errc_;
 
     void run() override;
     void set_slave_id(const Packet& p);
+    void send_nacks();
+    void receive_data(Packet& p);
+    void deliver(const Packet& p);
+    void deliver(const Packet& p, const Packet::BlockView& b);
+    Request::Handle send_fragments(Packet::BlockType id, const std::string& data,
+                                   Request::Callback cb, const CommandOptions& opts);
+    void send_fragments(const std::shared_ptr<Fragmented>& f);
+    void fragment_cb(const std::shared_ptr<Fragmented>& f, Request& r);
+    Request::Handle send_subscriptions(Request::Callback cb);
     void timeout_cb(master::RequestManager::TimeoutType);
 };
 
@@ -0,0 +1,174 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <random>
+#include <system_error>
+
+#include "master_bulk.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+FileSource::FileSource(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        int e = errno;
+        ::close(fd);
+        throw std::system_error(e, std::generic_category(), path);
+    }
+    size_ = st.st_size;
+    if (size_) {
+        void * p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            int e = errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), path);
+        }
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(p);
+    }
+    // the mapping keeps the file
+    ::close(fd);
+}
+
+FileSource::~FileSource()
+{
+    if (data_)
+        ::munmap(const_cast<char*>(data_), size_);
+}
+
+std::string_view FileSource::read(uint64_t offset, size_t len)
+{
+    return std::string_view(data_, size_).substr(offset, len);
+}
+
+BulkResult BulkSender::send(Packet::BlockType type, BulkSource& source, size_t chunk_size,
+                            const BulkOptions& opts)
+{
+    std::lock_guard<std::mutex> send_lk(send_mutex_);
+    const uint64_t size   = source.size();
+    const uint64_t window = std::max<size_t>(opts.window, 1) * chunk_size;
+    uint32_t transfer = opts.transfer;
+    while (!transfer)
+        transfer = std::random_device()();
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    active_      = true;
+    interrupted_ = false;
+    transfer_    = transfer;
+    size_        = size;
+    acked_       = 0;
+    acks_        = 0;
+    dup_acks_    = 0;
+
+    Packet::BulkChunk chunk = {transfer, type, size, 0, {}};
+    auto result = [&](BulkResult::Status status) {
+        active_ = false;
+        return BulkResult{status, transfer, acked_};
+    };
+
+    // the slave answers the probe with the offset to resume from
+    uint retry = 0;
+    while (!acks_) {
+        if (interrupted_ || retry++ > max_bulk_retry)
+            return result(BulkResult::Status::interrupted);
+        lk.unlock();
+        try {
+            send_(chunk);
+        } catch (std::exception&) {
+            lk.lock();
+            return result(BulkResult::Status::interrupted);
+        }
+        lk.lock();
+        cv_.wait_for(lk, rto_(), [&]{return acks_ || interrupted_;});
+    }
+
+    uint64_t next       = acked_;
+    uint64_t last_acked = acked_;
+    bool     recovering = false; // gone back after duplicate acks, until acked_ moves
+    retry = 0;
+    while (acked_ < size) {
+        if (interrupted_)
+            return result(BulkResult::Status::interrupted);
+        // fill the window, the acks may move meanwhile
+        while (next < size && next < acked_ + window) {
+            chunk.offset = next;
+            lk.unlock();
+            try {
+                chunk.data = source.read(next, std::min<uint64_t>(chunk_size, size - next));
+                send_(chunk);
+            } catch (std::exception&) {
+                lk.lock();
+                return result(BulkResult::Status::interrupted);
+            }
+            lk.lock();
+            next += chunk.data.size();
+        }
+
+        const bool progress = cv_.wait_for(lk, rto_(), [&]{
+            return acked_ != last_acked || (!recovering && dup_acks_ >= dup_ack_threshold) ||
+                   interrupted_;
+        });
+        if (acked_ != last_acked) {
+            last_acked = acked_;
+            recovering = false;
+            retry      = 0;
+            if (opts.progress) {
+                const uint64_t acked = acked_;
+                lk.unlock();
+                opts.progress(acked, size);
+                lk.lock();
+            }
+        } else if (!progress) {
+            if (++retry > max_bulk_retry)
+                return result(BulkResult::Status::interrupted);
+            next = acked_;
+        } else if (dup_acks_ >= dup_ack_threshold) {
+            // a chunk was lost, the following ones are dropped by the slave
+            recovering = true;
+            next       = acked_;
+        }
+        // the chunks after acked_ are all in flight or lost
+        next = std::max(next, acked_);
+    }
+    return result(BulkResult::Status::completed);
+}
+
+void BulkSender::ack(uint32_t transfer, uint64_t offset)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (!active_ || transfer != transfer_ || offset > size_)
+            return;
+        if (offset > acked_ || !acks_) {
+            acked_    = offset;
+            dup_acks_ = 0;
+        } else if (offset == acked_) {
+            dup_acks_++;
+        }
+        acks_++;
+    }
+    cv_.notify_all();
+}
+
+void BulkSender::interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (!active_)
+            return;
+        interrupted_ = true;
+    }
+    cv_.notify_all();
+}
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "packet.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+/// Data of a bulk transfer, read in chunks in offset order, again from the acked offset on loss
+class BulkSource
+{
+public:
+    virtual ~BulkSource() = default;
+    virtual uint64_t size() const = 0;
+    /// At most len bytes at offset, valid until the next read
+    virtual std::string_view read(uint64_t offset, size_t len) = 0;
+};
+
+/// Data already in memory, it must outlive the transfer
+class MemorySource: public BulkSource
+{
+public:
+    MemorySource(std::string_view data): data_(data) {}
+    uint64_t         size() const override {return data_.size();}
+    std::string_view read(uint64_t offset, size_t len) override {return data_.substr(offset, len);}
+
+private:
+    std::string_view data_;
+};
+
+/// File mapped in memory, the chunks are framed straight from the page cache
+class FileSource: public BulkSource
+{
+public:
+    /// Throws std::system_error if the file cannot be opened or mapped
+    FileSource(const std::string& path);
+    ~FileSource();
+
+    uint64_t         size() const override {return size_;}
+    std::string_view read(uint64_t offset, size_t len) override;
+
+private:
+    const char * data_ = nullptr;
+    uint64_t     size_ = 0;
+
+    FileSource(const FileSource&)            = delete;
+    FileSource& operator=(const FileSource&) = delete;
+};
+
+struct BulkOptions
+{
+    uint32_t transfer = 0;           // resume this transfer, a new one if 0
+    size_t   window   = bulk_window; // chunks sent ahead of the acks
+    std::function<void(uint64_t acked, uint64_t size)> progress;
+};
+
+struct BulkResult
+{
+    enum class Status {
+        completed,
+        interrupted, // disconnected or no progress after max_bulk_retry timeouts
+    };
+    Status   status;
+    uint32_t transfer; // to resume the transfer once reconnected
+    uint64_t acked;    // bytes received in order by the slave
+};
+
+/*
+ * Sender of the bulk transfers, one at a time. Chunks are sent a window ahead of the
+ * cumulative acks of the slave and sent again from the acked offset (go-back-n) after a
+ * retransmission timeout or three duplicate acks. A transfer starts with an empty chunk
+ * asking the slave where to resume.
+ */
+class BulkSender
+{
+public:
+    using SendFunction = std::function<void(const Packet::BulkChunk&)>;
+    using RtoFunction  = std::function<std::chrono::microseconds()>;
+
+    BulkSender(SendFunction send, RtoFunction rto): send_(send), rto_(rto) {}
+
+    /// Blocks until the transfer completes or is interrupted
+    BulkResult send(Packet::BlockType type, BulkSource& source, size_t chunk_size,
+                    const BulkOptions& opts = {});
+    void ack(uint32_t transfer, uint64_t offset);
+    /// Return from send() without waiting for the timeouts, e.g. on disconnection
+    void interrupt();
+
+private:
+    static constexpr uint dup_ack_threshold = 3;
+
+    SendFunction            send_;
+    RtoFunction             rto_;
+    std::mutex              send_mutex_; // one transfer at a time
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool                    active_      = false;
+    bool                    interrupted_ = false;
+    uint32_t                transfer_    = 0;
+    uint64_t                size_        = 0;
+    uint64_t                acked_       = 0;
+    uint64_t                acks_        = 0; // received for the current transfer
+    uint                    dup_acks_    = 0;
+};
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
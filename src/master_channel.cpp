@@ -0,0 +1,108 @@
+#include "application_error.h"
+#include "master_channel.h"
+#include "transport.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+void ChannelDemux::open(uint16_t id, const ChannelOptions& opts)
+{
+    if (id == 0 || id >= max_channels)
+        throw application_error(Errc::invalid_channel, std::to_string(id));
+    // the master thread dispatches to the channels without lock once started
+    if (running_)
+        throw application_error(Errc::invalid_channel, fmt::format("{} opened once started", id));
+    channels_[id] = std::make_unique<Channel>(opts);
+    channels_[id]->sequence.reset(0, Packet::v2);
+}
+
+void ChannelDemux::start()
+{
+    if (running_)
+        return;
+    running_ = true;
+    for (auto& c: channels_) {
+        if (c && c->cb)
+            c->worker = std::thread(&ChannelDemux::run, this, std::ref(*c));
+    }
+}
+
+void ChannelDemux::stop()
+{
+    if (!running_)
+        return;
+    running_ = false;
+    for (auto& c: channels_) {
+        if (c && c->worker.joinable())
+            c->worker.join();
+    }
+}
+
+void ChannelDemux::reset()
+{
+    // the slave numbers the packets of each channel from 1 at each connection
+    for (auto& c: channels_) {
+        if (c)
+            c->sequence.reset(0, Packet::v2);
+    }
+}
+
+bool ChannelDemux::dispatch(Packet& p)
+{
+    uint16_t id;
+    uint32_t seq;
+    Channel * c;
+    if (!p.channel_of(id, seq) || !(c = find(id)))
+        return false;
+
+    auto r = c->sequence.update(seq);
+    switch (r.status) {
+    case SequenceTracker::Status::gap:
+        log_debug(logger_, "channel {}: received {}, expected {}", id, seq, r.expected);
+        break;
+    case SequenceTracker::Status::duplicate:
+        return true;
+    default:
+        break;
+    }
+    if (c->queue.try_enqueue(std::move(p)))
+        c->queued++;
+    else
+        c->dropped++;
+    return true;
+}
+
+bool ChannelDemux::read(uint16_t id, Packet& p, std::chrono::milliseconds timeout)
+{
+    Channel * c = find(id);
+    if (!c || c->cb)
+        throw application_error(Errc::invalid_channel, std::to_string(id));
+    return c->queue.wait_dequeue_timed(p, timeout);
+}
+
+ChannelStats ChannelDemux::stats(uint16_t id) const
+{
+    Channel * c = find(id);
+    if (!c)
+        throw application_error(Errc::invalid_channel, std::to_string(id));
+    return {c->queued, c->dropped, c->sequence.stats()};
+}
+
+void ChannelDemux::run(Channel& c)
+{
+    Packet p;
+    while (running_) {
+        if (!c.queue.wait_dequeue_timed(p, time_base_ms))
+            continue;
+        try {
+            c.cb(p);
+        } catch (std::exception& e) {
+            log_error(logger_, "channel callback failed on packet {}: {}", p.id(), e.what());
+        }
+    }
+}
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "common/log.h"
+#include "common/readerwriterqueue.h"
+
+#include "packet.h"
+#include "sequence.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+struct ChannelOptions
+{
+    size_t queue_size = 1024; // packets waiting for the consumer, newer ones are dropped
+    /// Run on a thread of the channel, the packets are pulled with read() without it
+    std::function<void(const Packet&)> cb;
+};
+
+struct ChannelStats
+{
+    uint64_t      queued;
+    uint64_t      dropped;  // the queue was full
+    SequenceStats sequence; // of the packets of the channel
+};
+
+/*
+ * Logical channels of the data received from the slave, Feature::channels. The master thread
+ * moves the packets of each open channel to its own queue, drained by a thread of the channel
+ * or by the application, so that channels are consumed concurrently and a burst on one of
+ * them does not delay the others. The packets of the other channels are delivered as usual.
+ */
+class ChannelDemux: public common::Log
+{
+public:
+    ChannelDemux(common::Log logger): Log(logger) {}
+    ~ChannelDemux() {stop();}
+
+    /// Before start(), throws invalid_channel after; channel 0 is left to the data callback
+    /// and handlers
+    void open(uint16_t id, const ChannelOptions& opts);
+    void start();
+    void stop();
+    /// Restart the sequence of every channel, at each connection
+    void reset();
+    /// Move p to the queue of its channel, false if it has no channel open
+    bool dispatch(Packet& p);
+    /// Wait for a packet of a channel without callback, one reader per channel
+    bool read(uint16_t id, Packet& p, std::chrono::milliseconds timeout);
+    ChannelStats stats(uint16_t id) const;
+
+private:
+    struct Channel
+    {
+        Channel(const ChannelOptions& opts): queue(opts.queue_size), cb(opts.cb) {}
+
+        common::BlockingReaderWriterQueue<Packet> queue;
+        std::function<void(const Packet&)>        cb;
+        SequenceTracker                           sequence;
+        std::atomic<uint64_t>                     queued  = 0;
+        std::atomic<uint64_t>                     dropped = 0;
+        std::thread                               worker;
+    };
+
+    std::array<std::unique_ptr<Channel>, max_channels> channels_;
+    std::atomic_bool                                   running_ = false;
+
+    Channel * find(uint16_t id) const {return id < max_channels ? channels_[id].get() : nullptr;}
+    void run(Channel& c);
+};
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
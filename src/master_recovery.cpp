@@ -0,0 +1,108 @@
+#include "master_recovery.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+void DataRecovery::add_gap(Packet::Id expected, Packet::Id received)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    const Packet::Id mask = Packet::id_mask(version_);
+    size_t gap = (received - expected) & mask;
+    // older ids are not in the slave ring anymore
+    if (gap > window_) {
+        stats_.missing += gap - window_;
+        stats_.lost    += gap - window_;
+        expected = (received - window_) & mask;
+        gap      = window_;
+    }
+    for (Packet::Id id = expected; id != received; id = (id + 1) & mask) {
+        if (holes_.emplace(id, Hole{Clock::time_point::min(), 0}).second)
+            fresh_.push_back(id);
+    }
+    stats_.missing += gap;
+}
+
+bool DataRecovery::recover(const Packet& p)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (p.type() != Packet::Type::data || holes_.erase(p.id()) == 0)
+        return false;
+    stats_.recovered++;
+    return true;
+}
+
+std::vector<Packet::Id> DataRecovery::due(Clock::time_point now,
+                                          std::chrono::microseconds interval, Packet::Id last)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    const Packet::Id mask = Packet::id_mask(version_);
+    std::vector<Packet::Id> ids;
+    auto nack = [&](Packet::Id id, Hole& hole) {
+        hole.nacked_at = now;
+        hole.nacks++;
+        ids.push_back(id);
+        nacked_.emplace_back(id, now);
+    };
+    auto give_up = [&](std::unordered_map<Packet::Id, Hole>::iterator it) {
+        stats_.lost++;
+        holes_.erase(it);
+    };
+
+    for (auto id: fresh_) {
+        auto it = holes_.find(id);
+        if (it == holes_.end() || it->second.nacks)
+            continue;
+        if (((last - id) & mask) >= window_)
+            give_up(it);
+        else
+            nack(id, it->second);
+    }
+    fresh_.clear();
+
+    // holes nacked again are queued behind, they are not looked at twice
+    for (size_t n = nacked_.size(); n > 0 && !nacked_.empty(); n--) {
+        auto [id, at] = nacked_.front();
+        auto it = holes_.find(id);
+        if (it == holes_.end() || it->second.nacked_at != at) {
+            nacked_.pop_front();
+            continue;
+        }
+        if (now - at < interval)
+            break;
+        nacked_.pop_front();
+        // the last nack is given an interval to be answered
+        if (((last - id) & mask) >= window_ || it->second.nacks >= max_nacks_)
+            give_up(it);
+        else
+            nack(id, it->second);
+    }
+    stats_.nacks += ids.size();
+    return ids;
+}
+
+void DataRecovery::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    holes_.clear();
+    fresh_.clear();
+    nacked_.clear();
+    version_ = Packet::v1;
+}
+
+void DataRecovery::set_session(const Session& session)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    version_ = session.version;
+    window_  = session.window;
+}
+
+DataRecoveryStats DataRecovery::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+}
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "packet.h"
+#include "session.h"
+
+namespace hdcp {
+namespace appli {
+namespace master {
+
+struct DataRecoveryStats
+{
+    uint64_t missing;   // ids skipped in the received sequence
+    uint64_t recovered; // missing packets received afterwards
+    uint64_t lost;      // missing ids given up
+    uint64_t nacks;     // ids nacked, retries included
+};
+
+/*
+ * Holes in the sequence of data packets received from the slave. Every hole is nacked right
+ * away then once per interval, until it is filled or given up after max_nacks tries or once it
+ * falls out of the slave retransmission ring. Holes wait in the order of their last nack, so
+ * that only the due ones are looked at.
+ */
+class DataRecovery
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    DataRecovery(size_t window = data_ring_size, uint max_nacks = max_nack_retry):
+        window_(window), max_nacks_(max_nacks) {}
+
+    /// Record the ids in [expected, received)
+    void add_gap(Packet::Id expected, Packet::Id received);
+    /// True if p fills a hole, it is then out of the id sequence
+    bool recover(const Packet& p);
+    /// Ids to nack now, last is the last id received in sequence
+    std::vector<Packet::Id> due(Clock::time_point now, std::chrono::microseconds interval,
+                                Packet::Id last);
+    void clear();
+    /// Id size and window agreed, the holes beyond the window are not in the slave ring
+    void set_session(const Session& session);
+    DataRecoveryStats stats() const;
+
+private:
+    struct Hole
+    {
+        Clock::time_point nacked_at;
+        uint              nacks;
+    };
+
+    mutable std::mutex                   mutex_;
+    size_t                               window_;
+    uint                                 max_nacks_;
+    uint8_t                              version_ = Packet::v1;
+    std::unordered_map<Packet::Id, Hole> holes_;
+    // holes never nacked, then nacked ones with the time of their last nack, entries of holes
+    // filled since are skipped
+    std::deque<Packet::Id>               fresh_;
+    std::deque<std::pair<Packet::Id, Clock::time_point>> nacked_;
+    DataRecoveryStats                    stats_ {};
+};
+
+} /* namespace master */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -1,13 +1,9 @@
+#include <limits>
+
 #include "application_error.h"
 #include "master_request.h"
 
 namespace hdcp {
-
-void inc_retry(Request& r)
-{
-    r.retry_++;
-}
-
 namespace appli {
 namespace master {
 
@@ -33,60 +29,122 @@ void RequestManager::stop()
     log_debug(logger_, "request manager stopped");
 }
 
-void RequestManager::send_command(Packet::BlockType type, const std::string& data,
-                                  Request::Callback request_cb,
-                                  std::chrono::milliseconds timeout)
+Request::Handle RequestManager::send_command(Packet::BlockType type, const std::string& data,
+                                             Request::Callback request_cb,
+                                             const CommandOptions& opts)
 {
-    common::TimeoutQueue::Id id =
-        timeout_queue_.add_repeating(now_, timeout.count()/time_base_ms.count(),
-                                     std::bind(&RequestManager::cmd_timeout_cb, this,
-                                               std::placeholders::_1, std::placeholders::_2));
+    std::vector<Command> cmds = {{type, data, std::move(request_cb)}};
+    return send_commands(cmds, opts, false).at(0);
+}
 
-    // reset keepalive mngt
-    if (keepalive_mngt_) {
-        timeout_queue_.erase(keepalive_mngt_id_);
-        keepalive_mngt_id_ =
-            timeout_queue_.add_repeating(now_, keepalive_interval.count()/time_base_ms.count(),
-                                         std::bind(&RequestManager::ka_mngt_timeout_cb, this,
-                                                   std::placeholders::_1, std::placeholders::_2));
+std::vector<Request::Handle> RequestManager::send_commands(std::vector<Command>& cmds,
+                                                           const CommandOptions& opts,
+                                                           bool coalesce)
+{
+    std::vector<Request::Handle>   handles;
+    std::vector<Packet::BlockView> blocks;
+    std::vector<Request::Callback> cbs;
+    size_t payload_size = 0;
+    for (auto& c: cmds) {
+        Packet::BlockView b;
+        b.type = c.type;
+        b.data = c.data;
+        if (b.size(version_) > max_pl_size_)
+            throw application_error(appli::Errc::data_too_big);
+        if (!blocks.empty() && (!coalesce || payload_size + b.size(version_) > max_pl_size_ ||
+                                blocks.size() == std::numeric_limits<uint8_t>::max())) {
+            send_packet(blocks, cbs, opts, handles);
+            blocks.clear();
+            cbs.clear();
+            payload_size = 0;
+        }
+        blocks.push_back(b);
+        cbs.push_back(c.cb);
+        payload_size += b.size(version_);
     }
+    if (!blocks.empty())
+        send_packet(blocks, cbs, opts, handles);
+    return handles;
+}
 
-    // send command
-    Packet cmd = Packet::make_command(++packet_id_, type, data);
-    if (transport_)
-        transport_->write(cmd);
+void RequestManager::send_packet(std::vector<Packet::BlockView>& blocks,
+                                 std::vector<Request::Callback>& cbs, const CommandOptions& opts,
+                                 std::vector<Request::Handle>& handles)
+{
+    std::chrono::microseconds rto = opts.timeout.count() ? opts.timeout
+                                  : adaptive_timeout_   ? rtt_.rto() : command_timeout_;
+    Packet cmd = Packet::make_command(next_id(), blocks, version_, checksum_);
 
-    // add request to the set
+    // add requests to the set before sending, the ack may come back at any time
     {
         std::unique_lock<std::mutex> lk(requests_mutex_);
-        if (!requests_.insert({id, cmd, std::move(request_cb)}).second)
+        if (requests_.get<by_command>().count(cmd.id()))
             throw application_error(appli::Errc::request_overrun,
                                     fmt::format("id {} is pending", cmd.id()));
+        // each command of the packet is a request on its own
+        for (size_t i = 0; i < blocks.size(); i++) {
+            Request request(0, ++handle_, cmd, i, std::move(cbs[i]), rto, max_retry_, opts);
+            request.set_id(arm_cmd_timeout(request, 0));
+            requests_.insert(request);
+            handles.push_back(request.get_handle());
+        }
     }
+
+    reset_keepalive_mngt();
+
+    // send command
+    if (transport_)
+        transport_->write(cmd, opts.priority);
 }
 
-void RequestManager::send_hip(const Identification& id, std::chrono::milliseconds timeout)
+bool RequestManager::cancel(Request::Handle handle)
 {
+    std::unique_lock<std::mutex> lk(requests_mutex_);
+    auto& set_by_handle = requests_.get<by_handle>();
+    auto search = set_by_handle.find(handle);
+    if (search == set_by_handle.end())
+        return false;
+
+    Request r(*search);
+    timeout_queue_.erase(r.get_id());
+    set_by_handle.erase(search);
+    // the callback may send or cancel other commands
+    lk.unlock();
+    r.set_status(Request::Status::cancelled);
+    r.call_callback();
+    return true;
+}
+
+void RequestManager::send_hip(const Identification& id, const std::string& capabilities,
+                              std::chrono::milliseconds timeout)
+{
+    hip_sent_at_ = Request::Clock::now();
+    hip_count_++;
     if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_hip(++packet_id_, id));
+        transport_->write(Packet::make_hip(next_id(), id, capabilities));
     // set timeout
-    dip_id_ = timeout_queue_.add(now_, timeout.count()/time_base_ms.count(),
+    dip_id_ = timeout_queue_.add(now_, ticks(timeout),
                                  std::bind(&RequestManager::dip_timeout_cb, this,
                                            std::placeholders::_1, std::placeholders::_2));
 }
 
 void RequestManager::start_keepalive_management(std::chrono::milliseconds keepalive_interval,
-                                                std::chrono::milliseconds keepalive_timeout)
+                                                std::chrono::milliseconds keepalive_timeout,
+                                                bool passive)
 {
     keepalive_mngt_ = true;
+    passive_        = passive;
+    ka_interval_    = keepalive_interval;
+    rx_at_          = Request::Clock::time_point();
     keepalive_mngt_id_ =
-        timeout_queue_.add_repeating(now_, keepalive_interval.count()/time_base_ms.count(),
+        timeout_queue_.add_repeating(now_, ticks(ka_interval_),
                                      std::bind(&RequestManager::ka_mngt_timeout_cb, this,
                                                std::placeholders::_1, std::placeholders::_2));
+    ka_sent_at_ = Request::Clock::now();
     if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_keepalive(++packet_id_));
+        transport_->write(Packet::make_keepalive(next_id(), version_), Priority::high);
     // set timeout
-    timeout_keepalive_ = keepalive_timeout.count()/time_base_ms.count();
+    timeout_keepalive_ = ticks(keepalive_timeout);
     auto id = timeout_queue_.add(now_, timeout_keepalive_,
                                  std::bind(&RequestManager::ka_timeout_cb, this,
                                            std::placeholders::_1, std::placeholders::_2));
@@ -103,30 +161,151 @@ void RequestManager::stop_keepalive_management()
 
 void RequestManager::ack_command(Packet& packet)
 {
-    // get the first block, it should have the same block type of cmd sent
-    // and the data should correspond to its packet id
-    auto block = packet.blocks().at(0);
-    if (block.data.size() != sizeof(Packet::Id))
-        throw application_error(appli::Errc::invalid_cmd_ack_format);
-    const Packet::Id id = *reinterpret_cast<const Packet::Id*>(block.data.data());
+    for (auto& block: packet.blocks()) {
+        if (block.type == Packet::ReservedBlockType::cmd_ack_range) {
+            if (block.data.size() != 2 * Packet::id_size(packet.version()))
+                throw application_error(appli::Errc::invalid_cmd_ack_format);
+            auto range = packet.ids(block);
+            // the slave flushes its range before it spans more ids, last before first wraps
+            if (((range[1] - range[0]) & Packet::id_mask(packet.version())) > max_ack_range)
+                throw application_error(appli::Errc::invalid_cmd_ack_format,
+                                        fmt::format("range {}-{}", range[0], range[1]));
+            ack_range(packet, range[0], range[1]);
+            continue;
+        }
+
+        if (block.type == Packet::ReservedBlockType::cmd_response) {
+            Packet::Id       id;
+            uint8_t          index;
+            std::string_view response;
+            if (!packet.parse_cmd_response(block, id, index, response))
+                throw application_error(appli::Errc::invalid_cmd_ack_format);
+            // answered again from the slave cache, or timed out or cancelled meanwhile: the
+            // rest of the ack still counts
+            if (!ack_command(packet, id, index, response))
+                log_debug(logger_, "ack of command {}:{}, not pending", id, index);
+            continue;
+        }
+
+        // otherwise the block should have the same block type of cmd sent
+        // and the data should correspond to its packet id
+        if (block.data.size() != Packet::id_size(packet.version()))
+            throw application_error(appli::Errc::invalid_cmd_ack_format);
+        const Packet::Id id = packet.ids(block).at(0);
+        if (!ack_command(packet, id))
+            log_debug(logger_, "ack of command {}, not pending", id);
+    }
+}
+
+bool RequestManager::ack_command(Packet& ack, Packet::Id id)
+{
+    std::vector<Request> acked;
+    {
+        std::unique_lock<std::mutex> lk(requests_mutex_);
+        auto& set_by_command = requests_.get<by_command>();
+        auto range = set_by_command.equal_range(id);
+        if (range.first == range.second)
+            return false;
+        for (auto it = range.first; it != range.second; ++it) {
+            acked.push_back(*it);
+            timeout_queue_.erase(it->get_id());
+        }
+        set_by_command.erase(range.first, range.second);
+    }
+    for (auto& r: acked)
+        fulfill(r, ack);
+    return true;
+}
 
+void RequestManager::ack_range(Packet& ack, Packet::Id first, Packet::Id last)
+{
+    std::vector<Request> acked;
+    {
+        std::unique_lock<std::mutex> lk(requests_mutex_);
+        auto& set_by_command = requests_.get<by_command>();
+        // ids of the range that are not pending commands (ka, retried...) are skipped
+        const Packet::Id mask = Packet::id_mask(ack.version());
+        for (Packet::Id id = first; ; id = (id + 1) & mask) {
+            auto range = set_by_command.equal_range(id);
+            for (auto it = range.first; it != range.second; ++it) {
+                acked.push_back(*it);
+                timeout_queue_.erase(it->get_id());
+            }
+            set_by_command.erase(range.first, range.second);
+            if (id == last)
+                break;
+        }
+    }
+    for (auto& r: acked)
+        fulfill(r, ack);
+}
+
+bool RequestManager::ack_command(Packet& ack, Packet::Id id, uint8_t block,
+                                 std::string_view response)
+{
     std::unique_lock<std::mutex> lk(requests_mutex_);
     auto& set_by_command = requests_.get<by_command>();
-    auto search = set_by_command.find(id);
-    if (search == set_by_command.end())
-        throw application_error(appli::Errc::request_not_found,
-                                fmt::format("id {} not found", id));
-    Request r(*search);
+    auto range = set_by_command.equal_range(id);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->get_block_index() != block)
+            continue;
+        Request r(*it);
+        timeout_queue_.erase(r.get_id());
+        set_by_command.erase(it);
+        lk.unlock();
+        fulfill(r, ack, response);
+        return true;
+    }
+    return false;
+}
+
+void RequestManager::fulfill(Request& r, Packet& ack, std::string_view response)
+{
+    // called once the request is removed, without lock: the callback may send commands
+    if (r.get_retry() == 0)
+        rtt_.add_sample(std::chrono::duration_cast<std::chrono::microseconds>(
+                Request::Clock::now() - r.get_sent_at()));
     r.set_status(Request::Status::fulfilled);
-    r.set_ack(packet);
+    r.set_ack(ack);
+    r.set_response(response);
     r.call_callback();
+}
 
-    timeout_queue_.erase(r.get_id());
-    set_by_command.erase(id);
+void RequestManager::send_nack(const std::vector<Packet::Id>& missing)
+{
+    const size_t max_ids = (max_pl_size_ - Packet::block_header_size(version_)) /
+                           Packet::id_size(version_);
+    for (size_t i = 0; i < missing.size(); i += max_ids) {
+        std::vector<Packet::Id> ids(missing.begin() + i,
+                                    missing.begin() + std::min(i + max_ids, missing.size()));
+        if (transport_ && transport_->is_open())
+            transport_->write(Packet::make_nack(next_id(), ids, version_, checksum_),
+                              Priority::high);
+    }
+}
+
+void RequestManager::send_bulk(const Packet::BulkChunk& chunk)
+{
+    if (!transport_ || !transport_->is_open())
+        throw application_error(appli::Errc::write_while_disconnected);
+    transport_->write(Packet::make_bulk(next_id(), chunk, version_, checksum_), Priority::low);
 }
 
 void RequestManager::ack_keepalive()
 {
+    std::unique_lock<std::mutex> lk(mutex_id_);
+    // the ack is ambiguous if several ka are pending, in passive mode it is also delayed
+    if (ka_ids_.size() == 1 && !passive_)
+        rtt_.add_sample(std::chrono::duration_cast<std::chrono::microseconds>(
+                Request::Clock::now() - ka_sent_at_));
+    for (auto id: ka_ids_)
+        timeout_queue_.erase(id);
+    ka_ids_.clear();
+}
+
+void RequestManager::refresh_keepalive()
+{
+    rx_at_ = Request::Clock::now();
     std::unique_lock<std::mutex> lk(mutex_id_);
     for (auto id: ka_ids_)
         timeout_queue_.erase(id);
@@ -136,6 +315,9 @@ void RequestManager::ack_keepalive()
 void RequestManager::ack_dip()
 {
     timeout_queue_.erase(dip_id_);
+    if (hip_count_ == 1)
+        rtt_.add_sample(std::chrono::duration_cast<std::chrono::microseconds>(
+                Request::Clock::now() - hip_sent_at_));
 }
 
 void RequestManager::cmd_timeout_cb(common::TimeoutQueue::Id id, int64_t)
@@ -143,32 +325,41 @@ void RequestManager::cmd_timeout_cb(common::TimeoutQueue::Id id, int64_t)
     std::unique_lock<std::mutex> lk(requests_mutex_);
     auto& set_by_request = requests_.get<by_request>();
     auto search = set_by_request.find(id);
+    // acked or cancelled while the timer fired
     if (search == set_by_request.end())
-        throw hdcp::application_error(appli::Errc::request_not_found);
+        return;
 
-    if (search->get_retry() < max_retry_) {
+    bool expired = Request::Clock::now() >= search->get_deadline();
+    if (!expired && search->get_retry() < search->get_max_retry()) {
         log_warn(logger_, "command {} timeout, try = {}", search->get_command().id(),
                  search->get_retry());
-        set_by_request.modify(search, &inc_retry);
-        if (transport_ && transport_->is_open())
-            transport_->write(search->get_command());
-
-        // reset keepalive mngt
-        if (keepalive_mngt_) {
-            timeout_queue_.erase(keepalive_mngt_id_);
-            keepalive_mngt_id_ =
-                timeout_queue_.add_repeating(now_, keepalive_interval.count()/time_base_ms.count(),
-                                             std::bind(&RequestManager::ka_mngt_timeout_cb, this,
-                                                       std::placeholders::_1,
-                                                       std::placeholders::_2));
+        // the timeout that just fired was a one shot, arm the next one with backoff
+        auto timer_id = arm_cmd_timeout(*search, search->get_retry() + 1);
+        set_by_request.modify(search, [timer_id](Request& r) {r.inc_retry(); r.set_id(timer_id);});
+        const Packet& sent = search->get_command();
+        Packet::Id    origin;
+        uint8_t       index;
+        if (sent.nb_block() > 1 && !sent.parse_cmd_retry(sent.blocks().front(), origin, index)) {
+            // resend the command alone, the others of the packet have their own timers; the
+            // retry block lets the slave find it among the commands it already executed
+            auto retry = Packet::make_cmd_retry(sent.id(), search->get_block_index(), version_);
+            std::vector<Packet::BlockView> blocks = {Packet::BlockView(retry),
+                                                     search->get_block()};
+            Packet cmd = Packet::make_command(next_id(), blocks, version_, checksum_);
+            set_by_request.modify(search, [&cmd](Request& r) {r.set_command(cmd, 1);});
         }
+        if (transport_ && transport_->is_open())
+            transport_->write(search->get_command(), search->get_priority());
+
+        reset_keepalive_mngt();
     } else {
-        log_error(logger_, "command {} failed", search->get_command().id());
+        log_error(logger_, "command {} {}", search->get_command().id(),
+                  expired ? "deadline exceeded" : "failed");
         Request r(*search);
+        set_by_request.erase(search);
+        lk.unlock();
         r.set_status(Request::Status::timeout);
         r.call_callback();
-        timeout_queue_.erase(r.get_id());
-        set_by_request.erase(id);
     }
 }
 
@@ -188,14 +379,20 @@ void RequestManager::dip_timeout_cb(common::TimeoutQueue::Id, int64_t)
 
 void RequestManager::ka_mngt_timeout_cb(common::TimeoutQueue::Id, int64_t)
 {
+    // in passive mode the slave traffic proves the link alive as well as an ack would
+    if (passive_ && Request::Clock::now() - rx_at_.load() < ka_interval_)
+        return;
+
     // send keepalive
+    std::unique_lock<std::mutex> lk(mutex_id_);
+    if (ka_ids_.empty())
+        ka_sent_at_ = Request::Clock::now();
     if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_keepalive(++packet_id_));
+        transport_->write(Packet::make_keepalive(next_id(), version_), Priority::high);
 
     auto id = timeout_queue_.add(now_, timeout_keepalive_,
                                  std::bind(&RequestManager::ka_timeout_cb, this,
                                            std::placeholders::_1, std::placeholders::_2));
-    std::unique_lock<std::mutex> lk(mutex_id_);
     ka_ids_.push_back(id);
 }
 
@@ -204,7 +401,7 @@ void RequestManager::run()
     notify_running();
     while (is_running()) {
         timeout_queue_.run_once(now_++);
-        std::this_thread::sleep_for(time_base_ms);
+        std::this_thread::sleep_for(request_time_base);
     }
 }
 
@@ -215,8 +412,44 @@ void RequestManager::clear()
         requests_.clear();
     }
     timeout_queue_.clear();
+    rtt_.reset();
+    hip_count_        = 0;
     now_              = 0;
     packet_id_        = 0;
+    version_          = Packet::v1;
+    max_pl_size_      = Packet::max_pl_size;
+    checksum_         = Packet::Checksum::fletcher16;
+}
+
+void RequestManager::reset_keepalive_mngt()
+{
+    // keep-alives are only sent when nothing else has been sent for an interval
+    if (keepalive_mngt_) {
+        timeout_queue_.erase(keepalive_mngt_id_);
+        keepalive_mngt_id_ =
+            timeout_queue_.add_repeating(now_, ticks(ka_interval_),
+                                         std::bind(&RequestManager::ka_mngt_timeout_cb, this,
+                                                   std::placeholders::_1, std::placeholders::_2));
+    }
+}
+
+common::TimeoutQueue::Id RequestManager::arm_cmd_timeout(const Request& r, uint retry)
+{
+    auto timeout = adaptive_timeout_ ? rtt_.backoff(r.get_timeout(), retry) : r.get_timeout();
+    // never wait past the deadline, the request fails when it is reached
+    if (r.get_deadline() != Request::Clock::time_point::max())
+        timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::microseconds>(
+                r.get_deadline() - Request::Clock::now()));
+    return timeout_queue_.add(now_, ticks(timeout),
+                              std::bind(&RequestManager::cmd_timeout_cb, this,
+                                        std::placeholders::_1, std::placeholders::_2));
+}
+
+int64_t RequestManager::ticks(std::chrono::microseconds timeout)
+{
+    // round up so that a timeout never fires early
+    std::chrono::microseconds base = request_time_base;
+    return std::max<int64_t>(1, (timeout.count() + base.count() - 1) / base.count());
 }
 
 } /* namespace master */
@@ -1,11 +1,12 @@
 #pragma once
 
 #include <functional>
+#include <optional>
 
 #include <boost/multi_index/indexed_by.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index_container.hpp>
 
 #include "common/log.h"
@@ -13,47 +14,94 @@
 #include "common/thread.h"
 
 #include "transport.h"
+#include "rtt_estimator.h"
 
 namespace hdcp {
 
+struct CommandOptions
+{
+    std::chrono::milliseconds deadline {0}; // give up once elapsed, no deadline if 0
+    // first retransmission timeout, from the rtt or command_timeout_ if 0; backed off in
+    // adaptive mode
+    std::chrono::milliseconds timeout  {0};
+    std::optional<uint>       max_retry;    // retry budget, default one if not set
+    Priority                  priority = Priority::normal;
+};
+
 class Request
 {
 public:
     using Callback = std::function<void(Request&)>;
+    using Handle   = uint64_t;
+    using Clock    = std::chrono::steady_clock;
 
     enum class Status {
         pending,
         timeout,
         fulfilled,
+        cancelled,
     };
 
-    Request(common::TimeoutQueue::Id id, Packet& cmd, Callback callback):
-        id_(id), command_(cmd), cb_(callback) {}
+    Request(common::TimeoutQueue::Id id, Handle handle, Packet& cmd, uint8_t block,
+            Callback callback, std::chrono::microseconds timeout, uint max_retry,
+            const CommandOptions& opts):
+        id_(id), handle_(handle), command_(cmd), block_(block), cb_(callback), timeout_(timeout),
+        sent_at_(Clock::now()), max_retry_(opts.max_retry.value_or(max_retry)),
+        priority_(opts.priority)
+    {
+        deadline_ = opts.deadline.count() ? sent_at_ + opts.deadline : Clock::time_point::max();
+    }
 
     Status                   get_status()     const {return status_;}
     common::TimeoutQueue::Id get_id()         const {return id_;}
+    Handle                   get_handle()     const {return handle_;}
     Packet::Id               get_command_id() const {return command_.id();}
     const Packet&            get_command()    const {return command_;}
+    Packet::BlockView        get_block()      const {return command_.blocks().at(block_);}
+    uint8_t                  get_block_index() const {return block_;}
     Packet*                  get_ack()        const {return ack_;}
+    /// Response of the slave, points into the ack and is only valid during the callback
+    std::string_view         get_response()   const {return response_;}
     uint                     get_retry()      const {return retry_;}
+    std::chrono::microseconds get_timeout()   const {return timeout_;}
+    Clock::time_point        get_sent_at()    const {return sent_at_;}
+    Clock::time_point        get_deadline()   const {return deadline_;}
+    uint                     get_max_retry()  const {return max_retry_;}
+    Priority                 get_priority()   const {return priority_;}
 
     void set_status(Status s) {status_ = s;}
     void set_ack(Packet& ack) {ack_ = &ack;}
+    void set_response(std::string_view response) {response_ = response;}
+    void set_id(common::TimeoutQueue::Id id) {id_ = id;}
+    void set_command(const Packet& cmd, uint8_t block) {command_ = cmd; block_ = block;}
     void inc_retry()          {retry_++;}
 
-    void call_callback()      {cb_(*this);}
+    void call_callback()      {if (cb_) cb_(*this);}
 
 private:
-    friend void inc_retry(Request& r);
-
     common::TimeoutQueue::Id  id_;
+    Handle                    handle_;
     Packet                    command_;
+    uint8_t                   block_; // index of the command in the packet
     Callback                  cb_;
+    std::chrono::microseconds timeout_;
+    Clock::time_point         sent_at_;
+    Clock::time_point         deadline_;
+    uint                      max_retry_;
+    Priority                  priority_;
     Packet                  * ack_    = nullptr;
+    std::string_view          response_;
     Status                    status_ = Status::pending;
     uint                      retry_  = 0;
 };
 
+struct Command
+{
+    Packet::BlockType type;
+    std::string       data;
+    Request::Callback cb;
+};
+
 namespace appli {
 namespace master {
 
@@ -69,15 +117,36 @@ public:
     RequestManager(common::Log logger, Transport * transport, TimeoutCallback cb):
         Log(logger), transport_(transport), timeout_cb_(cb) {}
 
-    void send_command(Packet::BlockType type, const std::string& data,
-                      Request::Callback request_cb, std::chrono::milliseconds timeout);
-    void send_hip(const Identification& id, std::chrono::milliseconds timeout);
+    Request::Handle send_command(Packet::BlockType type, const std::string& data,
+                                 Request::Callback request_cb, const CommandOptions& opts = {});
+    /// Commands are packed in as few packets as possible if coalesce is set
+    std::vector<Request::Handle> send_commands(std::vector<Command>& cmds,
+                                               const CommandOptions& opts, bool coalesce);
+    bool cancel(Request::Handle handle);
+    void send_hip(const Identification& id, const std::string& capabilities,
+                  std::chrono::milliseconds timeout);
     void start_keepalive_management(std::chrono::milliseconds keepalive_interval,
-                                    std::chrono::milliseconds keepalive_timeout);
+                                    std::chrono::milliseconds keepalive_timeout,
+                                    bool passive = false);
     void stop_keepalive_management();
+    void send_nack(const std::vector<Packet::Id>& missing);
+    /// Bulk chunks go through the low priority lane, behind commands and keepalives
+    void send_bulk(const Packet::BulkChunk& chunk);
     void ack_command(Packet& packet);
     void ack_dip();
     void ack_keepalive();
+    void refresh_keepalive();
+
+    /// When disabled, commands are retried every CommandOptions::timeout or command_timeout_
+    void set_adaptive_timeout(bool enable) {adaptive_timeout_ = enable;}
+    /// Format of the packets sent, back to the defaults at each start
+    void set_session(const Session& session)
+    {
+        version_     = session.version;
+        max_pl_size_ = session.max_frame_size - Packet::max_header_size;
+        checksum_    = session.checksum;
+    }
+    RttStats rtt_stats() const {return rtt_.stats();}
 
     void start();
     void stop() override;
@@ -89,15 +158,19 @@ private:
 
     struct by_request {};
     struct by_command {};
+    struct by_handle {};
     typedef boost::multi_index_container<
         Request,
         boost::multi_index::indexed_by<
-            boost::multi_index::ordered_unique<
+            boost::multi_index::hashed_unique<
             boost::multi_index::tag<by_request>,
             boost::multi_index::const_mem_fun<Request, common::TimeoutQueue::Id, &Request::get_id>>,
-        boost::multi_index::ordered_unique<
+        boost::multi_index::hashed_non_unique<
             boost::multi_index::tag<by_command>,
-            boost::multi_index::const_mem_fun<Request, Packet::Id, &Request::get_command_id>>>>
+            boost::multi_index::const_mem_fun<Request, Packet::Id, &Request::get_command_id>>,
+        boost::multi_index::hashed_unique<
+            boost::multi_index::tag<by_handle>,
+            boost::multi_index::const_mem_fun<Request, Request::Handle, &Request::get_handle>>>>
             Set;
 
     Set requests_;
@@ -109,9 +182,28 @@ private:
     std::vector<common::TimeoutQueue::Id> ka_ids_;
     std::mutex mutex_id_;
     bool keepalive_mngt_ = false;
+    std::atomic_bool passive_ = false;
+    std::chrono::milliseconds ka_interval_ = keepalive_interval;
+    // last packet received from the slave, in passive mode it postpones the next ka as well
+    std::atomic<Request::Clock::time_point> rx_at_ {};
+
+    /*
+     * Rtt samples are taken from commands and keepalives that were not retransmitted
+     * (Karn's algorithm), the hip/dip exchange gives the first one
+     */
+    RttEstimator       rtt_ {command_timeout_, min_command_timeout, max_command_timeout,
+                             request_time_base};
+    bool               adaptive_timeout_ = true;
+    Request::Clock::time_point hip_sent_at_;
+    std::atomic<uint>          hip_count_ = 0;
+    Request::Clock::time_point ka_sent_at_;
 
     int64_t                 now_ = 0;
     std::atomic<Packet::Id> packet_id_ = 0;
+    std::atomic<uint8_t>    version_   = Packet::v1;
+    std::atomic<size_t>     max_pl_size_ = Packet::max_pl_size;
+    std::atomic<Packet::Checksum> checksum_ = Packet::Checksum::fletcher16;
+    std::atomic<Request::Handle> handle_ = 0;
 
     int64_t timeout_keepalive_;
 
@@ -124,12 +216,23 @@ private:
      */
     void ka_mngt_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
 
+    Packet::Id next_id() {return ++packet_id_ & Packet::id_mask(version_);}
+
     void cmd_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
     void ka_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
     void dip_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
 
     void run() override;
     void clear();
+    void send_packet(std::vector<Packet::BlockView>& blocks, std::vector<Request::Callback>& cbs,
+                     const CommandOptions& opts, std::vector<Request::Handle>& handles);
+    bool ack_command(Packet& ack, Packet::Id id);
+    void ack_range(Packet& ack, Packet::Id first, Packet::Id last);
+    bool ack_command(Packet& ack, Packet::Id id, uint8_t block, std::string_view response);
+    void fulfill(Request& r, Packet& ack, std::string_view response = {});
+    void reset_keepalive_mngt();
+    common::TimeoutQueue::Id arm_cmd_timeout(const Request& r, uint retry);
+    static int64_t ticks(std::chrono::microseconds timeout);
 };
 
 } /* namespace  master */
@@ -1,4 +1,9 @@
+#include <cstring>
+#include <limits>
+
 #include "packet.h"
+#include "checksum.h"
+#include "lz.h"
 
 namespace hdcp {
 
@@ -9,113 +14,583 @@ Packet::Packet(std::string_view v)
     if (pos == std::string::npos)
         throw hdcp::packet_error(packet::Errc::sop_not_found);
 
-    if (pos + sizeof(Header) > v.size())
+    if (pos + min_header_size > v.size())
+        throw hdcp::packet_error(packet::Errc::invalid_buffer_size);
+
+    size_t h_size = header_size(static_cast<uint8_t>(v[pos + offsetof(Header, ver)]));
+    if (pos + h_size > v.size())
         throw hdcp::packet_error(packet::Errc::invalid_buffer_size);
 
-    const Header * header = parse_header(std::string_view(v.data() + pos, sizeof(Header)));
-    if (pos + sizeof(Header) + header->len > v.size())
+    std::string_view header(v.data() + pos, h_size);
+    size_t len = parse_header(header);
+    if (pos + h_size + len > v.size())
         throw hdcp::packet_error(packet::Errc::invalid_buffer_size);
 
-    std::string_view payload(v.data() + pos + sizeof(Header), header->len);
-    parse_payload(payload, header);
+    std::string_view payload(v.data() + pos + h_size, len);
+    parse_payload(header, payload);
 
     // buffer is valid, copy data
-    std::copy(v.begin(), v.begin() + sizeof(Header) + header->len, data_.begin());
+    if (h_size + len > max_size)
+        large_data_.assign(v.begin() + pos, v.begin() + pos + h_size + len);
+    else
+        std::copy(v.begin() + pos, v.begin() + pos + h_size + len, data_.begin());
+}
+
+void Packet::reserve(size_t size)
+{
+    if (size > max_size) {
+        if (large_data_.empty()) {
+            large_data_.resize(size);
+            std::copy_n(data_.begin(), max_header_size, large_data_.begin());
+        } else {
+            large_data_.resize(size);
+        }
+    } else if (!large_data_.empty()) {
+        std::copy_n(large_data_.begin(), max_header_size, data_.begin());
+        // keep the capacity for the next large frame
+        large_data_.clear();
+    }
+}
+
+Packet::Id Packet::id() const
+{
+    return version() == v2 ? header_v2()->id : header()->id;
+}
+
+Packet::Type Packet::type() const
+{
+    return version() == v2 ? header_v2()->type : header()->type;
+}
+
+uint8_t Packet::nb_block() const
+{
+    return version() == v2 ? header_v2()->n_block : header()->n_block;
+}
+
+Packet::Checksum Packet::checksum() const
+{
+    if (version() != v2)
+        return Checksum::fletcher16;
+    return static_cast<Checksum>(header_v2()->flags & checksum_mask);
+}
+
+size_t Packet::alignment() const
+{
+    return version() == v2 ? alignment_of(header_v2()->flags) : 1;
+}
+
+bool Packet::compressed() const
+{
+    return version() == v2 && header_v2()->flags & compressed_flag;
+}
+
+void Packet::decompress(size_t max_frame_size)
+{
+    if (!compressed())
+        return;
+
+    // bounded by parse_payload to the largest frame, here to the one of the session
+    auto pl = payload();
+    uint32_t raw_size;
+    std::memcpy(&raw_size, pl.data(), sizeof(raw_size));
+    pl.remove_prefix(sizeof(raw_size));
+    if (raw_size > max_frame_size - sizeof(HeaderV2))
+        throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
+                                 fmt::format("{} once decompressed", raw_size));
+
+    HeaderV2 h = *header_v2();
+    h.flags = static_cast<uint8_t>(Checksum::none) | (h.flags & alignment_mask);
+    h.len   = raw_size;
+    h.p_crc = 0;
+    h.h_crc = compute_crc(std::string_view(reinterpret_cast<char*>(&h), sizeof(h) - sizeof(Crc)));
+
+    // the padding stays aligned as the payload keeps its offset in the frame
+    if (sizeof(HeaderV2) + raw_size <= max_size) {
+        // the smaller compressed payload is set aside, the raw one expands in the inline buffer
+        std::array<char, max_size> in;
+        if (large_data_.empty()) {
+            std::memcpy(in.data(), pl.data(), pl.size());
+            pl = std::string_view(in.data(), pl.size());
+        }
+        if (!lz::decompress(pl, data_.data() + sizeof(HeaderV2), raw_size))
+            throw hdcp::packet_error(packet::Errc::invalid_compressed_payload);
+        std::memcpy(data_.data(), &h, sizeof(h));
+        large_data_ = LargeBuffer();
+    } else {
+        LargeBuffer out(sizeof(HeaderV2) + raw_size);
+        if (!lz::decompress(pl, out.data() + sizeof(HeaderV2), raw_size))
+            throw hdcp::packet_error(packet::Errc::invalid_compressed_payload);
+        std::memcpy(out.data(), &h, sizeof(h));
+        large_data_ = std::move(out);
+    }
+
+    auto b = blocks();
+    if (nb_block() != b.size())
+        throw hdcp::packet_error(packet::Errc::invalid_number_of_block,
+                                 fmt::format("{} should be {}", b.size(), nb_block()));
+}
+
+size_t Packet::header_size(uint8_t version)
+{
+    return version == v2 ? sizeof(HeaderV2) : sizeof(Header);
+}
+
+std::vector<Packet::Id> Packet::ids(const BlockView& b) const
+{
+    std::vector<Id> ids;
+    if (version() == v2) {
+        auto it = reinterpret_cast<const Id*>(b.data.data());
+        ids.assign(it, it + b.data.size() / sizeof(Id));
+    } else {
+        auto it = reinterpret_cast<const uint16_t*>(b.data.data());
+        ids.assign(it, it + b.data.size() / sizeof(uint16_t));
+    }
+    return ids;
+}
+
+bool Packet::parse_cmd_response(const BlockView& b, Id& cmd_id, uint8_t& block,
+                                std::string_view& response) const
+{
+    size_t id_len = id_size(version());
+    if (b.data.size() < id_len + sizeof(block))
+        return false;
+    if (version() == v2)
+        cmd_id = *reinterpret_cast<const Id*>(b.data.data());
+    else
+        cmd_id = *reinterpret_cast<const uint16_t*>(b.data.data());
+    block  = static_cast<uint8_t>(b.data[id_len]);
+    response = b.data.substr(id_len + sizeof(block));
+    return true;
+}
+
+bool Packet::parse_cmd_retry(const BlockView& b, Id& cmd_id, uint8_t& block) const
+{
+    std::string_view rest;
+    return b.type == ReservedBlockType::cmd_retry &&
+           b.data.size() == id_size(version()) + sizeof(block) &&
+           parse_cmd_response(b, cmd_id, block, rest);
+}
+
+bool Packet::parse_array(const BlockView& b, ArrayView& array)
+{
+    if (b.type != ReservedBlockType::array || b.data.size() < sizeof(AHeader))
+        return false;
+    AHeader h;
+    std::memcpy(&h, b.data.data(), sizeof(h));
+    size_t len = b.data.size() - sizeof(h);
+    if (h.elem_size == 0 || len % h.elem_size)
+        return false;
+    array.type      = h.type;
+    array.elem_size = h.elem_size;
+    array.count     = len / h.elem_size;
+    array.data      = b.data.data() + sizeof(h);
+    return true;
 }
 
-Packet Packet::make_command(Id id, BlockType type, const std::string& data)
+Packet Packet::make_command(Id id, BlockType type, const std::string& data, uint8_t version)
 {
-    std::string payload(Packet::make_block(type, data));
-    std::string header(Packet::make_header(id, Packet::Type::cmd, 1, payload));
+    std::string payload(Packet::make_block(type, data, version));
+    std::string header(Packet::make_header(id, Packet::Type::cmd, 1, payload, version));
     return Packet(header + payload);
 }
 
-Packet Packet::make_cmd_ack(Id id, BlockType type, Id cmd_id)
+Packet Packet::make_command(Id id, std::vector<BlockView>& blocks, uint8_t version,
+                            Checksum checksum)
 {
-    std::string data(reinterpret_cast<char*>(&cmd_id), sizeof(Id));
-    std::string payload(Packet::make_block(type, data));
-    std::string header(Packet::make_header(id, Packet::Type::cmd_ack, 1, payload));
+    return make_packet(id, Packet::Type::cmd, blocks, version, checksum);
+}
+
+Packet Packet::make_cmd_ack(Id id, BlockType type, Id cmd_id, uint8_t version)
+{
+    std::string payload(Packet::make_block(type, make_id(cmd_id, version), version));
+    std::string header(Packet::make_header(id, Packet::Type::cmd_ack, 1, payload, version));
     return Packet(header + payload);
 }
 
-Packet Packet::make_data(Id id, std::vector<BlockView>& blocks)
+Packet Packet::make_cmd_ack(Id id, std::vector<Block>& blocks, uint8_t version,
+                            Checksum checksum)
 {
     std::string payload;
     for (auto& b: blocks) {
-        payload += Packet::make_block(b);
+        payload += Packet::make_block(b, version);
     }
-    std::string header(Packet::make_header(id, Packet::Type::data, blocks.size(), payload));
+    std::string header(Packet::make_header(id, Packet::Type::cmd_ack, blocks.size(), payload,
+                                           version, checksum));
     return Packet(header + payload);
 }
 
-Packet Packet::make_data(Id id, std::vector<Block>& blocks)
+Packet::Block Packet::make_cmd_ack_range(Id first, Id last, uint8_t version)
 {
-    std::string payload;
+    Block b;
+    b.type = ReservedBlockType::cmd_ack_range;
+    b.data = make_id(first, version) + make_id(last, version);
+    return b;
+}
+
+Packet::Block Packet::make_cmd_response(Id cmd_id, uint8_t block, std::string_view response,
+                                        uint8_t version)
+{
+    Block b;
+    b.type = ReservedBlockType::cmd_response;
+    b.data = make_id(cmd_id, version);
+    b.data.push_back(static_cast<char>(block));
+    b.data.append(response);
+    return b;
+}
+
+Packet::Block Packet::make_cmd_retry(Id cmd_id, uint8_t block, uint8_t version)
+{
+    Block b = make_cmd_response(cmd_id, block, {}, version);
+    b.type = ReservedBlockType::cmd_retry;
+    return b;
+}
+
+Packet::Block Packet::make_array(BlockType type, size_t elem_size, std::string_view elements)
+{
+    if (elem_size == 0 || elem_size > std::numeric_limits<uint16_t>::max() ||
+        elements.size() % elem_size)
+        throw hdcp::packet_error(packet::Errc::invalid_array_block,
+                                 fmt::format("{} bytes of {} bytes elements", elements.size(),
+                                             elem_size));
+    AHeader h = {type, static_cast<uint16_t>(elem_size)};
+    Block b;
+    b.type = ReservedBlockType::array;
+    b.data.reserve(sizeof(h) + elements.size());
+    b.data.append(reinterpret_cast<char*>(&h), sizeof(h));
+    b.data.append(elements);
+    return b;
+}
+
+std::vector<Packet::Block> Packet::make_fragments(const BlockView& b, uint32_t message,
+                                                  size_t max_size, uint8_t version)
+{
+    const size_t overhead = block_header_size(version) + sizeof(FHeader);
+    if (max_size <= overhead || b.data.size() > max_message_size)
+        throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
+                                 fmt::format("{} bytes in fragments of {}", b.data.size(),
+                                             max_size));
+    const size_t chunk = max_size - overhead;
+
+    std::vector<Block> fragments;
+    fragments.reserve((b.data.size() + chunk - 1) / chunk);
+    for (size_t offset = 0; offset < b.data.size(); offset += chunk) {
+        FHeader h = {b.type, message, static_cast<uint32_t>(b.data.size()),
+                     static_cast<uint32_t>(offset)};
+        auto part = b.data.substr(offset, chunk);
+        Block f;
+        f.type = ReservedBlockType::fragment;
+        f.data.reserve(sizeof(h) + part.size());
+        f.data.append(reinterpret_cast<char*>(&h), sizeof(h));
+        f.data.append(part);
+        fragments.push_back(std::move(f));
+    }
+    return fragments;
+}
+
+bool Packet::parse_fragment(const BlockView& b, Fragment& fragment)
+{
+    if (b.type != ReservedBlockType::fragment || b.data.size() < sizeof(FHeader))
+        return false;
+    FHeader h;
+    std::memcpy(&h, b.data.data(), sizeof(h));
+    auto data = b.data.substr(sizeof(h));
+    if (h.offset > h.size || data.size() > h.size - h.offset)
+        return false;
+    fragment = {h.type, h.message, h.size, h.offset, data};
+    return true;
+}
+
+Packet::Block Packet::make_subscribe(const std::vector<Subscription>& subscriptions)
+{
+    Block b;
+    b.type = ReservedBlockType::subscribe;
+    b.data.assign(reinterpret_cast<const char*>(subscriptions.data()),
+                  subscriptions.size() * sizeof(Subscription));
+    return b;
+}
+
+std::vector<Packet::Subscription> Packet::parse_subscribe(const BlockView& b)
+{
+    std::vector<Subscription> subscriptions(b.data.size() / sizeof(Subscription));
+    std::memcpy(subscriptions.data(), b.data.data(), subscriptions.size() * sizeof(Subscription));
+    return subscriptions;
+}
+
+Packet::Block Packet::make_channel(uint16_t id, uint32_t seq)
+{
+    CHeader h = {id, seq};
+    Block b;
+    b.type = ReservedBlockType::channel;
+    b.data.assign(reinterpret_cast<const char*>(&h), sizeof(h));
+    return b;
+}
+
+bool Packet::parse_channel(const BlockView& b, uint16_t& id, uint32_t& seq)
+{
+    if (b.type != ReservedBlockType::channel || b.data.size() < sizeof(CHeader))
+        return false;
+    CHeader h;
+    std::memcpy(&h, b.data.data(), sizeof(h));
+    id  = h.id;
+    seq = h.seq;
+    return true;
+}
+
+Packet Packet::make_data(Id id, std::vector<BlockView>& blocks, uint8_t version,
+                         Checksum checksum, bool compress, size_t alignment)
+{
+    return make_packet(id, Packet::Type::data, blocks, version, checksum, compress, alignment);
+}
+
+Packet Packet::make_data(Id id, std::vector<Block>& blocks, uint8_t version,
+                         Checksum checksum, bool compress, size_t alignment)
+{
+    std::vector<BlockView> views(blocks.begin(), blocks.end());
+    return make_packet(id, Packet::Type::data, views, version, checksum, compress, alignment);
+}
+
+Packet Packet::make_packet(Id id, Type type, const std::vector<BlockView>& blocks,
+                           uint8_t version, Checksum checksum, bool compress, size_t alignment)
+{
+    const uint8_t align_flags = version == v2 ? alignment_flags(alignment) : 0;
+    if (!align_flags)
+        alignment = 1;
+    const size_t h_size  = header_size(version);
+    const size_t bh_size = block_header_size(version);
+    size_t size = h_size;
+    for (auto& b: blocks)
+        size += block_padding(size + bh_size, b.type, alignment) + bh_size + b.data.size();
+    if (blocks.size() > UINT8_MAX)
+        throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
+                                 fmt::format("{} blocks", blocks.size()));
+
+    // blocks are written straight into the frame, behind the room left for the header
+    Packet p;
+    char * out = alloc_frame(p, size, version);
+    size_t pos = h_size;
     for (auto& b: blocks) {
-        payload += Packet::make_block(b);
+        size_t padding = block_padding(pos + bh_size, b.type, alignment);
+        write_block_header(out + pos, b.type, b.data.size(), version);
+        pos += bh_size;
+        std::memset(out + pos, 0, padding);
+        pos += padding;
+        std::memcpy(out + pos, b.data.data(), b.data.size());
+        pos += b.data.size();
+    }
+
+    std::string_view payload(out + h_size, size - h_size);
+    if (compress && version == v2) {
+        std::string compressed(payload);
+        if (compress_payload(compressed)) {
+            std::string header(make_header(id, type, blocks.size(), compressed, version,
+                                           checksum, true, align_flags));
+            return Packet(header + compressed);
+        }
+    }
+    write_header(out, id, type, blocks.size(), payload, version, checksum, false, align_flags);
+    return p;
+}
+
+Packet Packet::make_packet(Id id, Type type, BlockType block_type, std::string_view head,
+                           std::string_view data, uint8_t version, Checksum checksum)
+{
+    const size_t h_size  = header_size(version);
+    const size_t bh_size = block_header_size(version);
+    Packet p;
+    char * out = alloc_frame(p, h_size + bh_size + head.size() + data.size(), version);
+    write_block_header(out + h_size, block_type, head.size() + data.size(), version);
+    std::memcpy(out + h_size + bh_size, head.data(), head.size());
+    std::memcpy(out + h_size + bh_size + head.size(), data.data(), data.size());
+    std::string_view payload(out + h_size, bh_size + head.size() + data.size());
+    write_header(out, id, type, 1, payload, version, checksum, false, 0);
+    return p;
+}
+
+char * Packet::alloc_frame(Packet& p, size_t size, uint8_t version)
+{
+    if (size > (version == v2 ? max_frame_size : max_size))
+        throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
+                                 fmt::format("{} bytes", size));
+    if (size <= max_size)
+        return p.data_.data();
+    p.large_data_.resize(size);
+    return p.large_data_.data();
+}
+
+void Packet::write_block_header(char * out, BlockType type, size_t size, uint8_t version)
+{
+    if (version == v2) {
+        BHeaderV2 bh = {type, static_cast<uint32_t>(size)};
+        std::memcpy(out, &bh, sizeof(bh));
+    } else {
+        BHeader bh = {type, static_cast<uint16_t>(size)};
+        std::memcpy(out, &bh, sizeof(bh));
     }
-    std::string header(Packet::make_header(id, Packet::Type::data, blocks.size(), payload));
+}
+
+Packet Packet::make_nack(Id id, const std::vector<Id>& missing, uint8_t version,
+                         Checksum checksum)
+{
+    std::string data;
+    for (auto m: missing)
+        data += make_id(m, version);
+    std::string payload(Packet::make_block(ReservedBlockType::nack_ids, data, version));
+    std::string header(Packet::make_header(id, Packet::Type::nack, 1, payload, version,
+                                           checksum));
     return Packet(header + payload);
 }
 
-Packet Packet::make_keepalive(Id id)
+Packet Packet::make_bulk(Id id, const BulkChunk& chunk, uint8_t version, Checksum checksum)
+{
+    // the data is copied once, from the source into the frame
+    KHeader h = {chunk.transfer, chunk.type, chunk.size, chunk.offset};
+    return make_packet(id, Type::bulk, ReservedBlockType::bulk_chunk,
+                       std::string_view(reinterpret_cast<char*>(&h), sizeof(h)), chunk.data,
+                       version, checksum);
+}
+
+bool Packet::parse_bulk(const BlockView& b, BulkChunk& chunk)
+{
+    if (b.type != ReservedBlockType::bulk_chunk || b.data.size() < sizeof(KHeader))
+        return false;
+    KHeader h;
+    std::memcpy(&h, b.data.data(), sizeof(h));
+    auto data = b.data.substr(sizeof(h));
+    if (h.offset > h.size || data.size() > h.size - h.offset)
+        return false;
+    chunk = {h.transfer, h.type, h.size, h.offset, data};
+    return true;
+}
+
+size_t Packet::bulk_chunk_size(size_t max_pl_size, uint8_t version)
+{
+    return max_pl_size - block_header_size(version) - sizeof(KHeader);
+}
+
+Packet Packet::make_bulk_ack(Id id, uint32_t transfer, uint64_t offset, uint8_t version,
+                             Checksum checksum)
+{
+    KAck a = {transfer, offset};
+    return make_packet(id, Type::bulk_ack, ReservedBlockType::bulk_offset,
+                       std::string_view(reinterpret_cast<char*>(&a), sizeof(a)), {}, version,
+                       checksum);
+}
+
+bool Packet::parse_bulk_ack(const BlockView& b, uint32_t& transfer, uint64_t& offset)
+{
+    if (b.type != ReservedBlockType::bulk_offset || b.data.size() < sizeof(KAck))
+        return false;
+    KAck a;
+    std::memcpy(&a, b.data.data(), sizeof(a));
+    transfer = a.transfer;
+    offset   = a.offset;
+    return true;
+}
+
+Packet Packet::make_keepalive(Id id, uint8_t version)
 {
     std::string payload;
-    std::string header(Packet::make_header(id, Packet::Type::ka, 0, payload));
+    std::string header(Packet::make_header(id, Packet::Type::ka, 0, payload, version));
     return Packet(header + payload);
 }
 
-Packet Packet::make_keepalive_ack(Id id)
+Packet Packet::make_keepalive_ack(Id id, uint8_t version)
 {
     std::string payload;
-    std::string header(Packet::make_header(id, Packet::Type::ka_ack, 0, payload));
+    std::string header(Packet::make_header(id, Packet::Type::ka_ack, 0, payload, version));
     return Packet(header + payload);
 }
 
-Packet Packet::make_hip(Id id, const hdcp::Identification& host_id)
+Packet Packet::make_hip(Id id, const hdcp::Identification& host_id,
+                        const std::string& capabilities)
 {
-    std::string payload;
-    payload += Packet::make_block(ReservedBlockType::name, host_id.name);
-    payload += Packet::make_block(ReservedBlockType::serial_number, host_id.serial_number);
-    payload += Packet::make_block(ReservedBlockType::hw_version, host_id.hw_version);
-    payload += Packet::make_block(ReservedBlockType::sw_version, host_id.sw_version);
-    std::string header(Packet::make_header(id, Packet::Type::hip, 4, payload));
+    uint8_t n_block;
+    std::string payload(Packet::make_identification(host_id, capabilities, n_block));
+    std::string header(Packet::make_header(id, Packet::Type::hip, n_block, payload));
     return Packet(header + payload);
 }
 
-Packet Packet::make_dip(Id id, const hdcp::Identification& dev_id)
+Packet Packet::make_dip(Id id, const hdcp::Identification& dev_id,
+                        const std::string& capabilities)
 {
-    std::string payload;
-    payload += Packet::make_block(ReservedBlockType::name, dev_id.name);
-    payload += Packet::make_block(ReservedBlockType::serial_number, dev_id.serial_number);
-    payload += Packet::make_block(ReservedBlockType::hw_version, dev_id.hw_version);
-    payload += Packet::make_block(ReservedBlockType::sw_version, dev_id.sw_version);
-    std::string header(Packet::make_header(id, Packet::Type::dip, 4, payload));
+    uint8_t n_block;
+    std::string payload(Packet::make_identification(dev_id, capabilities, n_block));
+    std::string header(Packet::make_header(id, Packet::Type::dip, n_block, payload));
     return Packet(header + payload);
 }
 
+std::string Packet::make_identification(const hdcp::Identification& id,
+                                        const std::string& capabilities, uint8_t& n_block)
+{
+    std::string payload;
+    payload += Packet::make_block(ReservedBlockType::name, id.name);
+    payload += Packet::make_block(ReservedBlockType::serial_number, id.serial_number);
+    payload += Packet::make_block(ReservedBlockType::hw_version, id.hw_version);
+    payload += Packet::make_block(ReservedBlockType::sw_version, id.sw_version);
+    n_block = 4;
+    // only advertise capabilities when some are given so that old peers see the same packet
+    if (!capabilities.empty()) {
+        payload += Packet::make_block(ReservedBlockType::capabilities, capabilities);
+        n_block++;
+    }
+    return payload;
+}
+
 Packet::Crc Packet::compute_crc(std::string_view v)
 {
-    uint8_t CRCA = 0, CRCB = 0;
+    return checksum::fletcher16(v);
+}
 
-    for (const auto& c: v) {
-        CRCA = CRCA + *reinterpret_cast<const uint8_t*>(&c);
-        CRCB = CRCB + CRCA;
+uint32_t Packet::compute_crc(std::string_view v, Checksum checksum)
+{
+    switch (checksum) {
+    case Checksum::crc32c: return checksum::crc32c(v);
+    case Checksum::none:   return 0;
+    default:               return checksum::fletcher16(v);
     }
+}
 
-    return CRCA << 8 | CRCB;
+std::string Packet::make_header(Id id, Type type, uint8_t n_block, std::string_view payload,
+                                uint8_t version, Checksum checksum, bool compressed,
+                                uint8_t align_flags)
+{
+    std::string header(header_size(version), '\0');
+    write_header(header.data(), id, type, n_block, payload, version, checksum, compressed,
+                 align_flags);
+    return header;
 }
 
-std::string Packet::make_header(Id id, Type type, uint8_t n_block, const std::string& payload)
+void Packet::write_header(char * out, Id id, Type type, uint8_t n_block, std::string_view payload,
+                          uint8_t version, Checksum checksum, bool compressed,
+                          uint8_t align_flags)
 {
+    if (version == v2) {
+        HeaderV2 h = {
+            .sop   = sop,
+            .ver   = v2,
+            .flags = static_cast<uint8_t>(static_cast<uint8_t>(checksum) | align_flags |
+                                          (compressed ? compressed_flag : 0)),
+            .len   = static_cast<uint32_t>(payload.size()),
+            .id    = id,
+            .type  = type,
+            .n_block = n_block,
+            .p_crc = compute_crc(payload, checksum),
+            .h_crc = 0
+        };
+        char * it = reinterpret_cast<char*>(&h);
+        h.h_crc = compute_crc(std::string_view(it, sizeof(h) - sizeof(Crc)));
+        std::memcpy(out, &h, sizeof(h));
+        return;
+    }
+
     Header h = {
         .sop  = sop,
-        .ver  = ver,
+        .ver  = v1,
         .len  = static_cast<uint16_t>(payload.size()),
-        .id   = id,
+        .id   = static_cast<uint16_t>(id),
         .type = type,
         .n_block = n_block,
-        .p_crc = compute_crc(std::string_view(payload.data(), payload.size())),
+        .p_crc = compute_crc(payload),
         .h_crc = 0
     };
 
@@ -123,69 +598,162 @@ std::string Packet::make_header(Id id, Type type, uint8_t n_block, const std::st
     std::string_view header_view(it, sizeof(Packet::Header) - sizeof(Crc));
     h.h_crc = compute_crc(header_view);
 
-    return std::string(it, it + sizeof(h));
+    std::memcpy(out, &h, sizeof(h));
 }
 
-std::string Packet::make_block(BlockType type, const std::string& data)
+bool Packet::compress_payload(std::string& payload)
+{
+    uint32_t raw_size = payload.size();
+    std::string out(sizeof(raw_size) + lz::max_compressed_size(raw_size), '\0');
+    std::memcpy(out.data(), &raw_size, sizeof(raw_size));
+    size_t size = lz::compress(payload, out.data() + sizeof(raw_size),
+                               out.size() - sizeof(raw_size));
+    if (size == 0 || sizeof(raw_size) + size >= payload.size())
+        return false;
+    out.resize(sizeof(raw_size) + size);
+    payload.swap(out);
+    return true;
+}
+
+std::string Packet::make_id(Id id, uint8_t version)
+{
+    if (version == v2)
+        return std::string(reinterpret_cast<char*>(&id), sizeof(id));
+    uint16_t id16 = id;
+    return std::string(reinterpret_cast<char*>(&id16), sizeof(id16));
+}
+
+std::string Packet::make_block(BlockType type, const std::string& data, uint8_t version)
 {
     BlockView b;
     b.type = type;
     b.data = data;
-    return Packet::make_block(b);
+    return Packet::make_block(b, version);
 }
 
-std::string Packet::make_block(BlockView b)
+std::string Packet::make_block(BlockView b, uint8_t version, size_t padding)
 {
     char * it = reinterpret_cast<char*>(&b.type);
     std::string type_str(it, it + sizeof(BlockType));
 
-    uint16_t len = b.data.size();
-    it = reinterpret_cast<char*>(&len);
-    std::string len_str(it, it + sizeof(len));
+    std::string len_str;
+    if (version == v2) {
+        uint32_t len = b.data.size();
+        it = reinterpret_cast<char*>(&len);
+        len_str.assign(it, it + sizeof(len));
+    } else {
+        uint16_t len = b.data.size();
+        it = reinterpret_cast<char*>(&len);
+        len_str.assign(it, it + sizeof(len));
+    }
 
     std::string ret = type_str + len_str;
+    ret.append(padding, '\0');
     ret.append(b.data);
 
     return ret;
 }
 
-std::vector<Packet::BlockView> Packet::blocks(std::string_view payload)
+uint8_t Packet::alignment_flags(size_t alignment)
+{
+    switch (alignment) {
+    case 8:  return 1 << alignment_shift;
+    case 16: return 2 << alignment_shift;
+    case 32: return 3 << alignment_shift;
+    default: return 0;
+    }
+}
+
+size_t Packet::alignment_of(uint8_t flags)
+{
+    uint8_t n = (flags & alignment_mask) >> alignment_shift;
+    return n ? 4 << n : 1;
+}
+
+size_t Packet::block_padding(size_t offset, BlockType type, size_t alignment)
+{
+    // array elements are aligned rather than their header
+    if (type == ReservedBlockType::array)
+        offset += sizeof(AHeader);
+    return (alignment - offset % alignment) % alignment;
+}
+
+std::vector<Packet::BlockView> Packet::blocks(std::string_view payload, uint8_t version,
+                                              size_t alignment)
 {
     std::vector<BlockView> blocks;
-    auto it = payload.begin();
-    while (it + sizeof(BHeader) <= payload.end()) {
-        const BHeader * header = reinterpret_cast<const BHeader*>(it);
-        it += sizeof(Packet::BHeader);
-        if (it + header->len > payload.end())
-            break;
-        BlockView b;
-        b.type = header->type;
-        b.data = std::string_view(it, header->len);
-        it += header->len;
+    BlockView b;
+    for (size_t pos = 0; next_block(payload, pos, version, alignment, b);)
         blocks.push_back(b);
-    }
 
     return blocks;
 }
 
-const Packet::Header * Packet::parse_header(std::string_view v)
+bool Packet::next_block(std::string_view payload, size_t& pos, uint8_t version,
+                        size_t alignment, BlockView& b)
 {
-    if (v.size() != sizeof(Packet::Header))
+    const size_t bh_size = block_header_size(version);
+    if (pos + bh_size > payload.size())
+        return false;
+
+    size_t len;
+    if (version == v2) {
+        const BHeaderV2 * header = reinterpret_cast<const BHeaderV2*>(payload.data() + pos);
+        b.type = header->type;
+        len    = header->len;
+    } else {
+        const BHeader * header = reinterpret_cast<const BHeader*>(payload.data() + pos);
+        b.type = header->type;
+        len    = header->len;
+    }
+    size_t it = pos + bh_size;
+    if (alignment > 1)
+        it += block_padding(header_size(version) + it, b.type, alignment);
+    if (it > payload.size() || len > payload.size() - it)
+        return false;
+    b.data = payload.substr(it, len);
+    pos = it + len;
+    return true;
+}
+
+size_t Packet::parse_header(std::string_view v)
+{
+    if (v.size() < min_header_size)
         throw hdcp::packet_error(packet::Errc::invalid_buffer_size,
-                                 fmt::format("{} != {}", v.size(), sizeof(Packet::Header)));
+                                 fmt::format("{} < {}", v.size(), min_header_size));
 
     const Header * h = reinterpret_cast<const Header*>(v.data());
-    if (compute_crc(std::string_view(v.data(), v.size()-sizeof(Crc))) != h->h_crc)
-        throw hdcp::packet_error(packet::Errc::invalid_header_crc);
-
     if (h->sop != sop)
         throw hdcp::packet_error(packet::Errc::sop_not_found);
 
-    if (h->ver != ver)
+    if (h->ver != v1 && h->ver != v2)
         throw hdcp::packet_error(packet::Errc::invalid_protocol_version,
                                  fmt::format("{}", h->ver));
 
-    switch (h->type) {
+    if (v.size() != header_size(h->ver))
+        throw hdcp::packet_error(packet::Errc::invalid_buffer_size,
+                                 fmt::format("{} != {}", v.size(), header_size(h->ver)));
+
+    const Crc * h_crc = reinterpret_cast<const Crc*>(v.data() + v.size() - sizeof(Crc));
+    if (compute_crc(std::string_view(v.data(), v.size()-sizeof(Crc))) != *h_crc)
+        throw hdcp::packet_error(packet::Errc::invalid_header_crc);
+
+    Type   type;
+    size_t len;
+    if (h->ver == v2) {
+        auto h2 = reinterpret_cast<const HeaderV2*>(v.data());
+        type = h2->type;
+        len  = h2->len;
+        if ((h2->flags & checksum_mask) > static_cast<uint8_t>(Checksum::none) ||
+            h2->flags & ~(checksum_mask | compressed_flag | alignment_mask))
+            throw hdcp::packet_error(packet::Errc::invalid_header_flags,
+                                     fmt::format("{:#x}", h2->flags));
+    } else {
+        type = h->type;
+        len  = h->len;
+    }
+
+    switch (type) {
     case Packet::Type::hip:
     case Packet::Type::dip:
     case Packet::Type::ka:
@@ -193,48 +761,86 @@ const Packet::Header * Packet::parse_header(std::string_view v)
     case Packet::Type::cmd:
     case Packet::Type::cmd_ack:
     case Packet::Type::data:
+    case Packet::Type::nack:
+    case Packet::Type::bulk:
+    case Packet::Type::bulk_ack:
         break;
     default:
         throw hdcp::packet_error(packet::Errc::invalid_packet_type,
-                                 fmt::format("{:#x}", h->type));
+                                 fmt::format("{:#x}", type));
     }
 
-    if (h->len > max_size - sizeof(Header))
+    if (len > (h->ver == v2 ? max_frame_size : max_size) - v.size())
         throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
-                                 fmt::format("{}", h->len));
+                                 fmt::format("{}", len));
 
-    return h;
+    return len;
 }
 
 void Packet::parse_header() const
 {
-    parse_header(std::string_view(data_.data(), sizeof(Packet::Header)));
+    parse_header(header_view());
 }
 
-void Packet::parse_payload(std::string_view v, const Header * h)
+void Packet::parse_payload(std::string_view header, std::string_view v)
 {
-    if (h->len != v.size())
+    const Header * h = reinterpret_cast<const Header*>(header.data());
+    size_t   len;
+    uint8_t  n_block;
+    uint32_t p_crc;
+    Checksum checksum   = Checksum::fletcher16;
+    bool     compressed = false;
+    size_t   alignment  = 1;
+    if (h->ver == v2) {
+        auto h2 = reinterpret_cast<const HeaderV2*>(header.data());
+        len        = h2->len;
+        n_block    = h2->n_block;
+        p_crc      = h2->p_crc;
+        checksum   = static_cast<Checksum>(h2->flags & checksum_mask);
+        compressed = h2->flags & compressed_flag;
+        alignment  = alignment_of(h2->flags);
+    } else {
+        len     = h->len;
+        n_block = h->n_block;
+        p_crc   = h->p_crc;
+    }
+
+    if (len != v.size())
         throw hdcp::packet_error(packet::Errc::invalid_buffer_size,
-                                 fmt::format("{} != {}", v.size(), h->len));
+                                 fmt::format("{} != {}", v.size(), len));
 
-    if (h->p_crc != compute_crc(v))
+    if (p_crc != compute_crc(v, checksum))
         throw hdcp::packet_error(packet::Errc::invalid_payload_crc);
 
-    auto b = blocks(v);
-    if (h->n_block != b.size())
+    // blocks are counted once decompressed, only the announced size is checked here
+    if (compressed) {
+        uint32_t raw_size;
+        if (v.size() < sizeof(raw_size))
+            throw hdcp::packet_error(packet::Errc::invalid_compressed_payload);
+        std::memcpy(&raw_size, v.data(), sizeof(raw_size));
+        if (raw_size > max_frame_size - sizeof(HeaderV2))
+            throw hdcp::packet_error(packet::Errc::payload_exceed_max_size,
+                                     fmt::format("{} once decompressed", raw_size));
+        return;
+    }
+
+    auto b = blocks(v, h->ver, alignment);
+    if (n_block != b.size())
         throw hdcp::packet_error(packet::Errc::invalid_number_of_block,
-                                 fmt::format("{} should be {}", b.size(), h->n_block));
+                                 fmt::format("{} should be {}", b.size(), n_block));
 }
 
 void Packet::parse_payload() const
 {
-    parse_payload(payload(), header());
+    parse_payload(header_view(), payload());
 }
 
 std::ostream& operator<<(std::ostream& out, const Packet& p)
 {
     out << fmt::format("\npacket {}: type={:#x}, with {} block(s) (prot ver:{})\n",
                        p.id(), p.type(), p.nb_block(), p.version());
+    if (p.compressed())
+        return out << fmt::format("\tcompressed, {} bytes\n", p.payload().size());
     int i = 0;
     for (auto& b: p.blocks()) {
         out << fmt::format("\tblock {}: type {:#x}, len {} -> {:#x}\n",
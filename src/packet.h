@@ -1,34 +1,112 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <new>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include "common/log.h"
 
 #include "packet_error.h"
+#include "application_error.h"
 #include "application.h"
+#include "block_codec.h"
 
 namespace hdcp {
 
+/// Allocator of the buffers of large frames, aligned as the inline one
+template<typename T, size_t A>
+struct AlignedAllocator
+{
+    using value_type = T;
+    template<typename U> struct rebind {using other = AlignedAllocator<U, A>;};
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U, A>&) {}
+
+    T * allocate(size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(A)));
+    }
+    void deallocate(T * p, size_t) {::operator delete(p, std::align_val_t(A));}
+
+    template<typename U> bool operator==(const AlignedAllocator<U, A>&) const {return true;}
+    template<typename U> bool operator!=(const AlignedAllocator<U, A>&) const {return false;}
+};
+
 class Packet
 {
 public:
-    using Id        = uint16_t;
+    using Id        = uint32_t; // 16 bit on the wire in v1
     using BlockType = uint16_t;
 
+    static constexpr uint8_t v1 = 0x01;
+    static constexpr uint8_t v2 = 0x02; // 32 bit ids and lengths, Feature::extended_id
+
+    /// Payload integrity check of v2 packets, v1 ones always use fletcher16
+    enum class Checksum: uint8_t {
+        fletcher16 = 0,
+        crc32c     = 1,
+        none       = 2, // the link already guarantees integrity
+    };
+
+    /// Largest alignment of block data in v2 packets, that of the packet buffers
+    static constexpr size_t max_alignment = 32;
+
+    /*
+     * Block types up to max_reserved_block_type belong to the protocol, applications take
+     * theirs from first_application_block_type. The identification types, name to features,
+     * only mean something in the hip and dip and stay free in commands and data as they always
+     * were; the others are read by the protocol in any packet, see is_reserved().
+     */
+    static constexpr BlockType max_reserved_block_type     = 0x00ff;
+    static constexpr BlockType first_application_block_type = 0x0100;
     enum ReservedBlockType: BlockType {
         name          = 0x0001,
         serial_number = 0x0002,
         hw_version    = 0x0003,
-        sw_version    = 0x0004
+        sw_version    = 0x0004,
+        features      = 0x0005, // superseded by capabilities, ignored
+        cmd_ack_range = 0x0006, // acks every command packet with an id in [first, last]
+        cmd_response  = 0x0007, // acks one command with its response
+        nack_ids      = 0x0008, // ids of the data packets to send again
+        capabilities  = 0x0009, // hip/dip, encoded by hdcp::Capabilities
+        array         = 0x000a, // elements of one type and size behind a single header
+        subscribe     = 0x000b, // cmd, data block types the master wants to receive
+        fragment      = 0x000c, // part of a block too large for a packet
+        bulk_chunk    = 0x000d, // bulk, part of a transfer
+        bulk_offset   = 0x000e, // bulk_ack, bytes of a transfer received in order
+        channel       = 0x000f, // data, first block: logical channel and its sequence number
+        cmd_retry     = 0x0010, // cmd, first block: id and index of the command sent again
     };
 
+    /// True if the protocol reads blocks of type in commands or data, applications can't use it
+    static constexpr bool is_reserved(BlockType type)
+    {
+        return type > ReservedBlockType::features && type <= max_reserved_block_type;
+    }
+
+    /// Data block type sent to the master, one block in every decimation
+    struct Subscription
+    {
+        BlockType type;
+        uint16_t  decimation = 1;
+    }__attribute__((packed));
+
     struct BlockView;
     struct Block
     {
         explicit operator BlockView() const noexcept {return BlockView();};
-        size_t size() {return data.size() + sizeof(BHeader);};
+        /// Worst case once padded to alignment
+        size_t size(uint8_t version = v1, size_t alignment = 1) const
+        {
+            return data.size() + block_header_size(version) + alignment - 1;
+        };
         BlockType        type;
         std::string      data;
     };
@@ -38,21 +116,84 @@ public:
     {
         BlockView() = default;
         BlockView(const Block& from): type(from.type), data(from.data) {};
-        size_t size() {return data.size() + sizeof(BHeader);};
+        /// The encoded block must outlive the view
+        template<typename T>
+        BlockView(const EncodedBlock<T>& from): type(from.type()), data(from.data()) {};
+        size_t size(uint8_t version = v1, size_t alignment = 1) const
+        {
+            return data.size() + block_header_size(version) + alignment - 1;
+        };
+        /// Data as an array of T read in place, nullptr if it is not aligned for T
+        template<typename T>
+        const T * as() const {return aligned_as<T>(data.data());}
 
         BlockType        type;
         std::string_view data;
     };
 
+    /// Part of the data of a block sent in several packets
+    struct Fragment
+    {
+        BlockType        type;    // of the whole block
+        uint32_t         message; // identifies the block among those being sent
+        uint32_t         size;    // of the whole block data
+        uint32_t         offset;
+        std::string_view data;
+    };
+
+    /// Part of a bulk transfer, without data it asks the offset reached by the receiver
+    struct BulkChunk
+    {
+        uint32_t         transfer;
+        BlockType        type;     // of the whole transfer, up to the application
+        uint64_t         size;     // of the whole transfer
+        uint64_t         offset;
+        std::string_view data;
+    };
+
+    /// Strided view of the elements of an array block, they stay in the packet
+    struct ArrayView
+    {
+        BlockType    type      = 0; // type of every element
+        size_t       elem_size = 0;
+        size_t       count     = 0;
+        const char * data      = nullptr;
+
+        size_t size() const {return count;}
+        /// Elements as an array of T read in place, nullptr if they are not T sized or aligned
+        template<typename T>
+        const T * as() const {return elem_size == sizeof(T) ? aligned_as<T>(data) : nullptr;}
+        std::string_view operator[](size_t i) const
+        {
+            return std::string_view(data + i * elem_size, elem_size);
+        }
+        /// Element i copied in a T, throws invalid_block_size if the elements are not T sized
+        template<typename T>
+        T get(size_t i) const
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (elem_size != sizeof(T))
+                throw application_error(appli::Errc::invalid_block_size,
+                                        fmt::format("{} bytes elements read as {} bytes",
+                                                    elem_size, sizeof(T)));
+            T v;
+            std::memcpy(&v, data + i * elem_size, sizeof(T));
+            return v;
+        }
+    };
+
     enum class Type: uint8_t
     {
-        hip     = 0x01, // host identication packet
-        dip     = 0x41, // device identification packet
-        ka      = 0x02, // keep-alive
-        ka_ack  = 0x42, // keep-alive ack
-        cmd     = 0x03, // command
-        cmd_ack = 0x43, // command ack
-        data    = 0x44, // data
+        hip      = 0x01, // host identication packet
+        dip      = 0x41, // device identification packet
+        ka       = 0x02, // keep-alive
+        ka_ack   = 0x42, // keep-alive ack
+        cmd      = 0x03, // command
+        nack     = 0x05, // data retransmission request
+        bulk     = 0x06, // bulk transfer chunk
+        cmd_ack  = 0x43, // command ack
+        data     = 0x44, // data
+        bulk_ack = 0x46, // cumulative ack of bulk chunks
     };
 
     Packet(std::string_view);
@@ -62,31 +203,141 @@ public:
     Packet(Packet&&)                 = default;
     Packet& operator=(Packet&&)      = default;
 
-    Id       id()       const {return header()->id;}
-    uint8_t  version()  const {return header()->ver;}
-    Type     type()     const {return header()->type;}
-    uint8_t  nb_block() const {return header()->n_block;}
-    size_t   size()     const {return payload().size() + sizeof(Header);}
-    char *   data()           {return data_.data();}
-    const char * data() const {return data_.data();}
-    std::vector<BlockView> blocks() const {return blocks(payload());};
-    std::string_view header_view()  const {return std::string_view(data_.data(), sizeof(Header));};
+    Id       id()       const;
+    uint8_t  version()  const {return static_cast<uint8_t>(data()[offsetof(Header, ver)]);}
+    Type     type()     const;
+    uint8_t  nb_block() const;
+    Checksum checksum() const;
+    /// Alignment of the block data in the frame, 1 when not padded
+    size_t   alignment() const;
+    /// Blocks of a compressed packet are only readable once decompressed
+    bool     compressed() const;
+    /// Expand the payload in the packet buffer, from a copy of the compressed one; the header
+    /// then describes the raw payload. A frame above max_size once expanded gets a buffer of
+    /// its own, written straight from the compressed payload
+    void     decompress(size_t max_frame_size = Packet::max_frame_size);
+    size_t   size()     const {return header_size() + payload_size();}
+    size_t   header_size() const {return header_size(version());}
+    char *   data()           {return large_data_.empty() ? data_.data() : large_data_.data();}
+    const char * data() const {return large_data_.empty() ? data_.data() : large_data_.data();}
+    /// Make room for a frame of size bytes, keeping the header already read
+    void     reserve(size_t size);
+    std::vector<BlockView> blocks() const {return blocks(payload(), version(), alignment());};
+    /// Call f on each block, without building the vector of blocks()
+    template<typename F>
+    void for_each_block(F&& f) const
+    {
+        BlockView b;
+        for (size_t pos = 0; next_block(payload(), pos, version(), alignment(), b);)
+            f(b);
+    }
+    /// Values of the first block of type, or of the first array block of type elements
+    template<typename T>
+    TypedView<T> get(BlockType type) const
+    {
+        BlockView b;
+        ArrayView a;
+        for (size_t pos = 0; next_block(payload(), pos, version(), alignment(), b);) {
+            if (b.type == type) {
+                if (b.data.size() % BlockCodec<T>::size)
+                    throw application_error(appli::Errc::invalid_block_size,
+                                            fmt::format("{} bytes read as {} bytes values",
+                                                        b.data.size(), BlockCodec<T>::size));
+                return TypedView<T>(b.data.data(), b.data.size() / BlockCodec<T>::size);
+            }
+            if (parse_array(b, a) && a.type == type && a.elem_size >= BlockCodec<T>::size)
+                return TypedView<T>(a.data, a.count, a.elem_size);
+        }
+        return {};
+    }
+    /// Logical channel of a data packet and its sequence number in it, false on the default
+    /// channel. The channel block stays the first of blocks()
+    bool channel_of(uint16_t& id, uint32_t& seq) const
+    {
+        BlockView b;
+        size_t pos = 0;
+        return next_block(payload(), pos, version(), alignment(), b) && parse_channel(b, id, seq);
+    }
+    std::string_view header_view()  const {return std::string_view(data(), header_size());};
     std::string_view payload() const
     {
-        return std::string_view(data_.data() + sizeof(Packet::Header), header()->len);
+        return std::string_view(data() + header_size(), payload_size());
+    }
+    /// Packet ids carried by a block (acks, nacks), their width depends on the version
+    std::vector<Id> ids(const BlockView& b) const;
+    /// Split a cmd_response block, false if it is ill-formed
+    bool parse_cmd_response(const BlockView& b, Id& cmd_id, uint8_t& block,
+                            std::string_view& response) const;
+    /// Split a cmd_retry block, false if it is ill-formed
+    bool parse_cmd_retry(const BlockView& b, Id& cmd_id, uint8_t& block) const;
+    /// View the elements of an array block, false if it is ill-formed
+    static bool parse_array(const BlockView& b, ArrayView& array);
+    /// Size of the id sequence space, ids wrap at 16 bits in v1
+    static Id id_mask(uint8_t version) {return version == v1 ? 0xffff : 0xffffffff;}
+    /// Signed distance from b to a in the sequence space of the version
+    static int32_t id_delta(Id a, Id b, uint8_t version)
+    {
+        return version == v1 ? static_cast<int16_t>(a - b) : static_cast<int32_t>(a - b);
+    }
+    static size_t id_size(uint8_t version) {return version == v1 ? sizeof(uint16_t) : sizeof(Id);}
+    static size_t header_size(uint8_t version);
+    static size_t block_header_size(uint8_t version)
+    {
+        return version == v2 ? sizeof(BHeaderV2) : sizeof(BHeader);
     }
 
     void parse_header() const;
     void parse_payload() const;
 
-    static Packet make_command(Id, BlockType, const std::string&);
-    static Packet make_cmd_ack(Id, BlockType, Id);
-    static Packet make_data(Id, std::vector<BlockView>& blocks);
-    static Packet make_data(Id, std::vector<Block>& blocks);
-    static Packet make_keepalive(Id id);
-    static Packet make_keepalive_ack(Id id);
-    static Packet make_hip(Id id, const hdcp::Identification& host_id);
-    static Packet make_dip(Id id, const hdcp::Identification& dev_id);
+    static Packet make_command(Id, BlockType, const std::string&, uint8_t version = v1);
+    static Packet make_command(Id, std::vector<BlockView>& blocks, uint8_t version = v1,
+                               Checksum checksum = Checksum::fletcher16);
+    static Packet make_cmd_ack(Id, BlockType, Id, uint8_t version = v1);
+    static Packet make_cmd_ack(Id, std::vector<Block>& blocks, uint8_t version = v1,
+                               Checksum checksum = Checksum::fletcher16);
+    static Block  make_cmd_ack_range(Id first, Id last, uint8_t version = v1);
+    static Block  make_cmd_response(Id cmd_id, uint8_t block, std::string_view response,
+                                    uint8_t version = v1);
+    /// Leads a command of a coalesced packet sent again alone, so that the slave recognizes
+    /// block of packet cmd_id, Feature::cmd_batching
+    static Block  make_cmd_retry(Id cmd_id, uint8_t block, uint8_t version = v1);
+    /// Split b in fragment blocks of at most max_size bytes each once serialized,
+    /// Feature::fragmentation
+    static std::vector<Block> make_fragments(const BlockView& b, uint32_t message,
+                                             size_t max_size, uint8_t version = v1);
+    static bool parse_fragment(const BlockView& b, Fragment& fragment);
+    /// An empty list subscribes to every type, Feature::subscriptions
+    static Block  make_subscribe(const std::vector<Subscription>& subscriptions);
+    static std::vector<Subscription> parse_subscribe(const BlockView& b);
+    /// First block of the data packets sent on a channel other than 0, Feature::channels
+    static Block  make_channel(uint16_t id, uint32_t seq);
+    static bool   parse_channel(const BlockView& b, uint16_t& id, uint32_t& seq);
+    /// count elements of elem_size bytes laid end to end in elements, Feature::array_blocks
+    static Block  make_array(BlockType type, size_t elem_size, std::string_view elements);
+    /// compress only applies to v2 and is dropped if it does not shrink the payload, block
+    /// data (array elements) is padded to alignment in v2 if it is 8, 16 or 32
+    static Packet make_data(Id, std::vector<BlockView>& blocks, uint8_t version = v1,
+                            Checksum checksum = Checksum::fletcher16, bool compress = false,
+                            size_t alignment = 1);
+    static Packet make_data(Id, std::vector<Block>& blocks, uint8_t version = v1,
+                            Checksum checksum = Checksum::fletcher16, bool compress = false,
+                            size_t alignment = 1);
+    static Packet make_nack(Id id, const std::vector<Id>& missing, uint8_t version = v1,
+                            Checksum checksum = Checksum::fletcher16);
+    static Packet make_bulk(Id id, const BulkChunk& chunk, uint8_t version = v1,
+                            Checksum checksum = Checksum::fletcher16);
+    static bool   parse_bulk(const BlockView& b, BulkChunk& chunk);
+    /// Largest data of a bulk chunk in a payload of max_pl_size
+    static size_t bulk_chunk_size(size_t max_pl_size, uint8_t version = v1);
+    static Packet make_bulk_ack(Id id, uint32_t transfer, uint64_t offset, uint8_t version = v1,
+                                Checksum checksum = Checksum::fletcher16);
+    static bool   parse_bulk_ack(const BlockView& b, uint32_t& transfer, uint64_t& offset);
+    static Packet make_keepalive(Id id, uint8_t version = v1);
+    static Packet make_keepalive_ack(Id id, uint8_t version = v1);
+    static Packet make_hip(Id id, const hdcp::Identification& host_id,
+                           const std::string& capabilities = {});
+    static Packet make_dip(Id id, const hdcp::Identification& dev_id,
+                           const std::string& capabilities = {});
 
 private:
     friend std::ostream& operator<<(std::ostream& out, const Packet& p);
@@ -100,38 +351,146 @@ private:
         uint16_t sop;
         uint8_t  ver;
         uint16_t len;
-        Id       id;
+        uint16_t id;
         Type     type;
         uint8_t  n_block;
         Crc      p_crc;
         Crc      h_crc;
     }__attribute__((packed));
 
+    struct HeaderV2
+    {
+        uint16_t sop;
+        uint8_t  ver;
+        uint8_t  flags;  // checksum of the payload in the low bits, compressed flag, alignment
+        uint32_t len;
+        Id       id;
+        Type     type;
+        uint8_t  n_block;
+        uint32_t p_crc;  // fletcher16 zero-extended, crc32c, or 0
+        Crc      h_crc;  // always fletcher16, the header is checked before the flags are known
+    }__attribute__((packed));
+
+    static constexpr uint8_t checksum_mask   = 0x03;
+    // the payload is a 32 bit raw size followed by the lz stream of the raw payload
+    static constexpr uint8_t compressed_flag = 0x04;
+    // block data starts at a multiple of 4 << n bytes of the frame, n = 0 if not padded
+    static constexpr uint8_t alignment_mask  = 0x18;
+    static constexpr uint8_t alignment_shift = 3;
+
     struct BHeader
     {
         BlockType type;
         uint16_t  len;
     }__attribute__((packed));
 
+    struct BHeaderV2
+    {
+        BlockType type;
+        uint32_t  len;
+    }__attribute__((packed));
+
+    // starts the data of a fragment block, the part of the whole data follows
+    struct FHeader
+    {
+        BlockType type;
+        uint32_t  message;
+        uint32_t  size;
+        uint32_t  offset;
+    }__attribute__((packed));
+
+    // starts the data of a bulk chunk
+    struct KHeader
+    {
+        uint32_t  transfer;
+        BlockType type;
+        uint64_t  size;
+        uint64_t  offset;
+    }__attribute__((packed));
+
+    struct KAck
+    {
+        uint32_t transfer;
+        uint64_t offset;
+    }__attribute__((packed));
+
+    struct CHeader
+    {
+        uint16_t id;
+        uint32_t seq;
+    }__attribute__((packed));
+
+    // starts the data of an array block, the elements follow
+    struct AHeader
+    {
+        BlockType type;
+        uint16_t  elem_size;
+    }__attribute__((packed));
+
 public:
-    static const size_t max_size    = 2048;
-    static const size_t max_pl_size = max_size - sizeof(Header);
+    /// Largest v1 frame, and of v2 frames unless Feature::large_frames is negotiated
+    static constexpr size_t max_size        = 2048;
+    static constexpr size_t max_frame_size  = 1 << 20;
+    /// A v1 header is the shortest one, reading it is enough to know the version
+    static constexpr size_t min_header_size = sizeof(Header);
+    static constexpr size_t max_header_size = sizeof(HeaderV2);
+    static constexpr size_t max_pl_size     = max_size - max_header_size;
 
 private:
     static Crc compute_crc(std::string_view);
-    static std::string make_header(Id id, Type type, uint8_t n_block, const std::string& payload);
-    static std::string make_block(BlockType type, const std::string& data);
-    static std::string make_block(BlockView b);
-    static std::vector<BlockView> blocks(std::string_view);
-    static const Header * parse_header(std::string_view);
-    static void parse_payload(std::string_view, const Header *);
-
-    const Header * header() const
+    static uint32_t compute_crc(std::string_view, Checksum checksum);
+    static std::string make_header(Id id, Type type, uint8_t n_block, std::string_view payload,
+                                   uint8_t version = v1,
+                                   Checksum checksum = Checksum::fletcher16,
+                                   bool compressed = false, uint8_t align_flags = 0);
+    static void write_header(char * out, Id id, Type type, uint8_t n_block,
+                             std::string_view payload, uint8_t version, Checksum checksum,
+                             bool compressed, uint8_t align_flags);
+    /// Blocks written in place in the frame of the packet, without intermediate strings
+    static Packet make_packet(Id id, Type type, const std::vector<BlockView>& blocks,
+                              uint8_t version, Checksum checksum, bool compress = false,
+                              size_t alignment = 1);
+    /// Packet of one block made of head then data, each copied once in the frame
+    static Packet make_packet(Id id, Type type, BlockType block_type, std::string_view head,
+                              std::string_view data, uint8_t version, Checksum checksum);
+    /// Give p a frame of size bytes and return it
+    static char * alloc_frame(Packet& p, size_t size, uint8_t version);
+    static void   write_block_header(char * out, BlockType type, size_t size, uint8_t version);
+    /// Replace payload by its compressed form if smaller, true if it was
+    static bool compress_payload(std::string& payload);
+    static std::string make_block(BlockType type, const std::string& data, uint8_t version = v1);
+    static std::string make_block(BlockView b, uint8_t version = v1, size_t padding = 0);
+    static std::string make_id(Id id, uint8_t version);
+    static std::vector<BlockView> blocks(std::string_view, uint8_t version,
+                                         size_t alignment = 1);
+    /// Block starting at pos of the payload, pos is moved past it, false at the end
+    static bool next_block(std::string_view payload, size_t& pos, uint8_t version,
+                           size_t alignment, BlockView& b);
+    /// Supported alignment flags, 0 for any other alignment
+    static uint8_t alignment_flags(size_t alignment);
+    static size_t  alignment_of(uint8_t flags);
+    /// Bytes between a block header ending at offset of the frame and its data
+    static size_t  block_padding(size_t offset, BlockType type, size_t alignment);
+    template<typename T>
+    static const T * aligned_as(const char * p)
     {
-        return reinterpret_cast<const Header*>(data_.data());
+        static_assert(std::is_trivially_copyable_v<T>);
+        return reinterpret_cast<uintptr_t>(p) % alignof(T) ? nullptr
+                                                            : reinterpret_cast<const T*>(p);
     }
+    static std::string make_identification(const hdcp::Identification& id,
+                                           const std::string& capabilities, uint8_t& n_block);
+    static size_t parse_header(std::string_view);
+    static void parse_payload(std::string_view header, std::string_view payload);
+
+    const Header   * header()    const {return reinterpret_cast<const Header*>(data());}
+    const HeaderV2 * header_v2() const {return reinterpret_cast<const HeaderV2*>(data());}
+    size_t payload_size() const {return version() == v2 ? header_v2()->len : header()->len;}
+
+    using LargeBuffer = std::vector<char, AlignedAllocator<char, max_alignment>>;
 
-    std::array<char, max_size> data_;
+    alignas(max_alignment) std::array<char, max_size> data_;
+    LargeBuffer large_data_; // used instead of data_ by frames above max_size
 };
 
 } /* namespace hdcp */
@@ -16,6 +16,9 @@ std::string ErrorCategory::message(int e) const
     case Errc::invalid_packet_type:          return "invalid packet type";
     case Errc::invalid_number_of_block:      return "invalid number of blocks";
     case Errc::payload_exceed_max_size:      return "payload exceed max allowed size";
+    case Errc::invalid_header_flags:         return "unsupported header flags";
+    case Errc::invalid_compressed_payload:   return "invalid compressed payload";
+    case Errc::invalid_array_block:          return "invalid array block";
     default:                                 return "unknown error code";
     }
 }
@@ -14,6 +14,9 @@ enum class Errc {
     invalid_packet_type,
     invalid_number_of_block,
     payload_exceed_max_size,
+    invalid_header_flags,
+    invalid_compressed_payload,
+    invalid_array_block,
 };
 
 struct ErrorCategory: public std::error_category
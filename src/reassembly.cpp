@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstring>
+
+#include "reassembly.h"
+
+namespace hdcp {
+
+namespace {
+
+constexpr size_t max_pooled_buffers = 4;
+
+} /* namespace */
+
+void Reassembler::Message::Release::operator()(Buffer * b) const
+{
+    std::unique_ptr<Buffer> buffer(b);
+    if (auto p = pool.lock()) {
+        std::lock_guard<std::mutex> lk(p->mutex);
+        if (p->free.size() < max_pooled_buffers)
+            p->free.push_back(std::move(buffer));
+    }
+}
+
+Reassembler::Reassembler(std::chrono::milliseconds timeout, size_t max_size,
+                         size_t max_messages, size_t max_bytes):
+    timeout_(timeout), max_size_(std::min(max_size, max_bytes)),
+    max_messages_(std::max<size_t>(max_messages, 1)), max_bytes_(max_bytes),
+    pool_(std::make_shared<Pool>())
+{
+}
+
+Reassembler::Message Reassembler::acquire(Packet::BlockType type, size_t size)
+{
+    std::unique_ptr<Buffer> buffer;
+    {
+        std::lock_guard<std::mutex> lk(pool_->mutex);
+        if (!pool_->free.empty()) {
+            buffer = std::move(pool_->free.back());
+            pool_->free.pop_back();
+        }
+    }
+    if (!buffer)
+        buffer = std::make_unique<Buffer>();
+    // the capacity of a reused buffer is kept, only larger messages allocate, nothing is
+    // initialized as the fragments cover the whole message before it is returned
+    buffer->resize(size);
+
+    Message m;
+    m.type_   = type;
+    m.buffer_ = std::unique_ptr<Buffer, Message::Release>(buffer.release(),
+                                                          Message::Release{pool_});
+    return m;
+}
+
+std::optional<Reassembler::Message> Reassembler::add(const Packet::Fragment& fragment,
+                                                     Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (fragment.size > max_size_ || fragment.offset > fragment.size ||
+        fragment.data.size() > fragment.size - fragment.offset) {
+        stats_.rejected++;
+        return std::nullopt;
+    }
+
+    auto it = pending_.find(fragment.message);
+    if (it == pending_.end()) {
+        make_room(fragment.size);
+        Pending p;
+        p.message = acquire(fragment.type, fragment.size);
+        it = pending_.emplace(fragment.message, std::move(p)).first;
+        pending_bytes_ += fragment.size;
+    }
+    auto& p = it->second;
+    if (p.message.type_ != fragment.type || p.message.buffer_->size() != fragment.size) {
+        stats_.rejected++;
+        return std::nullopt;
+    }
+    p.last = now;
+    const uint32_t end = fragment.offset + fragment.data.size();
+    const size_t   added = cover(p.ranges, fragment.offset, end);
+    if (!added && fragment.size)
+        return std::nullopt;
+
+    std::memcpy(p.message.buffer_->data() + fragment.offset, fragment.data.data(),
+                fragment.data.size());
+    p.received += added;
+    if (p.received < fragment.size)
+        return std::nullopt;
+
+    pending_bytes_ -= fragment.size;
+    Message m = std::move(p.message);
+    pending_.erase(it);
+    stats_.completed++;
+    return m;
+}
+
+size_t Reassembler::cover(std::map<uint32_t, uint32_t>& ranges, uint32_t begin, uint32_t end)
+{
+    if (begin == end)
+        return 0;
+    // merge the range with those it overlaps or touches, what they covered is not new
+    auto it = ranges.upper_bound(begin);
+    if (it != ranges.begin() && std::prev(it)->second >= begin)
+        --it;
+    size_t covered = 0;
+    while (it != ranges.end() && it->first <= end) {
+        begin = std::min(begin, it->first);
+        end   = std::max(end, it->second);
+        covered += it->second - it->first;
+        it = ranges.erase(it);
+    }
+    ranges.emplace(begin, end);
+    return end - begin - covered;
+}
+
+void Reassembler::make_room(size_t size)
+{
+    while (!pending_.empty() &&
+           (pending_.size() >= max_messages_ || pending_bytes_ + size > max_bytes_)) {
+        auto oldest = std::min_element(pending_.begin(), pending_.end(),
+                                       [](auto& a, auto& b) {
+                                           return a.second.last < b.second.last;
+                                       });
+        stats_.evicted++;
+        pending_bytes_ -= oldest->second.message.buffer_->size();
+        pending_.erase(oldest);
+    }
+}
+
+void Reassembler::expire(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (now - it->second.last > timeout_) {
+            stats_.expired++;
+            pending_bytes_ -= it->second.message.buffer_->size();
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Reassembler::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    pending_.clear();
+    pending_bytes_ = 0;
+}
+
+ReassemblyStats Reassembler::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+}
+
+} /* namespace hdcp */
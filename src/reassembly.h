@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "packet.h"
+
+namespace hdcp {
+
+struct ReassemblyStats
+{
+    uint64_t completed;
+    uint64_t expired;  // incomplete when their timeout elapsed
+    uint64_t evicted;  // incomplete, dropped for a new message past the limits
+    uint64_t rejected; // fragments inconsistent with their message, or too large
+};
+
+/// Aligned allocator leaving the elements of a resized buffer uninitialized
+template<typename T, size_t A>
+struct UninitAllocator: AlignedAllocator<T, A>
+{
+    template<typename U> struct rebind {using other = UninitAllocator<U, A>;};
+
+    UninitAllocator() = default;
+    template<typename U> UninitAllocator(const UninitAllocator<U, A>&) {}
+
+    template<typename U> void construct(U * p) {::new(static_cast<void*>(p)) U;}
+    template<typename U, typename... Args> void construct(U * p, Args&&... args)
+    {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+/*
+ * Blocks received in fragments. Each message is written once, straight from the fragments,
+ * in a contiguous buffer taken from a pool: buffers of completed messages are reused by the
+ * next ones instead of being allocated again. The messages reassembled at the same time and
+ * their bytes are bounded, the one without fragment for the longest time makes room for a
+ * new one.
+ */
+class Reassembler
+{
+    using Buffer = std::vector<char, UninitAllocator<char, Packet::max_alignment>>;
+    struct Pool;
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// A reassembled block, its buffer goes back to the pool when the message is destroyed
+    class Message
+    {
+    public:
+        Packet::BlockView block() const
+        {
+            Packet::BlockView b;
+            b.type = type_;
+            b.data = std::string_view(buffer_->data(), buffer_->size());
+            return b;
+        }
+
+    private:
+        friend class Reassembler;
+        struct Release
+        {
+            std::weak_ptr<Pool> pool;
+            void operator()(Buffer * b) const;
+        };
+
+        Packet::BlockType                       type_;
+        std::unique_ptr<Buffer, Release>        buffer_;
+    };
+
+    explicit Reassembler(std::chrono::milliseconds timeout = reassembly_timeout,
+                         size_t max_size = max_message_size,
+                         size_t max_messages = max_reassembly_messages,
+                         size_t max_bytes = max_reassembly_bytes);
+
+    /// Write a fragment in its message, the message is returned once complete
+    std::optional<Message> add(const Packet::Fragment& fragment, Clock::time_point now);
+    /// Drop the messages without fragment for the timeout
+    void expire(Clock::time_point now);
+    void clear();
+    ReassemblyStats stats() const;
+
+private:
+    struct Pending
+    {
+        Message                      message;
+        size_t                       received = 0; // bytes covered by the fragments
+        std::map<uint32_t, uint32_t> ranges;       // covered, begin to end, not touching
+        Clock::time_point            last;
+    };
+    struct Pool
+    {
+        std::mutex                           mutex;
+        std::vector<std::unique_ptr<Buffer>> free;
+    };
+
+    std::chrono::milliseconds             timeout_;
+    size_t                                max_size_;
+    size_t                                max_messages_;
+    size_t                                max_bytes_;
+    std::shared_ptr<Pool>                 pool_;
+    mutable std::mutex                    mutex_;
+    std::unordered_map<uint32_t, Pending> pending_;
+    size_t                                pending_bytes_ = 0;
+    ReassemblyStats                       stats_ {};
+
+    Message acquire(Packet::BlockType type, size_t size);
+    /// Drop the oldest messages until one of size fits in the limits
+    void make_room(size_t size);
+    static size_t cover(std::map<uint32_t, uint32_t>& ranges, uint32_t begin, uint32_t end);
+};
+
+} /* namespace hdcp */
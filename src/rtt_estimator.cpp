@@ -0,0 +1,64 @@
+#include <algorithm>
+
+#include "rtt_estimator.h"
+
+namespace hdcp {
+
+RttEstimator::RttEstimator(std::chrono::milliseconds initial_rto,
+                           std::chrono::milliseconds min_rto,
+                           std::chrono::milliseconds max_rto,
+                           std::chrono::milliseconds granularity):
+    initial_rto_(initial_rto), min_rto_(min_rto), max_rto_(max_rto), granularity_(granularity)
+{
+    reset();
+}
+
+void RttEstimator::add_sample(std::chrono::microseconds rtt)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (samples_ == 0) {
+        srtt_   = rtt;
+        rttvar_ = rtt / 2;
+    } else {
+        // alpha = 1/8, beta = 1/4
+        auto err = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+        rttvar_  = (3 * rttvar_ + err) / 4;
+        srtt_    = (7 * srtt_ + rtt) / 8;
+    }
+    last_ = rtt;
+    samples_++;
+    rto_ = std::clamp(srtt_ + std::max<std::chrono::microseconds>(granularity_, 4 * rttvar_),
+                      min_rto_, max_rto_);
+}
+
+void RttEstimator::reset()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    srtt_    = std::chrono::microseconds::zero();
+    rttvar_  = std::chrono::microseconds::zero();
+    last_    = std::chrono::microseconds::zero();
+    rto_     = initial_rto_;
+    samples_ = 0;
+}
+
+std::chrono::microseconds RttEstimator::rto() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return rto_;
+}
+
+std::chrono::microseconds RttEstimator::backoff(std::chrono::microseconds timeout,
+                                                uint retry) const
+{
+    for (uint i = 0; i < retry && timeout < max_rto_; i++)
+        timeout *= 2;
+    return std::min(timeout, max_rto_);
+}
+
+RttStats RttEstimator::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return {srtt_, rttvar_, last_, rto_, samples_};
+}
+
+} /* namespace hdcp */
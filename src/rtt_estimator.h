@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+namespace hdcp {
+
+struct RttStats
+{
+    std::chrono::microseconds srtt;    // smoothed round-trip time
+    std::chrono::microseconds rttvar;  // round-trip time variation
+    std::chrono::microseconds last;    // last sample
+    std::chrono::microseconds rto;     // current retransmission timeout
+    uint64_t                  samples;
+};
+
+/*
+ * Smoothed RTT and retransmission timeout estimator (RFC 6298)
+ */
+class RttEstimator
+{
+public:
+    RttEstimator(std::chrono::milliseconds initial_rto,
+                 std::chrono::milliseconds min_rto,
+                 std::chrono::milliseconds max_rto,
+                 std::chrono::milliseconds granularity);
+
+    void add_sample(std::chrono::microseconds rtt);
+    void reset();
+
+    std::chrono::microseconds rto() const;
+    /// Exponential backoff of a timeout for a given number of retries
+    std::chrono::microseconds backoff(std::chrono::microseconds timeout, uint retry) const;
+    RttStats stats() const;
+
+private:
+    const std::chrono::microseconds initial_rto_;
+    const std::chrono::microseconds min_rto_;
+    const std::chrono::microseconds max_rto_;
+    const std::chrono::microseconds granularity_;
+
+    mutable std::mutex        mutex_;
+    std::chrono::microseconds srtt_;
+    std::chrono::microseconds rttvar_;
+    std::chrono::microseconds last_;
+    std::chrono::microseconds rto_;
+    uint64_t                  samples_;
+};
+
+} /* namespace hdcp */
@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "sequence.h"
+
+namespace hdcp {
+
+void SequenceTracker::reset(Packet::Id id, uint8_t version)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::fill(seen_.begin(), seen_.end(), false);
+    version_ = version;
+    last_    = id;
+    mark(id, true);
+}
+
+void SequenceTracker::set_version(uint8_t version)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    version_ = version;
+}
+
+SequenceTracker::Result SequenceTracker::update(Packet::Id id)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    const Packet::Id mask = Packet::id_mask(version_);
+    const Packet::Id expected = (last_ + 1) & mask;
+    stats_.received++;
+
+    auto delta = Packet::id_delta(id, expected, version_);
+    if (delta >= 0) {
+        // forget the skipped ids, they may come back late
+        if (static_cast<size_t>(delta) >= seen_.size()) {
+            std::fill(seen_.begin(), seen_.end(), false);
+        } else {
+            for (Packet::Id i = expected; i != id; i = (i + 1) & mask)
+                mark(i, false);
+        }
+        mark(id, true);
+        last_ = id;
+        stats_.lost += delta;
+        return {delta ? Status::gap : Status::in_order, expected};
+    }
+
+    auto age = static_cast<size_t>(Packet::id_delta(last_, id, version_));
+    if (age < seen_.size() && !seen(id)) {
+        mark(id, true);
+        if (stats_.lost)
+            stats_.lost--;
+        stats_.reordered++;
+        return {Status::late, expected};
+    }
+    stats_.duplicated++;
+    return {Status::duplicate, expected};
+}
+
+Packet::Id SequenceTracker::last() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return last_;
+}
+
+SequenceStats SequenceTracker::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+}
+
+} /* namespace hdcp */
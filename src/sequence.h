@@ -0,0 +1,57 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "packet.h"
+
+namespace hdcp {
+
+struct SequenceStats
+{
+    uint64_t received;
+    uint64_t lost;       // skipped ids not received since
+    uint64_t reordered;  // skipped ids received late
+    uint64_t duplicated;
+};
+
+/*
+ * Received packet ids of one direction. Ids skipped by a jump are counted as lost until they
+ * show up, the last window ids are remembered to tell a late packet from a duplicate.
+ */
+class SequenceTracker
+{
+public:
+    enum class Status {
+        in_order,
+        gap,       // some ids were skipped
+        late,      // a skipped id
+        duplicate, // an id already received, or too old to know
+    };
+    struct Result
+    {
+        Status     status;
+        Packet::Id expected;
+    };
+
+    explicit SequenceTracker(size_t window = sequence_window): seen_(window) {}
+
+    /// Restart the sequence after id, typically the hip or dip
+    void reset(Packet::Id id, uint8_t version = Packet::v1);
+    void set_version(uint8_t version);
+    Result update(Packet::Id id);
+    Packet::Id last() const;
+    SequenceStats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<bool>  seen_;
+    Packet::Id         last_    = 0;
+    uint8_t            version_ = Packet::v1;
+    SequenceStats      stats_ {};
+
+    bool seen(Packet::Id id) const {return seen_[id % seen_.size()];}
+    void mark(Packet::Id id, bool seen) {seen_[id % seen_.size()] = seen;}
+};
+
+} /* namespace hdcp */
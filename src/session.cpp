@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "session.h"
+
+namespace hdcp {
+
+namespace {
+
+struct Entry
+{
+    Capabilities::Id id;
+    uint16_t         len;
+}__attribute__((packed));
+
+void add_entry(std::string& data, Capabilities::Id id, uint32_t value)
+{
+    Entry e {id, sizeof(value)};
+    data.append(reinterpret_cast<const char*>(&e), sizeof(e));
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} /* namespace */
+
+std::string Capabilities::encode() const
+{
+    std::string data;
+    add_entry(data, Id::features, features);
+    add_entry(data, Id::max_frame_size, max_frame_size);
+    add_entry(data, Id::checksums, checksums);
+    add_entry(data, Id::codecs, codecs);
+    add_entry(data, Id::window, window);
+    add_entry(data, Id::alignment, alignment);
+    return data;
+}
+
+Capabilities Capabilities::decode(std::string_view data)
+{
+    Capabilities c;
+    auto it = data.begin();
+    while (it + sizeof(Entry) <= data.end()) {
+        const Entry * e = reinterpret_cast<const Entry*>(it);
+        it += sizeof(Entry);
+        if (e->len > static_cast<size_t>(data.end() - it))
+            break;
+        std::string_view value(it, e->len);
+        it += e->len;
+        // unknown ids, or known ones with an unexpected size, come from a newer peer
+        if (value.size() != sizeof(uint32_t))
+            continue;
+        uint32_t v = *reinterpret_cast<const uint32_t*>(value.data());
+        switch (e->id) {
+        case Id::features:       c.features       = v; break;
+        case Id::max_frame_size: c.max_frame_size = v; break;
+        case Id::checksums:      c.checksums      = v; break;
+        case Id::codecs:         c.codecs         = v; break;
+        case Id::window:         c.window         = v; break;
+        case Id::alignment:      c.alignment      = v; break;
+        default: break;
+        }
+    }
+    return c;
+}
+
+Capabilities Capabilities::agree(const Capabilities& other) const
+{
+    Capabilities c;
+    c.features       = features & other.features;
+    c.max_frame_size = std::min(max_frame_size, other.max_frame_size);
+    c.checksums      = checksums & other.checksums;
+    c.codecs         = codecs & other.codecs;
+    c.window         = std::min(window, other.window);
+    c.alignment      = std::min(alignment, other.alignment);
+    // large frames need the v2 header and a size above the v1 one
+    if (!(c.features & Feature::extended_id) || c.max_frame_size <= Packet::max_size)
+        c.features &= ~Feature::large_frames;
+    if (!(c.features & Feature::large_frames))
+        c.max_frame_size = Packet::max_size;
+    // the retransmission ring is bounded in bytes, whatever the frame size
+    c.window = std::min<uint32_t>(c.window,
+                                  std::max<size_t>(data_ring_bytes / c.max_frame_size, 1));
+    // fletcher16 is the fallback every peer implements
+    c.checksums |= checksum_bit(Packet::Checksum::fletcher16);
+    return c;
+}
+
+Session::Session(const Capabilities& agreed):
+    version(agreed.features & Feature::extended_id ? Packet::v2 : Packet::v1),
+    features(agreed.features),
+    max_frame_size(std::clamp<size_t>(agreed.max_frame_size, Packet::max_size,
+                                      Packet::max_frame_size)),
+    checksums(agreed.checksums),
+    codecs(agreed.codecs),
+    window(agreed.window)
+{
+    if (version != Packet::v2)
+        return;
+    // padding only exists in the v2 header, to the largest supported alignment asked for
+    for (size_t a = Packet::max_alignment; a >= 8; a /= 2) {
+        if (agreed.alignment >= a) {
+            alignment = a;
+            break;
+        }
+    }
+    for (auto c: {Packet::Checksum::none, Packet::Checksum::crc32c}) {
+        if (checksums & checksum_bit(c)) {
+            checksum = c;
+            break;
+        }
+    }
+}
+
+bool Session::accepts(const Packet& p) const
+{
+    // v1 packets are always checked with fletcher16
+    return p.version() == Packet::v1 || checksums & checksum_bit(p.checksum());
+}
+
+} /* namespace hdcp */
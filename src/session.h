@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "application.h"
+#include "packet.h"
+
+namespace hdcp {
+
+/// Payload checksums of the packets, a bitmask of checksum_bit() when advertised
+using Checksums = uint32_t;
+constexpr Checksums checksum_bit(Packet::Checksum c) {return 1u << static_cast<uint8_t>(c);}
+/// Checksum::none is left out, only links known to be reliable should advertise it
+constexpr Checksums default_checksums = checksum_bit(Packet::Checksum::fletcher16) |
+                                        checksum_bit(Packet::Checksum::crc32c);
+
+/// Payload codecs, a bitmask when advertised, none is always supported
+using Codecs = uint32_t;
+enum Codec: Codecs {
+    lz = 1 << 0, // data packets, see lz.h
+};
+
+/*
+ * What one end is able, or asks, to use. Exchanged in the capabilities block of the hip and
+ * dip as a list of {id, length, value} entries, entries unknown to the reader are skipped so
+ * that new capabilities do not break older peers.
+ */
+struct Capabilities
+{
+    enum class Id: uint16_t {
+        features       = 0x0001,
+        max_frame_size = 0x0002,
+        checksums      = 0x0003,
+        codecs         = 0x0004,
+        window         = 0x0005,
+        alignment      = 0x0006,
+    };
+
+    Features  features       = 0;
+    uint32_t  max_frame_size = Packet::max_size;
+    Checksums checksums      = checksum_bit(Packet::Checksum::fletcher16);
+    Codecs    codecs         = 0;
+    uint32_t  window         = data_ring_size; // data packets kept for retransmission
+    uint32_t  alignment      = 1;              // of the data blocks, see Packet::make_data
+
+    std::string encode() const;
+    static Capabilities decode(std::string_view data);
+    /// What both ends support, the dip carries the result computed by the slave
+    Capabilities agree(const Capabilities& other) const;
+};
+
+/// Parameters agreed at handshake, back to the defaults at each connection
+struct Session
+{
+    uint8_t   version        = Packet::v1;
+    Features  features       = 0;
+    size_t    max_frame_size = Packet::max_size;
+    Checksums checksums      = checksum_bit(Packet::Checksum::fletcher16);
+    Codecs    codecs         = 0;
+    size_t    window         = data_ring_size;
+    /// Of the block data in v2 data packets, 1 when they are not padded
+    size_t    alignment      = 1;
+    /// Cheapest agreed checksum, used for the payloads of v2 packets
+    Packet::Checksum checksum = Packet::Checksum::fletcher16;
+
+    Session() = default;
+    explicit Session(const Capabilities& agreed);
+
+    /// False for a v2 packet checked with a checksum not agreed, none included, its payload
+    /// integrity is then not guaranteed on this link
+    bool accepts(const Packet& p) const;
+
+    friend std::ostream& operator<<(std::ostream& os, const Session& s)
+    {
+        return os << fmt::format("session: version {}, features {:#x}, max frame {}, "
+                                 "checksum {}, codecs {:#x}, window {}, alignment {}",
+                                 s.version, s.features, s.max_frame_size,
+                                 static_cast<int>(s.checksum), s.codecs, s.window,
+                                 s.alignment);
+    }
+};
+
+} /* namespace hdcp */
@@ -0,0 +1,363 @@
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstring>
+#include <system_error>
+
+#include "shm.h"
+
+namespace hdcp {
+namespace transport {
+namespace shm {
+
+/*
+ * Records are a 32 bit frame size followed by the frame, 8 byte aligned. A frame never wraps
+ * around: the end of the ring is skipped with a padding record instead.
+ */
+struct Ring
+{
+    alignas(64) std::atomic<uint64_t> head;          // bytes written, by the producer
+    std::atomic<uint64_t>             written;       // records
+    alignas(64) std::atomic<uint64_t> tail;          // bytes released, by the consumer
+    std::atomic<uint64_t>             read;          // records
+    // futex words, bumped at each publish (data) or release (space)
+    alignas(64) std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t>             data_waiting;
+    alignas(64) std::atomic<uint32_t> space_seq;
+    std::atomic<uint32_t>             space_waiting;
+};
+
+struct Segment
+{
+    std::atomic<uint32_t> magic;
+    uint32_t              version;
+    uint64_t              capacity;
+    std::atomic<uint32_t> open[2];
+    Ring                  rings[2];
+};
+
+namespace {
+
+constexpr uint32_t segment_magic   = 0x68646370;
+constexpr uint32_t segment_version = 1;
+constexpr uint32_t padding_record  = 0xffffffff;
+constexpr size_t   record_header   = sizeof(uint32_t);
+constexpr size_t   record_align    = 8;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+              std::atomic<uint64_t>::is_always_lock_free, "atomics must be address free");
+
+size_t record_size(size_t frame) {return (record_header + frame + record_align - 1) &
+                                         ~(record_align - 1);}
+size_t data_offset() {return (sizeof(Segment) + 63) & ~size_t(63);}
+
+uint64_t ring_capacity(size_t requested)
+{
+    uint64_t c = 1;
+    while (c < std::max(requested, record_size(Packet::max_frame_size)))
+        c <<= 1;
+    return c;
+}
+
+void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+long futex(std::atomic<uint32_t>& word, int op, uint32_t val, const timespec * ts)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, val, ts, nullptr, 0);
+}
+
+std::system_error system_error(const std::string& what)
+{
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+} /* namespace */
+
+Endpoint::Endpoint(common::Logger logger, const std::string& name, Role role,
+                   const Options& opts):
+    Log(logger), name_(name), role_(role), opts_(opts), side_(role == Role::owner ? 0 : 1)
+{
+    int fd;
+    if (role_ == Role::owner) {
+        // a segment left by a crashed owner is replaced
+        ::shm_unlink(name_.c_str());
+        fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    } else {
+        fd = ::shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0);
+    }
+    if (fd < 0)
+        throw system_error(name_);
+    try {
+        map(fd, role_ == Role::owner);
+    } catch (...) {
+        ::close(fd);
+        if (role_ == Role::owner)
+            ::shm_unlink(name_.c_str());
+        throw;
+    }
+    // the mapping keeps the segment
+    ::close(fd);
+
+    tx_      = &segment_->rings[side_];
+    rx_      = &segment_->rings[!side_];
+    auto base = reinterpret_cast<char*>(segment_) + data_offset();
+    tx_data_ = base + side_ * capacity_;
+    rx_data_ = base + !side_ * capacity_;
+}
+
+Endpoint::~Endpoint()
+{
+    stop();
+    ::munmap(segment_, map_size_);
+    if (role_ == Role::owner)
+        ::shm_unlink(name_.c_str());
+}
+
+void Endpoint::map(int fd, bool create)
+{
+    if (create) {
+        capacity_ = ring_capacity(opts_.capacity);
+        map_size_ = data_offset() + 2 * capacity_;
+        if (::ftruncate(fd, map_size_) < 0)
+            throw system_error(name_);
+    } else {
+        struct stat st;
+        if (::fstat(fd, &st) < 0)
+            throw system_error(name_);
+        map_size_ = st.st_size;
+        if (map_size_ < data_offset())
+            throw std::system_error(EPROTO, std::generic_category(), name_);
+    }
+
+    void * p = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        throw system_error(name_);
+    segment_ = static_cast<Segment*>(p);
+
+    if (create) {
+        // the pages are zeroed, which is the initial state of every counter
+        segment_->version  = segment_version;
+        segment_->capacity = capacity_;
+        segment_->magic.store(segment_magic, std::memory_order_release);
+        return;
+    }
+    capacity_ = segment_->capacity;
+    if (segment_->magic.load(std::memory_order_acquire) != segment_magic ||
+        segment_->version != segment_version || data_offset() + 2 * capacity_ != map_size_) {
+        ::munmap(p, map_size_);
+        throw std::system_error(EPROTO, std::generic_category(), name_);
+    }
+}
+
+void Endpoint::start()
+{
+    log_debug(logger_, "starting transport...");
+    open();
+    log_debug(logger_, "transport started");
+}
+
+void Endpoint::stop()
+{
+    if (!segment_->open[side_])
+        return;
+    log_debug(logger_, "stopping transport...");
+    close();
+    log_debug(logger_, "transport stopped");
+}
+
+bool Endpoint::is_open()
+{
+    return segment_->open[side_] && segment_->open[!side_];
+}
+
+void Endpoint::open()
+{
+    segment_->open[side_] = 1;
+}
+
+void Endpoint::close()
+{
+    segment_->open[side_] = 0;
+    // a sleeping peer sees the closing at once
+    wake(tx_->data_seq, tx_->data_waiting);
+    wake(rx_->space_seq, rx_->space_waiting);
+}
+
+template<typename F>
+bool Endpoint::wait(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, F&& ready,
+                    Clock::time_point deadline)
+{
+    const auto spin_end = Clock::now() + opts_.busy_poll;
+    while (!ready()) {
+        const auto now = Clock::now();
+        if (now >= deadline || !is_open())
+            return false;
+        if (now < spin_end) {
+            cpu_relax();
+            continue;
+        }
+        // a publish after the load changes seq, the futex then returns at once
+        const uint32_t s = seq.load();
+        waiting.fetch_add(1);
+        if (!ready()) {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+            timespec ts = {static_cast<time_t>(left.count() / 1000000000),
+                           static_cast<long>(left.count() % 1000000000)};
+            futex(seq, FUTEX_WAIT, s, &ts);
+        }
+        waiting.fetch_sub(1);
+    }
+    return true;
+}
+
+void Endpoint::wake(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting)
+{
+    seq.fetch_add(1);
+    if (waiting.load())
+        futex(seq, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+bool Endpoint::wait_space(uint64_t size, Clock::time_point deadline)
+{
+    const uint64_t head = tx_->head.load(std::memory_order_relaxed);
+    return wait(tx_->space_seq, tx_->space_waiting, [&] {
+        return capacity_ - (head - tx_->tail.load(std::memory_order_acquire)) >= size;
+    }, deadline);
+}
+
+void Endpoint::publish(uint64_t head)
+{
+    tx_->head.store(head, std::memory_order_release);
+    wake(tx_->data_seq, tx_->data_waiting);
+}
+
+void Endpoint::write(Packet&& p, Priority)
+{
+    if (!is_open())
+        throw transport_error(Errc::write_while_closed);
+
+    std::lock_guard<std::mutex> lk(write_mutex_);
+    const auto     deadline = Clock::now() + time_base_ms;
+    const uint64_t record   = record_size(p.size());
+    uint64_t       head     = tx_->head.load(std::memory_order_relaxed);
+    uint64_t       pos      = head & (capacity_ - 1);
+
+    // a frame is contiguous for the reader to take it in one copy
+    auto full = [this] {
+        return transport_error(is_open() ? Errc::write_queue_full : Errc::write_while_closed);
+    };
+    if (capacity_ - pos < record) {
+        if (!wait_space(capacity_ - pos, deadline))
+            throw full();
+        std::memcpy(tx_data_ + pos, &padding_record, sizeof(padding_record));
+        head += capacity_ - pos;
+        pos   = 0;
+        publish(head);
+    }
+    if (!wait_space(record, deadline))
+        throw full();
+
+    const uint32_t size = p.size();
+    std::memcpy(tx_data_ + pos, &size, sizeof(size));
+    std::memcpy(tx_data_ + pos + record_header, p.data(), size);
+    tx_->written.fetch_add(1, std::memory_order_relaxed);
+    publish(head + record);
+}
+
+bool Endpoint::next_record(uint64_t tail, uint64_t head, uint32_t& size, uint64_t& next) const
+{
+    // the other process may be faulty: a record must lie in the ring and in what it published
+    const uint64_t pos = tail & (capacity_ - 1);
+    std::memcpy(&size, rx_data_ + pos, sizeof(size));
+    if (size == padding_record)
+        next = tail + capacity_ - pos;
+    else if (record_header + uint64_t(size) <= capacity_ - pos)
+        next = tail + record_size(size);
+    else
+        return false;
+    return next <= head;
+}
+
+void Endpoint::corrupted(uint64_t tail)
+{
+    errc_ = std::error_code(EPROTO, std::generic_category());
+    log_error(logger_, "invalid record at {} of the ring, closing", tail);
+    close();
+}
+
+bool Endpoint::read(Packet& p)
+{
+    const auto deadline = Clock::now() + time_base_ms;
+    for (;;) {
+        const uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+        uint64_t       head = tail;
+        if (!wait(rx_->data_seq, rx_->data_waiting, [&] {
+                head = rx_->head.load(std::memory_order_acquire);
+                return head != tail;
+            }, deadline))
+            return false;
+
+        uint32_t size;
+        uint64_t next;
+        if (!next_record(tail, head, size, next)) {
+            corrupted(tail);
+            return false;
+        }
+        if (size == padding_record) {
+            rx_->tail.store(next, std::memory_order_release);
+            continue;
+        }
+
+        bool valid = true;
+        try {
+            const uint64_t pos = tail & (capacity_ - 1);
+            p = Packet(std::string_view(rx_data_ + pos + record_header, size));
+        } catch (packet_error& e) {
+            log_warn(logger_, e.what());
+            valid = false;
+        }
+        rx_->read.fetch_add(1, std::memory_order_relaxed);
+        rx_->tail.store(next, std::memory_order_release);
+        wake(rx_->space_seq, rx_->space_waiting);
+        if (valid)
+            return true;
+    }
+}
+
+size_t Endpoint::read_queue_size() const
+{
+    return rx_->written.load(std::memory_order_relaxed) - rx_->read.load(std::memory_order_relaxed);
+}
+
+void Endpoint::clear_queues()
+{
+    const uint64_t head = rx_->head.load(std::memory_order_acquire);
+    uint64_t       tail = rx_->tail.load(std::memory_order_relaxed);
+    while (tail != head) {
+        uint32_t size;
+        uint64_t next;
+        if (!next_record(tail, head, size, next)) {
+            corrupted(tail);
+            break;
+        }
+        if (size != padding_record)
+            rx_->read.fetch_add(1, std::memory_order_relaxed);
+        tail = next;
+    }
+    rx_->tail.store(tail, std::memory_order_release);
+    wake(rx_->space_seq, rx_->space_waiting);
+}
+
+} /* namespace shm */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <mutex>
+
+#include "common/log.h"
+
+#include "transport.h"
+
+namespace hdcp {
+namespace transport {
+namespace shm {
+
+struct Options
+{
+    size_t                    capacity = 4 << 20; // bytes of each ring, at least a large frame
+    std::chrono::microseconds busy_poll {0};      // spin before sleeping, with a core per end
+};
+
+struct Segment;
+struct Ring;
+
+/*
+ * Transport between two processes of one host over a pair of single producer, single
+ * consumer rings in a POSIX shared memory segment. A frame is copied in the ring by the writer
+ * and out of it by the reader, straight into the packet, without a queue or a socket buffer in
+ * between; a futex wakes the other end only when it sleeps. A record inconsistent with the
+ * ring closes the connection. The owner creates and removes the segment, the other end
+ * attaches to it by name.
+ */
+class Endpoint: public common::Log, public Transport
+{
+public:
+    enum class Role {
+        owner,
+        attach,
+    };
+
+    /// Throws std::system_error if the segment cannot be created or mapped, attaching
+    /// requires the owner to be started
+    Endpoint(common::Logger logger, const std::string& name, Role role,
+             const Options& opts = {});
+    ~Endpoint();
+
+    using Transport::write;
+    /// Writes are not queued, a full ring holds the writer back for up to a time base
+    void   write(Packet&& p, Priority prio) override;
+    bool   read(Packet& p) override;
+    size_t read_queue_size() const override;
+    void   clear_queues() override;
+    void   start()   override;
+    void   stop()    override;
+    bool   is_open() override;
+    void   open()    override;
+    void   close()   override;
+    size_t max_frame_size() const override {return Packet::max_frame_size;}
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string name_;
+    Role        role_;
+    Options     opts_;
+    size_t      side_;      // 0 for the owner, writing ring 0
+    Segment   * segment_   = nullptr;
+    size_t      map_size_  = 0;
+    uint64_t    capacity_  = 0;
+    Ring      * tx_        = nullptr;
+    Ring      * rx_        = nullptr;
+    char      * tx_data_   = nullptr;
+    char      * rx_data_   = nullptr;
+    std::mutex  write_mutex_; // the threads of this process share the producer side
+
+    void map(int fd, bool create);
+    template<typename F>
+    bool wait(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, F&& ready,
+              Clock::time_point deadline);
+    void wake(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting);
+    bool wait_space(uint64_t size, Clock::time_point deadline);
+    void publish(uint64_t head);
+    bool next_record(uint64_t tail, uint64_t head, uint32_t& size, uint64_t& next) const;
+    void corrupted(uint64_t tail);
+};
+
+} /* namespace shm */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -10,8 +10,18 @@ Slave::Slave(common::Logger logger, const Identification& id,
     statemachine_("com_slave", states_, State::init),
     transport_(std::move(transport)),
     request_manager_(logger, transport_.get(), std::bind(&Slave::timeout_cb, this)),
+    dispatcher_(logger,
+                std::bind(&Slave::process_command, this,
+                          std::placeholders::_1, std::placeholders::_2),
+                std::bind(&Slave::complete_command, this, std::placeholders::_1,
+                          std::placeholders::_2, std::placeholders::_3, std::placeholders::_4)),
     slave_id_(id)
 {
+    supported_.features       = supported_features;
+    supported_.max_frame_size = transport_->max_frame_size();
+    supported_.checksums      = default_checksums;
+    supported_.codecs         = Codec::lz;
+    supported_.alignment      = Packet::max_alignment;
     statemachine_.set_transition_handler(
         [this] (const common::Statemachine<State>::State * p,
                 const common::Statemachine<State>::State * c)
@@ -36,6 +46,8 @@ void Slave::start()
     log_debug(logger_, "starting application...");
     transport_->start();
     statemachine_.reinit();
+    if (dispatcher_options_.workers)
+        dispatcher_.start(dispatcher_options_.workers, dispatcher_options_.max_in_flight);
     common::Thread::start(true);
     log_debug(logger_, "application started");
 }
@@ -48,25 +60,26 @@ void Slave::stop()
     common::Thread::stop();
     if (joinable())
         join();
+    dispatcher_.stop();
     request_manager_.stop();
     transport_->stop();
     log_debug(logger_, "application stopped");
 }
 
-void Slave::send_data(std::vector<Packet::BlockView>& blocks)
+void Slave::send_data(std::vector<Packet::BlockView>& blocks, uint16_t channel)
 {
     if (state() != State::connected)
         throw application_error(Errc::write_while_disconnected);
 
-    request_manager_.send_data(blocks);
+    request_manager_.send_data(blocks, channel);
 }
 
-void Slave::send_data(std::vector<Packet::Block>& blocks)
+void Slave::send_data(std::vector<Packet::Block>& blocks, uint16_t channel)
 {
     if (state() != State::connected)
         throw application_error(Errc::write_while_disconnected);
 
-    request_manager_.send_data(blocks);
+    request_manager_.send_data(blocks, channel);
 }
 
 common::transition_status Slave::handler_state_init()
@@ -81,8 +94,14 @@ common::transition_status Slave::handler_state_init()
 common::transition_status Slave::handler_state_disconnected()
 {
     if (statemachine_.nb_loop_in_current_state() == 1) {
+        dispatcher_.clear();
+        parked_cmds_.clear();
+        cmd_cache_.clear();
+        reassembler_.clear();
         request_manager_.stop();
         transport_->clear_queues();
+        session_ = Session();
+        transport_->set_session(session_);
     }
 
     Packet p;
@@ -94,7 +113,7 @@ common::transition_status Slave::handler_state_disconnected()
     case Packet::Type::hip:
         if (p.id() != 1)
             log_warn(logger_, "hip id should be 0");
-        received_packet_id_ = p.id();
+        rx_sequence_.reset(p.id());
         set_master_id(p);
         evt_mngr_.notify(Event::hip_received);
         break;
@@ -110,20 +129,33 @@ common::transition_status Slave::handler_state_connecting()
 {
     if (statemachine_.nb_loop_in_current_state() == 1) {
         request_manager_.start();
-        request_manager_.send_dip(slave_id_);
-        request_manager_.start_keepalive_management(keepalive_timeout);
+        request_manager_.send_dip(slave_id_,
+                                  session_.features ? agreed_.encode() : std::string());
+        // the dip is the last v1 packet, both ends switch right after it
+        request_manager_.set_session(session_);
+        transport_->set_session(session_);
+        request_manager_.start_keepalive_management(keepalive_timeout,
+                                                    session_.features & Feature::passive_keepalive);
+        request_manager_.set_cmd_batching(session_.features & Feature::cmd_batching);
+        request_manager_.set_data_retransmission(session_.features & Feature::reliable_data ?
+                                                 session_.window : 0);
     }
 
     Packet p;
     if (!transport_->read(p))
         return common::transition_status::stay_curr_state;
 
-    log_trace(logger_, "{}", p);
-    if (++received_packet_id_ != p.id()) {
-        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), received_packet_id_);
-        received_packet_id_ = p.id();
+    if (!session_.accepts(p)) {
+        log_warn(logger_, "packet {} dropped: checksum {} not agreed", p.id(),
+                 static_cast<int>(p.checksum()));
+        return common::transition_status::stay_curr_state;
     }
 
+    log_trace(logger_, "{}", p);
+    auto seq = rx_sequence_.update(p.id());
+    if (seq.status == SequenceTracker::Status::gap)
+        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), seq.expected);
+
     switch (p.type()) {
     case Packet::Type::ka:
         request_manager_.keepalive();
@@ -139,50 +171,123 @@ common::transition_status Slave::handler_state_connecting()
 
 common::transition_status Slave::handler_state_connected()
 {
+    // the commands wait for room in the dispatcher, the other packets are processed meanwhile
+    dispatch_parked();
+    reassembler_.expire(Reassembler::Clock::now());
+    bulk_.expire(slave::BulkReceiver::Clock::now());
     Packet p;
     if (!transport_->read(p))
         return common::transition_status::stay_curr_state;
 
+    if (!session_.accepts(p)) {
+        log_warn(logger_, "packet {} dropped: checksum {} not agreed", p.id(),
+                 static_cast<int>(p.checksum()));
+        return common::transition_status::stay_curr_state;
+    }
+
     log_trace(logger_, "{}", p);
-    if (++received_packet_id_ != p.id()) {
-        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), received_packet_id_);
-        received_packet_id_ = p.id();
+    auto seq = rx_sequence_.update(p.id());
+    if (seq.status == SequenceTracker::Status::gap) {
+        log_warn(logger_, "packet loss: received {}, expected {}", p.id(), seq.expected);
+        // a range ack must not cover lost packets
+        request_manager_.flush_cmd_acks();
     }
 
+    // any valid packet proves the master is alive
+    const bool passive_keepalive = session_.features & Feature::passive_keepalive;
+    if (passive_keepalive)
+        request_manager_.refresh_keepalive();
+
     switch (p.type()) {
     case Packet::Type::hip:
         master_id_ = Identification();
+        rx_sequence_.reset(p.id());
+        set_master_id(p);
+        dispatcher_.clear();
+        parked_cmds_.clear();
+        cmd_cache_.clear();
+        reassembler_.clear();
         request_manager_.stop_keepalive_management();
         request_manager_.stop();
         evt_mngr_.notify(Event::hip_received);
         break;
     case Packet::Type::cmd:
     {
-        request_manager_.keepalive();
-        request_manager_.send_cmd_ack(p);
+        // the cmd ack is enough to prove liveness in passive mode
+        if (!passive_keepalive)
+            request_manager_.keepalive();
         auto blocks = p.blocks();
-        if (blocks.size() != 1) {
+        const bool valid = blocks.size() == 1 || (session_.features & Feature::cmd_batching);
+        if (!valid)
             log_warn(logger_, "you should receive exactly one block in cmds (received {})",
                      blocks.size());
+        if (valid) {
+            // a retransmitted command is answered without running it again
+            std::vector<std::string> responses;
+            auto lookup = cmd_cache_.lookup(p, responses);
+            if (lookup == slave::CommandCache::Lookup::pending)
+                break;
+            if (lookup == slave::CommandCache::Lookup::hit) {
+                log_debug(logger_, "command {} already executed", p.id());
+                ack_command(p, responses, false);
+                break;
+            }
+        }
+        if (dispatcher_.is_running()) {
+            if (parked_cmds_.empty() && dispatcher_.available()) {
+                dispatch_command(std::move(p));
+            } else if (parked_cmds_.size() < dispatcher_options_.max_in_flight) {
+                parked_cmds_.push_back(std::move(p));
+            } else {
+                // dropped as a lost packet: the acks pending go first, its retry runs it
+                log_warn(logger_, "command {} refused: {} commands waiting", p.id(),
+                         parked_cmds_.size());
+                cmd_cache_.forget(p);
+                request_manager_.flush_cmd_acks();
+            }
             break;
         }
-        try {
-            if (cmd_cb_)
-                cmd_cb_(blocks[0]);
-        } catch (std::exception& e) {
-            log_error(logger_, "failed to process command {}", p.id());
+        if (!valid) {
+            request_manager_.ack_command(p);
+            break;
         }
+        std::vector<std::string> responses;
+        if (!(session_.features & Feature::cmd_response)) {
+            request_manager_.ack_command(p);
+            for (auto& b: blocks)
+                responses.push_back(process_command(p, b));
+            cmd_cache_.complete(p, responses);
+            break;
+        }
+        // the ack waits for the responses
+        for (auto& b: blocks)
+            responses.push_back(process_command(p, b));
+        cmd_cache_.complete(p, responses);
+        ack_command(p, responses, true);
         break;
     }
     case Packet::Type::ka:
         request_manager_.keepalive();
         break;
+    case Packet::Type::nack:
+        request_manager_.retransmit(p);
+        break;
+    case Packet::Type::bulk:
+        if (session_.features & Feature::bulk_transfer) {
+            receive_bulk(p);
+            break;
+        }
+        [[fallthrough]];
     default:
         log_warn(logger_,
                  "you should not receive this packet type ({:#x}) while connected", p.type());
         break;
     }
 
+    // ack every command received so far once there is nothing more to process
+    if (transport_->read_queue_size() == 0)
+        request_manager_.flush_cmd_acks();
+
     return common::transition_status::stay_curr_state;
 }
 
@@ -239,6 +344,8 @@ void Slave::run()
 
 void Slave::set_master_id(const Packet& p)
 {
+    // old masters do not send capabilities: nothing is turned on
+    Capabilities requested;
     for (auto& b: p.blocks()) {
         switch (b.type) {
         case Packet::ReservedBlockType::name:
@@ -253,11 +360,123 @@ void Slave::set_master_id(const Packet& p)
         case Packet::ReservedBlockType::sw_version:
             master_id_.sw_version = b.data;
             break;
+        case Packet::ReservedBlockType::capabilities:
+            requested = Capabilities::decode(b.data);
+            break;
         default:
-            log_warn(logger_, "you shouldn't received non-id block type ({:#x})", b.type);
+            // newer masters may add blocks, they are not a reason to fail the handshake
+            log_debug(logger_, "ignoring block type {:#x} in an identification packet", b.type);
         }
     }
+    agreed_  = supported_.agree(requested);
+    session_ = Session(agreed_);
+    rx_sequence_.set_version(session_.version);
     log_debug(logger_, "master {}", master_id_);
+    log_debug(logger_, "{} (requested features {:#x})", session_, requested.features);
+}
+
+std::string Slave::process_command(const Packet& p, const Packet::BlockView& b)
+{
+    // only tells which command a retransmission repeats, see CommandCache
+    if (b.type == Packet::ReservedBlockType::cmd_retry)
+        return std::string();
+    // subscriptions are handled by the protocol, the application only sees their effect
+    if (b.type == Packet::ReservedBlockType::subscribe &&
+        session_.features & Feature::subscriptions) {
+        auto subscriptions = Packet::parse_subscribe(b);
+        log_debug(logger_, "master subscribed to {} block type(s)", subscriptions.size());
+        request_manager_.set_subscriptions(subscriptions);
+        return std::string();
+    }
+    // the handlers run once the whole block arrived, with the fragment completing it
+    Packet::Fragment fragment;
+    if (session_.features & Feature::fragmentation && Packet::parse_fragment(b, fragment)) {
+        auto message = reassembler_.add(fragment, Reassembler::Clock::now());
+        return message ? process_command(p, message->block()) : std::string();
+    }
+    try {
+        if (auto handler = cmd_handlers_.find(b.type))
+            return (*handler)(b);
+        if (cmd_cb_)
+            return cmd_cb_(b);
+    } catch (std::exception& e) {
+        log_error(logger_, "failed to process command {}: {}", p.id(), e.what());
+    }
+    return std::string();
+}
+
+void Slave::dispatch_parked()
+{
+    while (!parked_cmds_.empty() && dispatcher_.available()) {
+        dispatch_command(std::move(parked_cmds_.front()));
+        parked_cmds_.pop_front();
+    }
+}
+
+void Slave::dispatch_command(Packet&& p)
+{
+    const bool valid = p.nb_block() == 1 || (session_.features & Feature::cmd_batching);
+    if (dispatcher_options_.ack == slave::AckPolicy::on_reception) {
+        request_manager_.ack_command(p);
+        if (valid)
+            dispatcher_.dispatch(std::move(p));
+    } else {
+        // even an invalid packet must be acked in order
+        dispatcher_.dispatch(std::move(p), valid);
+    }
+}
+
+void Slave::complete_command(const Packet& p, std::vector<std::string>& responses,
+                             bool in_order, bool idle)
+{
+    cmd_cache_.complete(p, responses);
+    if (dispatcher_options_.ack == slave::AckPolicy::on_reception)
+        return;
+
+    ack_command(p, responses, in_order);
+    if (idle)
+        request_manager_.flush_cmd_acks();
+}
+
+void Slave::ack_command(const Packet& p, const std::vector<std::string>& responses,
+                        bool in_order)
+{
+    // a range ack must not cover a command still in progress
+    if (!in_order)
+        request_manager_.flush_cmd_acks();
+    if (session_.features & Feature::cmd_response) {
+        for (size_t i = 0; i < responses.size(); i++) {
+            try {
+                if (!responses[i].empty())
+                    request_manager_.add_cmd_response(p.id(), i, responses[i]);
+            } catch (hdcp_error& e) {
+                log_error(logger_, "failed to send response: {}", e.what());
+            }
+        }
+    }
+    request_manager_.ack_command(p);
+    if (!in_order)
+        request_manager_.flush_cmd_acks();
+}
+
+void Slave::receive_bulk(const Packet& p)
+{
+    for (auto& b: p.blocks()) {
+        Packet::BulkChunk chunk;
+        if (!Packet::parse_bulk(b, chunk)) {
+            log_warn(logger_, "invalid bulk block in packet {}", p.id());
+            continue;
+        }
+        try {
+            auto r = bulk_.receive(chunk, slave::BulkReceiver::Clock::now());
+            // acks are also flushed when the master stops sending, e.g. at the end of its window
+            if (r.ack || transport_->read_queue_size() == 0)
+                request_manager_.send_bulk_ack(chunk.transfer, r.offset);
+        } catch (std::exception& e) {
+            // not acked, the master sends the chunk again
+            log_error(logger_, "failed to receive bulk transfer {}: {}", chunk.transfer, e.what());
+        }
+    }
 }
 
 void Slave::timeout_cb()
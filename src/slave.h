@@ -1,11 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
+
 #include "common/log.h"
 #include "common/statemachine.h"
 #include "common/thread.h"
 #include "common/event_mngr.h"
 
 #include "slave_request.h"
+#include "slave_dispatcher.h"
+#include "slave_cache.h"
+#include "slave_bulk.h"
+#include "handler_table.h"
+#include "sequence.h"
+#include "reassembly.h"
 #include "transport.h"
 #include "application.h"
 
@@ -22,6 +31,8 @@ public:
         connected
     };
     using CmdCallback    = std::function<void(const Packet::BlockView&)>;
+    /// The returned data, if any, is sent back to the master in the command ack
+    using ResponseCallback = CommandHandler;
     using StatusCallback = std::function<void(State, const std::error_code&)>;
 
     Slave(common::Logger logger, const Identification& id, std::unique_ptr<Transport> transport);
@@ -30,14 +41,80 @@ public:
     State state() const {return statemachine_.curr_state();};
     const Identification& master_id() const {return master_id_;}
     const Identification& slave_id()  const {return slave_id_;}
+    Features              features()  const {return session_.features;}
+    /// Largest frame agreed with the master, Packet::max_size without Feature::large_frames
+    size_t                max_frame_size() const {return session_.max_frame_size;}
+    const Session&        session()   const {return session_;}
 
     void start();
     void stop() override;
-    void set_cmd_cb(CmdCallback&& cb)       {cmd_cb_   = std::forward<CmdCallback>(cb);}
+    /// Called for the commands without a handler of their own
+    void set_cmd_cb(CmdCallback&& cb)
+    {
+        cmd_cb_ = [cb = std::forward<CmdCallback>(cb)](const Packet::BlockView& b) {
+            cb(b);
+            return std::string();
+        };
+    }
+    /// In place of set_cmd_cb, answer the commands with Feature::cmd_response
+    void set_response_cb(ResponseCallback&& cb) {cmd_cb_ = std::forward<ResponseCallback>(cb);}
+    /// Handle the commands of one block type, to be set before start(), not a reserved one
+    void on_command(Packet::BlockType type, CommandHandler&& handler)
+    {
+        cmd_handlers_.set(type, std::forward<CommandHandler>(handler));
+    }
+    /// handler takes the decoded T and returns nothing, a string or a value to encode
+    template<typename T, typename F>
+    void on_command(Packet::BlockType type, F&& handler)
+    {
+        cmd_handlers_.set(type, make_command_handler<T>(std::forward<F>(handler)));
+    }
+    template<typename T, typename F>
+    void on_command(F&& handler) {on_command<T>(block_type_of<T>, std::forward<F>(handler));}
     void set_status_cb(StatusCallback&& cb) {status_cb_ = std::forward<StatusCallback>(cb);}
-
-    void send_data(std::vector<Packet::BlockView>&);
-    void send_data(std::vector<Packet::Block>&);
+    /// Receive the bulk transfers of the master in order, Feature::bulk_transfer
+    void set_bulk_cb(slave::BulkReceiver::Callback&& cb)
+    {
+        bulk_.set_callback(std::forward<slave::BulkReceiver::Callback>(cb));
+    }
+    /// Restrict the features the master is allowed to turn on
+    void set_supported_features(Features f) {supported_.features = f;}
+    /// Largest frame the slave accepts with Feature::large_frames, that of the transport by
+    /// default and at most
+    void set_max_frame_size(size_t size)
+    {
+        supported_.max_frame_size = std::clamp(size, Packet::max_size,
+                                               transport_->max_frame_size());
+    }
+    /// Everything the master is allowed to turn on
+    void set_supported_capabilities(const Capabilities& c) {supported_ = c;}
+    /// Run the command callback on a worker pool, to be set before start()
+    void set_dispatcher_options(const slave::DispatcherOptions& opts) {dispatcher_options_ = opts;}
+    void set_cmd_ordering(Packet::BlockType type, slave::Ordering o) {dispatcher_.set_ordering(type, o);}
+    void set_default_cmd_ordering(slave::Ordering o) {dispatcher_.set_default_ordering(o);}
+    /// Number of executed commands remembered to answer retransmissions, 0 disables it
+    void set_cmd_cache_size(size_t size) {cmd_cache_.set_capacity(size);}
+    slave::CommandCacheStats cmd_cache_stats() const {return cmd_cache_.stats();}
+    /// Commands received in fragments, Feature::fragmentation
+    ReassemblyStats          reassembly_stats() const {return reassembler_.stats();}
+    /// Data blocks sent and dropped for lack of subscription by the master
+    slave::SubscriptionStats subscription_stats() const
+    {
+        return request_manager_.subscription_stats();
+    }
+    slave::BulkStats         bulk_stats() const {return bulk_.stats();}
+    /// Loss, reordering and duplicates of the packets received from the master
+    SequenceStats            rx_stats()  const {return rx_sequence_.stats();}
+
+    /// On a logical channel other than 0 with Feature::channels, the master receives each
+    /// channel in its own queue
+    void send_data(std::vector<Packet::BlockView>&, uint16_t channel = 0);
+    void send_data(std::vector<Packet::Block>&, uint16_t channel = 0);
+    /// Transport lane of the data packets of a channel, normal by default, before start()
+    void set_channel_priority(uint16_t channel, Priority prio)
+    {
+        request_manager_.set_channel_priority(channel, prio);
+    }
 
 private:
     using common::Thread::start;
@@ -87,16 +164,34 @@ private:
     common::Statemachine<State>   statemachine_;
     std::unique_ptr<Transport>    transport_;
     slave::RequestManager         request_manager_;
+    slave::CommandDispatcher      dispatcher_;
+    slave::DispatcherOptions      dispatcher_options_;
+    std::deque<Packet>            parked_cmds_; // waiting for room in the dispatcher, in order
+    slave::CommandCache           cmd_cache_;
     Identification                slave_id_;
     Identification                master_id_;
-    CmdCallback                   cmd_cb_;
-    Packet::Id                    received_packet_id_;
+    ResponseCallback              cmd_cb_;
+    HandlerTable<CommandHandler>  cmd_handlers_;
+    SequenceTracker               rx_sequence_;
+    Reassembler                   reassembler_;
+    slave::BulkReceiver           bulk_;
     std::error_code               errc_;
+    Capabilities                  supported_; // everything implemented, set by the constructor
+    Capabilities                  agreed_;
+    Session                       session_;
 
     StatusCallback                status_cb_;
 
     void run() override;
     void set_master_id(const Packet& p);
+    std::string process_command(const Packet& p, const Packet::BlockView& b);
+    /// Dispatch the commands parked while the dispatcher was full
+    void dispatch_parked();
+    void dispatch_command(Packet&& p);
+    void complete_command(const Packet& p, std::vector<std::string>& responses,
+                          bool in_order, bool idle);
+    void ack_command(const Packet& p, const std::vector<std::string>& responses, bool in_order);
+    void receive_bulk(const Packet& p);
     void timeout_cb();
 };
 
@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "slave_bulk.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+BulkReceiver::BulkReceiver(std::chrono::milliseconds timeout, size_t max_transfers):
+    timeout_(timeout), max_transfers_(std::max<size_t>(max_transfers, 1))
+{
+}
+
+BulkReceiver::Result BulkReceiver::receive(const Packet::BulkChunk& chunk,
+                                           Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = transfers_.find(chunk.transfer);
+    if (it == transfers_.end() || it->second.type != chunk.type ||
+        it->second.size != chunk.size) {
+        // a new transfer, those completed are not resumed anymore
+        transfers_.erase(chunk.transfer);
+        for (auto t = transfers_.begin(); t != transfers_.end();) {
+            if (t->second.offset == t->second.size)
+                t = transfers_.erase(t);
+            else
+                ++t;
+        }
+        if (transfers_.size() >= max_transfers_) {
+            // the incomplete transfer idle for the longest time makes room
+            auto oldest = std::min_element(transfers_.begin(), transfers_.end(),
+                                           [](auto& a, auto& b) {
+                                               return a.second.last < b.second.last;
+                                           });
+            stats_.dropped++;
+            transfers_.erase(oldest);
+        }
+        it = transfers_.emplace(chunk.transfer, Transfer{chunk.type, chunk.size, 0, 0, now})
+                 .first;
+    }
+    auto& t = it->second;
+    t.last = now;
+
+    // a probe asks where to resume
+    if (chunk.data.empty())
+        return {t.offset, true};
+    if (chunk.offset != t.offset) {
+        stats_.out_of_order++;
+        return {t.offset, true};
+    }
+
+    if (cb_)
+        cb_(chunk);
+    t.offset += chunk.data.size();
+    stats_.bytes += chunk.data.size();
+    const bool complete = t.offset == t.size;
+    if (complete)
+        stats_.completed++;
+    if (complete || ++t.unacked >= bulk_ack_interval) {
+        t.unacked = 0;
+        return {t.offset, true};
+    }
+    return {t.offset, false};
+}
+
+void BulkReceiver::expire(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto it = transfers_.begin(); it != transfers_.end();) {
+        if (now - it->second.last > timeout_) {
+            if (it->second.offset != it->second.size)
+                stats_.dropped++;
+            it = transfers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+BulkStats BulkReceiver::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+}
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
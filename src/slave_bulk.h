@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "packet.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+struct BulkStats
+{
+    uint64_t bytes;        // delivered to the application
+    uint64_t out_of_order; // chunks dropped, sent again by the master
+    uint64_t completed;    // transfers
+    uint64_t dropped;      // incomplete transfers forgotten, idle or past the limit
+};
+
+/*
+ * Bulk transfers received from the master. Chunks are delivered in order, the others are
+ * dropped and the offset reached is acked again so that the master goes back to it. The
+ * offset of a transfer survives reconnections, the master resumes from it, unless the
+ * transfer stays idle for the timeout or more incomplete ones take its place.
+ */
+class BulkReceiver
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Called with the chunks of a transfer in offset order, a throw leaves the offset as is
+    using Callback = std::function<void(const Packet::BulkChunk&)>;
+    struct Result
+    {
+        uint64_t offset; // bytes of the transfer received in order
+        bool     ack;    // to be acked now rather than with the next ones
+    };
+
+    explicit BulkReceiver(std::chrono::milliseconds timeout = bulk_idle_timeout,
+                          size_t max_transfers = max_bulk_transfers);
+
+    void   set_callback(Callback&& cb) {cb_ = std::forward<Callback>(cb);}
+    Result receive(const Packet::BulkChunk& chunk, Clock::time_point now);
+    /// Forget the transfers without chunk for the timeout
+    void   expire(Clock::time_point now);
+    BulkStats stats() const;
+
+private:
+    struct Transfer
+    {
+        Packet::BlockType type;
+        uint64_t          size;
+        uint64_t          offset   = 0;
+        size_t            unacked  = 0; // chunks received since the last ack
+        Clock::time_point last;
+    };
+
+    std::chrono::milliseconds              timeout_;
+    size_t                                 max_transfers_;
+    Callback                               cb_;
+    mutable std::mutex                     mutex_;
+    std::unordered_map<uint32_t, Transfer> transfers_;
+    BulkStats                              stats_ {};
+};
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -0,0 +1,140 @@
+#include "slave_cache.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+CommandCache::Lookup CommandCache::lookup(const Packet& p, std::vector<std::string>& responses)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (capacity_ == 0)
+        return Lookup::miss;
+
+    auto now = Clock::now();
+    evict(now);
+    stats_.lookups++;
+
+    auto   cmds    = commands(p);
+    size_t found   = 0;
+    bool   pending = false;
+    for (auto& c: cmds) {
+        auto it = entries_.find(c.key);
+        if (it != entries_.end() && it->second.hash == c.hash) {
+            found++;
+            pending |= it->second.pending;
+        }
+    }
+
+    if (found && found == cmds.size() && !pending) {
+        stats_.hits++;
+        responses.assign(p.nb_block(), std::string());
+        for (auto& c: cmds)
+            responses[c.index] = entries_[c.key].response;
+        return Lookup::hit;
+    }
+    // executing again only some of the commands would reorder them
+    if (found) {
+        stats_.pending++;
+        return Lookup::pending;
+    }
+
+    // a wrapped id replaces the previous entries
+    for (auto& c: cmds) {
+        auto it = entries_.find(c.key);
+        if (it != entries_.end())
+            order_.erase(it->second.pos);
+        order_.push_back(c.key);
+        entries_[c.key] = Entry {c.hash, now, true, {}, std::prev(order_.end())};
+    }
+    while (entries_.size() > capacity_)
+        evict(Clock::time_point::max());
+    return Lookup::miss;
+}
+
+void CommandCache::complete(const Packet& p, const std::vector<std::string>& responses)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto& c: commands(p)) {
+        auto it = entries_.find(c.key);
+        if (it == entries_.end() || it->second.hash != c.hash)
+            continue;
+        it->second.pending  = false;
+        it->second.response = c.index < responses.size() ? responses[c.index] : std::string();
+    }
+}
+
+void CommandCache::forget(const Packet& p)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto& c: commands(p)) {
+        auto it = entries_.find(c.key);
+        if (it == entries_.end() || it->second.hash != c.hash || !it->second.pending)
+            continue;
+        order_.erase(it->second.pos);
+        entries_.erase(it);
+    }
+}
+
+void CommandCache::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    entries_.clear();
+    order_.clear();
+}
+
+void CommandCache::set_capacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    capacity_ = capacity;
+    while (entries_.size() > capacity_)
+        evict(Clock::time_point::max());
+}
+
+size_t CommandCache::size() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return entries_.size();
+}
+
+CommandCacheStats CommandCache::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+}
+
+std::vector<CommandCache::Command> CommandCache::commands(const Packet& p)
+{
+    auto blocks = p.blocks();
+    Packet::Id origin = p.id();
+    uint8_t    first  = 0;
+    size_t     start  = 0;
+    if (!blocks.empty() && p.parse_cmd_retry(blocks.front(), origin, first))
+        start = 1;
+
+    std::vector<Command> cmds;
+    for (size_t i = start; i < blocks.size(); i++) {
+        Key key = (static_cast<Key>(origin) << 8) | static_cast<uint8_t>(first + i - start);
+        size_t h = std::hash<std::string_view>()(blocks[i].data) * 31 + blocks[i].type;
+        cmds.push_back({i, key, h});
+    }
+    return cmds;
+}
+
+void CommandCache::evict(Clock::time_point now)
+{
+    // a time point of max forces the eviction of the oldest entry
+    bool force = now == Clock::time_point::max();
+    while (!order_.empty()) {
+        auto it = entries_.find(order_.front());
+        if (!force && now - it->second.time < ttl_)
+            break;
+        entries_.erase(it);
+        order_.pop_front();
+        if (force)
+            break;
+    }
+}
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
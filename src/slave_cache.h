@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "packet.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+struct CommandCacheStats
+{
+    uint64_t lookups;
+    uint64_t hits;    // retransmissions answered without running the handlers
+    uint64_t pending; // retransmissions of a command still in progress, dropped
+};
+
+/*
+ * Recently executed commands, keyed by packet id and index in the packet and checked against a
+ * hash of the block so that a wrapped id is not mistaken for a retransmission. A command of a
+ * coalesced packet sent again alone behind a cmd_retry block is found under its original key.
+ * Bounded both in size and age.
+ */
+class CommandCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Lookup {
+        miss,    // new commands, recorded as pending
+        pending, // retransmission of commands in progress or partly forgotten, dropped
+        hit,     // retransmission of executed commands, responses are filled
+    };
+
+    CommandCache(size_t capacity = cmd_cache_size, std::chrono::milliseconds ttl = cmd_cache_ttl):
+        capacity_(capacity), ttl_(ttl) {}
+
+    Lookup lookup(const Packet& p, std::vector<std::string>& responses);
+    void   complete(const Packet& p, const std::vector<std::string>& responses);
+    /// The pending commands of p were not run, their retransmission runs them
+    void   forget(const Packet& p);
+    void   clear();
+    /// 0 disables the cache
+    void   set_capacity(size_t capacity);
+    /// Commands remembered
+    size_t size() const;
+    CommandCacheStats stats() const;
+
+private:
+    using Key = uint64_t; // packet id and index of the command in the packet
+
+    struct Entry
+    {
+        size_t                    hash;
+        Clock::time_point         time;
+        bool                      pending;
+        std::string               response;
+        std::list<Key>::iterator  pos; // in order_
+    };
+
+    /// A command of a packet, under its original key
+    struct Command
+    {
+        size_t            index;
+        Key               key;
+        size_t            hash;
+    };
+
+    mutable std::mutex             mutex_;
+    size_t                         capacity_;
+    std::chrono::milliseconds      ttl_;
+    std::unordered_map<Key, Entry> entries_;
+    std::list<Key>                 order_; // insertion order, for eviction
+    CommandCacheStats              stats_ {};
+
+    static std::vector<Command> commands(const Packet& p);
+    void evict(Clock::time_point now);
+};
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
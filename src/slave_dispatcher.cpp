@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#include "slave_dispatcher.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+CommandDispatcher::~CommandDispatcher()
+{
+    stop();
+}
+
+void CommandDispatcher::start(size_t workers, size_t max_in_flight)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (running_)
+        return;
+
+    log_debug(logger_, "starting command dispatcher ({} workers)...", workers);
+    running_       = true;
+    max_in_flight_ = std::max<size_t>(max_in_flight, 1);
+    for (size_t i = 0; i < workers; i++)
+        workers_.emplace_back(&CommandDispatcher::run, this);
+}
+
+void CommandDispatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (!running_)
+            return;
+        log_debug(logger_, "stopping command dispatcher...");
+        running_ = false;
+    }
+    work_cv_.notify_all();
+    for (auto& w: workers_)
+        w.join();
+    workers_.clear();
+    clear();
+    log_debug(logger_, "command dispatcher stopped");
+}
+
+void CommandDispatcher::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    in_flight_ -= queued_;
+    queued_ = 0;
+    ready_.clear();
+    // a running handler keeps its strand, the next command of its type waits for it
+    for (auto it = strands_.begin(); it != strands_.end();) {
+        it->second.jobs.clear();
+        it->second.busy = it->second.running;
+        it = it->second.busy ? std::next(it) : strands_.erase(it);
+    }
+    commands_.clear();
+    completed_.clear();
+}
+
+void CommandDispatcher::set_ordering(Packet::BlockType type, Ordering ordering)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    ordering_[type] = ordering;
+}
+
+void CommandDispatcher::set_default_ordering(Ordering ordering)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    default_ordering_ = ordering;
+}
+
+bool CommandDispatcher::available()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return !running_ || in_flight_ < max_in_flight_;
+}
+
+void CommandDispatcher::dispatch(Packet&& p, bool run_handlers)
+{
+    auto cmd = std::make_shared<Command>();
+    cmd->packet = std::move(p);
+    // the views point in the shared packet which does not move anymore
+    if (run_handlers)
+        cmd->blocks = cmd->packet.blocks();
+    cmd->responses.resize(cmd->blocks.size());
+    cmd->remaining = cmd->blocks.size();
+
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        commands_.push_back(cmd);
+        if (cmd->remaining > 0) {
+            for (size_t i = 0; i < cmd->blocks.size(); i++) {
+                in_flight_++;
+                queued_++;
+                schedule({cmd, i});
+            }
+            return;
+        }
+        complete(cmd);
+    }
+    deliver();
+}
+
+Ordering CommandDispatcher::ordering(Packet::BlockType type) const
+{
+    auto it = ordering_.find(type);
+    return it != ordering_.end() ? it->second : default_ordering_;
+}
+
+void CommandDispatcher::schedule(Job&& job)
+{
+    auto type = job.cmd->blocks[job.index].type;
+    if (ordering(type) == Ordering::sequential) {
+        auto& strand = strands_[type];
+        if (strand.busy) {
+            strand.jobs.push_back(std::move(job));
+            return;
+        }
+        strand.busy = true;
+    }
+    ready_.push_back(std::move(job));
+    work_cv_.notify_one();
+}
+
+bool CommandDispatcher::complete(const std::shared_ptr<Command>& cmd)
+{
+    auto it = std::find(commands_.begin(), commands_.end(), cmd);
+    // dropped by clear()
+    if (it == commands_.end())
+        return false;
+    bool in_order = it == commands_.begin();
+    commands_.erase(it);
+    completed_.push_back({cmd, in_order, queued_ == 0});
+    return true;
+}
+
+void CommandDispatcher::deliver()
+{
+    // the callback acks, possibly in a range: the completions are not reordered
+    std::lock_guard<std::mutex> cb_lk(callback_mutex_);
+    for (;;) {
+        Completion c;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (completed_.empty())
+                return;
+            c = std::move(completed_.front());
+            completed_.pop_front();
+        }
+        if (completion_cb_)
+            completion_cb_(c.cmd->packet, c.cmd->responses, c.in_order, c.idle);
+    }
+}
+
+void CommandDispatcher::run()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (true) {
+        work_cv_.wait(lk, [this]{return !running_ || !ready_.empty();});
+        if (!running_)
+            return;
+        Job job = std::move(ready_.front());
+        ready_.pop_front();
+        queued_--;
+        auto& block = job.cmd->blocks[job.index];
+        auto strand = strands_.find(block.type);
+        if (strand != strands_.end() && strand->second.busy)
+            strand->second.running = true;
+        lk.unlock();
+
+        std::string response;
+        try {
+            response = handler_(job.cmd->packet, block);
+        } catch (std::exception& e) {
+            log_error(logger_, "command {} handler failed: {}", job.cmd->packet.id(), e.what());
+        }
+
+        lk.lock();
+        job.cmd->responses[job.index] = std::move(response);
+        in_flight_--;
+        // hand the strand over to the next command of the same type
+        auto it = strands_.find(block.type);
+        if (it != strands_.end() && it->second.busy) {
+            it->second.running = false;
+            if (it->second.jobs.empty()) {
+                it->second.busy = false;
+            } else {
+                ready_.push_back(std::move(it->second.jobs.front()));
+                it->second.jobs.pop_front();
+                work_cv_.notify_one();
+            }
+        }
+        if (--job.cmd->remaining == 0 && complete(job.cmd)) {
+            lk.unlock();
+            deliver();
+            lk.lock();
+        }
+    }
+}
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
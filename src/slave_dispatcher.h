@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "common/log.h"
+
+#include "packet.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+/// When the command ack is sent by a dispatching slave
+enum class AckPolicy {
+    on_completion, // once every handler of the packet returned, carries their responses
+    on_reception,  // as soon as the packet is dispatched, responses are dropped
+};
+
+/// Execution order of the commands of a given block type
+enum class Ordering {
+    sequential, // one at a time, in reception order
+    concurrent, // on any free worker
+};
+
+struct DispatcherOptions
+{
+    size_t    workers       = 0;  // 0 runs the handlers on the slave thread
+    size_t    max_in_flight = 64; // handlers queued or running
+    AckPolicy ack           = AckPolicy::on_completion;
+};
+
+/*
+ * Runs command handlers on a pool of workers. Commands of a sequential block type are
+ * serialized on a strand, the other ones may run concurrently.
+ */
+class CommandDispatcher: public common::Log
+{
+public:
+    using Handler = std::function<std::string(const Packet&, const Packet::BlockView&)>;
+    /**
+     * Called once every block of a packet has been handled, without the dispatcher lock and
+     * in completion order. in_order is true when every packet dispatched before has
+     * completed, idle when no handler is waiting for a worker.
+     */
+    using CompletionCallback = std::function<void(const Packet&, std::vector<std::string>&,
+                                                  bool in_order, bool idle)>;
+
+    CommandDispatcher(common::Log logger, Handler handler, CompletionCallback cb):
+        Log(logger), handler_(handler), completion_cb_(cb) {}
+    ~CommandDispatcher();
+
+    void start(size_t workers, size_t max_in_flight);
+    void stop();
+    bool is_running() const {return running_;}
+    /// Drop the handlers not started yet, running ones complete without callback and keep
+    /// their strand until then
+    void clear();
+
+    void set_ordering(Packet::BlockType type, Ordering ordering);
+    void set_default_ordering(Ordering ordering);
+
+    /// Whether a new packet can be dispatched within max_in_flight
+    bool available();
+    /// Without handlers, the packet only takes its place in the completion order
+    void dispatch(Packet&& p, bool run_handlers = true);
+
+private:
+    struct Command
+    {
+        Packet                         packet;
+        std::vector<Packet::BlockView> blocks;
+        std::vector<std::string>       responses;
+        size_t                         remaining;
+    };
+    struct Job
+    {
+        std::shared_ptr<Command> cmd;
+        size_t                   index;
+    };
+    struct Strand
+    {
+        std::deque<Job> jobs;
+        bool            busy    = false; // a job is ready or running
+        bool            running = false;
+    };
+    struct Completion
+    {
+        std::shared_ptr<Command> cmd;
+        bool                     in_order;
+        bool                     idle;
+    };
+
+    Handler            handler_;
+    CompletionCallback completion_cb_;
+
+    std::mutex              mutex_;
+    std::mutex              callback_mutex_; // one thread calls back at a time
+    std::condition_variable work_cv_;
+    bool                    running_ = false;
+    size_t                  max_in_flight_;
+    size_t                  in_flight_ = 0;
+    size_t                  queued_    = 0;
+
+    std::deque<Job>                                   ready_;
+    std::unordered_map<Packet::BlockType, Strand>     strands_;
+    std::unordered_map<Packet::BlockType, Ordering>   ordering_;
+    Ordering                                          default_ordering_ = Ordering::sequential;
+    // packets in reception order, until completion
+    std::deque<std::shared_ptr<Command>>              commands_;
+    std::deque<Completion>                            completed_; // not called back yet
+    std::vector<std::thread>                          workers_;
+
+    Ordering ordering(Packet::BlockType type) const;
+    void     schedule(Job&& job);
+    /// Under the lock, false if the packet was dropped by clear()
+    bool     complete(const std::shared_ptr<Command>& cmd);
+    /// Without the lock, calls back the completions in order
+    void     deliver();
+    void     run();
+};
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
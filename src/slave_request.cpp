@@ -40,45 +40,194 @@ void RequestManager::stop()
 void RequestManager::send_cmd_ack(const Packet& packet)
 {
     if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_cmd_ack(++packet_id_,
-                                               packet.blocks().at(0).type, packet.id()));
+        write(Packet::make_cmd_ack(next_id(), packet.blocks().at(0).type, packet.id(),
+                                   version_),
+              Priority::high);
 }
 
-void RequestManager::send_data(std::vector<Packet::BlockView>& blocks)
+void RequestManager::ack_command(const Packet& packet)
 {
+    std::lock_guard<std::recursive_mutex> lk(ack_mutex_);
+    if (!cmd_batching_) {
+        // a response acks its command on its own
+        if (responses_.empty())
+            send_cmd_ack(packet);
+        else
+            flush_cmd_acks();
+        return;
+    }
+
+    // the master rejects ranges spanning more ids, an id before the range starts a new one
+    const Packet::Id mask = Packet::id_mask(version_);
+    if (ack_pending_ && ((packet.id() - ack_first_) & mask) > max_ack_range)
+        flush_cmd_acks();
+    if (!ack_pending_) {
+        ack_pending_ = true;
+        ack_first_   = packet.id();
+        ack_last_    = packet.id();
+    }
+    if (((packet.id() - ack_first_) & mask) > ((ack_last_ - ack_first_) & mask))
+        ack_last_ = packet.id();
+    if (((ack_last_ - ack_first_) & mask) == max_ack_range)
+        flush_cmd_acks();
+}
+
+void RequestManager::add_cmd_response(Packet::Id cmd_id, uint8_t block, std::string_view response)
+{
+    std::lock_guard<std::recursive_mutex> lk(ack_mutex_);
+    auto b = Packet::make_cmd_response(cmd_id, block, response, version_);
+    // keep room for the range block
+    auto range_size = Packet::make_cmd_ack_range(0, 0, version_).size(version_);
+    if (b.size(version_) + range_size > max_pl_size_)
+        throw application_error(appli::Errc::data_too_big,
+                                fmt::format("response to command {}", cmd_id));
+    if (responses_size_ + b.size(version_) + range_size > max_pl_size_)
+        flush_cmd_acks();
+    responses_size_ += b.size(version_);
+    responses_.push_back(std::move(b));
+}
+
+void RequestManager::flush_cmd_acks()
+{
+    std::lock_guard<std::recursive_mutex> lk(ack_mutex_);
+    if (!ack_pending_ && responses_.empty())
+        return;
+
+    std::vector<Packet::Block> blocks;
+    blocks.swap(responses_);
+    responses_size_ = 0;
+    // responses first, the range acks the commands without response
+    if (ack_pending_)
+        blocks.push_back(Packet::make_cmd_ack_range(ack_first_, ack_last_, version_));
+    ack_pending_ = false;
+
+    if (transport_ && transport_->is_open())
+        write(Packet::make_cmd_ack(next_id(), blocks, version_, checksum_), Priority::high);
+}
+
+void RequestManager::send_data(std::vector<Packet::BlockView>& blocks, uint16_t channel)
+{
+    if (channel >= max_channels)
+        throw application_error(appli::Errc::invalid_channel, std::to_string(channel));
+    // without the feature every channel is sent as the default one
+    if (!channels_)
+        channel = 0;
+    const Priority prio      = channel_priorities_[channel];
+    const size_t   alignment = alignment_;
+
+    // packets of the other channels start with their channel block
+    Packet::Block channel_block;
     std::vector<Packet::BlockView> payload;
-    size_t payload_size = 0;
-    for (auto& b: blocks) {
-        if (b.size() > Packet::max_pl_size)
+    size_t header_size = 0;
+    if (channel) {
+        channel_block = Packet::make_channel(channel, 0);
+        header_size   = channel_block.size(version_, alignment);
+        payload.push_back(channel_block);
+    }
+    size_t payload_size = header_size;
+    auto flush = [&] {
+        std::unique_lock<std::mutex> lk;
+        if (channel) {
+            lk = std::unique_lock<std::mutex>(channel_mutex_[channel]);
+            channel_block = Packet::make_channel(channel, ++channel_seq_[channel]);
+            payload[0]    = channel_block;
+        }
+        write_data(Packet::make_data(next_data_id(), payload, version_, checksum_, compress_,
+                                     alignment), prio);
+        payload.resize(channel ? 1 : 0);
+        payload_size = header_size;
+    };
+
+    std::vector<Packet::BlockView> selected;
+    for (auto& b: subscriptions_.select(blocks, selected)) {
+        const bool too_big = b.size(version_, alignment) + header_size > max_pl_size_;
+        if (too_big && (!fragmentation_ || channel))
             throw application_error(appli::Errc::data_too_big);
-        if (payload_size + b.size() > Packet::max_pl_size) {
-            transport_->write(Packet::make_data(++packet_id_, payload));
-            payload.clear();
-            payload_size = 0;
+        if (payload_size + b.size(version_, alignment) > max_pl_size_ &&
+            payload_size > header_size)
+            flush();
+        if (too_big) {
+            // one fragment per packet, in order
+            auto fragments = Packet::make_fragments(b, message_id_++,
+                                                    max_pl_size_ - (alignment - 1), version_);
+            for (auto& f: fragments) {
+                std::vector<Packet::BlockView> fragment = {f};
+                write_data(Packet::make_data(next_data_id(), fragment, version_, checksum_,
+                                             compress_, alignment), prio);
+            }
+            continue;
         }
         payload.push_back(b);
-        payload_size += b.size();
+        payload_size += b.size(version_, alignment);
     }
-    if (payload.size() != 0)
-        transport_->write(Packet::make_data(++packet_id_, payload));
+    if (payload_size > header_size)
+        flush();
 }
 
-void RequestManager::send_data(std::vector<Packet::Block>& blocks)
+void RequestManager::send_data(std::vector<Packet::Block>& blocks, uint16_t channel)
 {
     std::vector<Packet::BlockView> view;
     std::copy(blocks.begin(), blocks.end(), std::back_inserter(view));
-    send_data(view);
+    send_data(view, channel);
+}
+
+void RequestManager::set_channel_priority(uint16_t channel, Priority prio)
+{
+    if (channel >= max_channels)
+        throw application_error(appli::Errc::invalid_channel, std::to_string(channel));
+    channel_priorities_[channel] = prio;
+}
+
+void RequestManager::set_data_retransmission(size_t ring_size)
+{
+    std::lock_guard<std::mutex> lk(ring_mutex_);
+    ring_.clear();
+    ring_.resize(ring_size);
+}
+
+void RequestManager::retransmit(const Packet& nack)
+{
+    auto blocks = nack.blocks();
+    if (blocks.size() != 1 || blocks[0].type != Packet::ReservedBlockType::nack_ids) {
+        log_warn(logger_, "invalid nack {}", nack.id());
+        return;
+    }
+    for (auto id: nack.ids(blocks[0])) {
+        std::shared_ptr<const Packet> p;
+        {
+            std::lock_guard<std::mutex> lk(ring_mutex_);
+            if (ring_.empty())
+                return;
+            p = ring_[id % ring_.size()];
+        }
+        // overwritten since or never sent
+        if (!p || p->id() != id) {
+            log_debug(logger_, "packet {} can't be sent again", id);
+            continue;
+        }
+        if (transport_ && transport_->is_open())
+            write(Packet(*p), Priority::high);
+    }
 }
 
-void RequestManager::send_dip(const Identification& id)
+void RequestManager::send_bulk_ack(uint32_t transfer, uint64_t offset)
 {
     if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_dip(++packet_id_, id));
+        write(Packet::make_bulk_ack(next_id(), transfer, offset, version_, checksum_),
+              Priority::high);
 }
 
-void RequestManager::start_keepalive_management(std::chrono::milliseconds keepalive_timeout)
+void RequestManager::send_dip(const Identification& id, const std::string& capabilities)
+{
+    if (transport_ && transport_->is_open())
+        write(Packet::make_dip(next_id(), id, capabilities));
+}
+
+void RequestManager::start_keepalive_management(std::chrono::milliseconds keepalive_timeout,
+                                                bool passive)
 {
     keepalive_mngt_ = true;
+    passive_        = passive;
     // set timeout
     timeout_keepalive_ = keepalive_timeout.count()/time_base_ms.count();
     keepalive_id_ = timeout_queue_.add(now_, timeout_keepalive_,
@@ -93,6 +242,21 @@ void RequestManager::stop_keepalive_management()
 }
 
 void RequestManager::keepalive()
+{
+    refresh_keepalive();
+
+    if (passive_) {
+        ka_tx_count_ = tx_count_.load();
+        timeout_queue_.add(now_, 1, std::bind(&RequestManager::ka_ack_timeout_cb, this,
+                                              std::placeholders::_1, std::placeholders::_2));
+        return;
+    }
+
+    if (transport_ && transport_->is_open())
+        write(Packet::make_keepalive_ack(next_id(), version_), Priority::high);
+}
+
+void RequestManager::refresh_keepalive()
 {
     if (keepalive_mngt_) {
         timeout_queue_.erase(keepalive_id_);
@@ -100,17 +264,49 @@ void RequestManager::keepalive()
                                            std::bind(&RequestManager::ka_timeout_cb, this,
                                                      std::placeholders::_1, std::placeholders::_2));
     }
+}
 
-    if (transport_ && transport_->is_open())
-        transport_->write(Packet::make_keepalive_ack(++packet_id_));
+void RequestManager::write(Packet&& p, Priority prio)
+{
+    tx_count_++;
+    transport_->write(std::move(p), prio);
 }
 
+void RequestManager::write_data(Packet&& p, Priority prio)
+{
+    if (reliable_) {
+        auto copy = std::make_shared<const Packet>(p);
+        {
+            std::lock_guard<std::mutex> lk(ring_mutex_);
+            if (!ring_.empty())
+                ring_[p.id() % ring_.size()].swap(copy);
+        }
+        // the packet replaced is released here
+    }
+    write(std::move(p), prio);
+}
 
 void RequestManager::clear()
 {
+    std::lock_guard<std::recursive_mutex> lk(ack_mutex_);
+    ack_pending_ = false;
+    responses_.clear();
+    responses_size_ = 0;
     timeout_queue_.clear();
     now_              = 0;
     packet_id_        = 0;
+    data_id_          = 0;
+    reliable_         = false;
+    version_          = Packet::v1;
+    max_pl_size_      = Packet::max_pl_size;
+    checksum_         = Packet::Checksum::fletcher16;
+    compress_         = false;
+    alignment_        = 1;
+    subscriptions_.clear();
+    fragmentation_    = false;
+    channels_         = false;
+    for (auto& seq: channel_seq_)
+        seq = 0;
 }
 
 void RequestManager::ka_timeout_cb(common::TimeoutQueue::Id, int64_t)
@@ -120,6 +316,16 @@ void RequestManager::ka_timeout_cb(common::TimeoutQueue::Id, int64_t)
         timeout_cb_();
 }
 
+void RequestManager::ka_ack_timeout_cb(common::TimeoutQueue::Id, int64_t)
+{
+    // a packet has been sent since the ka was received, it already acks it
+    if (tx_count_ != ka_tx_count_)
+        return;
+
+    if (transport_ && transport_->is_open())
+        write(Packet::make_keepalive_ack(next_id(), version_), Priority::high);
+}
+
 } /* namespace slave  */
 } /* namespace appli  */
 } /* namespace hdcp */
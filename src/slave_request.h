@@ -1,9 +1,14 @@
+#include <array>
+#include <memory>
+#include <mutex>
+
 #include "common/log.h"
 #include "common/timeout_queue.h"
 #include "common/thread.h"
 
 #include "transport.h"
 #include "packet.h"
+#include "slave_subscription.h"
 
 namespace hdcp {
 namespace appli {
@@ -15,15 +20,48 @@ public:
     using TimeoutCallback = std::function<void()>;
 
     RequestManager(common::Log logger, Transport * transport, TimeoutCallback cb):
-        Log(logger), transport_(transport), timeout_cb_(cb) {}
+        Log(logger), transport_(transport), timeout_cb_(cb)
+    {
+        channel_priorities_.fill(Priority::normal);
+    }
 
     void send_cmd_ack(const Packet& packet);
-    void send_data(std::vector<Packet::BlockView>& blocks);
-    void send_data(std::vector<Packet::Block>& blocks);
-    void send_dip(const Identification& id);
-    void start_keepalive_management(std::chrono::milliseconds keepalive_timeout);
+    /// With batching, acks are accumulated in a range until flushed
+    void ack_command(const Packet& packet);
+    void flush_cmd_acks();
+    /// Queue the response of a command, it is sent in place of its ack
+    void add_cmd_response(Packet::Id cmd_id, uint8_t block, std::string_view response);
+    void set_cmd_batching(bool enable) {cmd_batching_ = enable;}
+    /// Format of the packets sent, back to the defaults at each start
+    void set_session(const Session& session)
+    {
+        version_       = session.version;
+        max_pl_size_   = session.max_frame_size - Packet::max_header_size;
+        checksum_      = session.checksum;
+        compress_      = session.version == Packet::v2 && session.codecs & Codec::lz;
+        alignment_     = session.alignment;
+        fragmentation_ = session.features & Feature::fragmentation;
+        channels_      = session.features & Feature::channels;
+        reliable_      = session.features & Feature::reliable_data;
+    }
+    /// Blocks the master did not subscribe to are dropped, larger ones than a packet are
+    /// fragmented with Feature::fragmentation on channel 0 only
+    void send_data(std::vector<Packet::BlockView>& blocks, uint16_t channel = 0);
+    void send_data(std::vector<Packet::Block>& blocks, uint16_t channel = 0);
+    /// To be set before start()
+    void set_channel_priority(uint16_t channel, Priority prio);
+    void set_subscriptions(const std::vector<Packet::Subscription>& s) {subscriptions_.set(s);}
+    SubscriptionStats subscription_stats() const {return subscriptions_.stats();}
+    /// Keep the last data packets to answer nacks, 0 disables it
+    void set_data_retransmission(size_t ring_size);
+    void retransmit(const Packet& nack);
+    void send_bulk_ack(uint32_t transfer, uint64_t offset);
+    void send_dip(const Identification& id, const std::string& capabilities);
+    void start_keepalive_management(std::chrono::milliseconds keepalive_timeout,
+                                    bool passive = false);
     void stop_keepalive_management();
     void keepalive();
+    void refresh_keepalive();
 
     void start();
     void stop() override;
@@ -36,16 +74,66 @@ private:
 
     int64_t                 now_ = 0;
     std::atomic<Packet::Id> packet_id_ = 0;
+    // with Feature::reliable_data data packets are numbered apart, so that the master only
+    // sees holes for data it can nack
+    std::atomic<Packet::Id> data_id_   = 0;
+    std::atomic_bool        reliable_  = false;
+    std::atomic<uint8_t>    version_   = Packet::v1;
+    std::atomic<size_t>     max_pl_size_ = Packet::max_pl_size;
+    std::atomic<Packet::Checksum> checksum_ = Packet::Checksum::fletcher16;
+    std::atomic_bool        compress_    = false;
+    std::atomic<size_t>     alignment_   = 1;
+    SubscriptionFilter      subscriptions_;
+    std::atomic_bool        fragmentation_ = false;
+    std::atomic<uint32_t>   message_id_    = 0;
+    std::atomic_bool        channels_      = false;
+    std::array<Priority, max_channels>              channel_priorities_;
+    // sequence numbers of the data packets sent on each channel
+    std::array<std::atomic<uint32_t>, max_channels> channel_seq_ {};
+    // held from numbering a packet of the channel to writing it, so that they stay in order
+    std::array<std::mutex, max_channels>            channel_mutex_;
 
     bool keepalive_mngt_ = false;
+    bool passive_        = false;
+
+    bool       cmd_batching_ = false;
+    bool       ack_pending_  = false;
+    Packet::Id ack_first_;
+    Packet::Id ack_last_;
+    std::vector<Packet::Block> responses_;
+    size_t                     responses_size_ = 0;
+    // acks are also produced by the command dispatcher workers
+    std::recursive_mutex       ack_mutex_;
 
     int64_t timeout_keepalive_;
 
+    // data packets indexed by id modulo the ring size, shared so that they are copied and
+    // released outside the lock
+    std::vector<std::shared_ptr<const Packet>> ring_;
+    std::mutex                                 ring_mutex_;
+
+    /*
+     * In passive mode the ka ack is deferred by one time base and dropped if any
+     * other packet has been sent in between, the master accepting any packet as an ack
+     */
+    std::atomic<uint64_t> tx_count_    = 0;
+    std::atomic<uint64_t> ka_tx_count_ = 0;
+
     Transport * transport_;
 
     TimeoutCallback timeout_cb_;
 
     void ka_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
+    void ka_ack_timeout_cb(common::TimeoutQueue::Id id, int64_t now);
+
+    // control packets go through the high priority lane so that data bursts do not delay them
+    void write(Packet&& p, Priority prio = Priority::normal);
+    Packet::Id next_id() {return ++packet_id_ & Packet::id_mask(version_);}
+    Packet::Id next_data_id()
+    {
+        return reliable_ ? ++data_id_ & Packet::id_mask(version_) : next_id();
+    }
+    void write_data(Packet&& p, Priority prio = Priority::normal);
 
     void run() override;
     void clear();
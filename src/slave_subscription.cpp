@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "slave_subscription.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+void SubscriptionFilter::set(const std::vector<Packet::Subscription>& subscriptions)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    entries_.clear();
+    for (auto& s: subscriptions)
+        entries_[s.type] = {std::max<uint16_t>(s.decimation, 1), 0};
+    all_.store(entries_.empty(), std::memory_order_release);
+}
+
+const std::vector<Packet::BlockView>& SubscriptionFilter::select(
+    const std::vector<Packet::BlockView>& blocks, std::vector<Packet::BlockView>& selected)
+{
+    if (all_.load(std::memory_order_acquire)) {
+        sent_.fetch_add(blocks.size(), std::memory_order_relaxed);
+        return blocks;
+    }
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (all_.load(std::memory_order_relaxed)) {
+        sent_.fetch_add(blocks.size(), std::memory_order_relaxed);
+        return blocks;
+    }
+    selected.clear();
+    for (auto& b: blocks) {
+        Packet::ArrayView array;
+        auto type = Packet::parse_array(b, array) ? array.type : b.type;
+        auto it = entries_.find(type);
+        // the first block of a type is sent, then one every decimation
+        if (it == entries_.end() || it->second.count++ % it->second.decimation) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        selected.push_back(b);
+    }
+    sent_.fetch_add(selected.size(), std::memory_order_relaxed);
+    return selected;
+}
+
+SubscriptionStats SubscriptionFilter::stats() const
+{
+    return {sent_.load(std::memory_order_relaxed), dropped_.load(std::memory_order_relaxed)};
+}
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "packet.h"
+
+namespace hdcp {
+namespace appli {
+namespace slave {
+
+struct SubscriptionStats
+{
+    uint64_t sent;    // data blocks passed to serialization
+    uint64_t dropped; // data blocks not subscribed to, or skipped by decimation
+};
+
+/*
+ * Data block types the master subscribed to, array blocks are known by the type of their
+ * elements. Every block is sent until the master subscribes, and again after an empty
+ * subscription; the filter then takes no lock.
+ */
+class SubscriptionFilter
+{
+public:
+    void set(const std::vector<Packet::Subscription>& subscriptions);
+    void clear() {set({});}
+    /// blocks itself when everything is sent, the subscribed blocks copied in selected if not
+    const std::vector<Packet::BlockView>& select(const std::vector<Packet::BlockView>& blocks,
+                                                 std::vector<Packet::BlockView>& selected);
+    SubscriptionStats stats() const;
+
+private:
+    struct Entry
+    {
+        uint16_t decimation;
+        uint32_t count; // blocks of the type seen since the subscription
+    };
+
+    std::mutex                                   mutex_;
+    std::atomic_bool                             all_     = true;
+    std::atomic<uint64_t>                        sent_    = 0;
+    std::atomic<uint64_t>                        dropped_ = 0;
+    std::unordered_map<Packet::BlockType, Entry> entries_;
+};
+
+} /* namespace slave */
+} /* namespace appli */
+} /* namespace hdcp */
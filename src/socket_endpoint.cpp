@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "socket_endpoint.h"
+
+namespace hdcp {
+namespace transport {
+
+void SocketEndpoint::start()
+{
+    if (is_running())
+        return;
+    log_debug(logger_, "starting transport...");
+    open();
+    common::Thread::start(true);
+    log_debug(logger_, "transport started");
+}
+
+void SocketEndpoint::stop()
+{
+    if (!is_running())
+        return;
+    log_debug(logger_, "stopping transport...");
+    close();
+    common::Thread::stop();
+    interrupt();
+    if (joinable())
+        join();
+    log_debug(logger_, "transport stopped");
+}
+
+bool SocketEndpoint::is_open()
+{
+    return connected_;
+}
+
+void SocketEndpoint::close()
+{
+    if (!connected_.exchange(false))
+        return;
+    log_debug(logger_, "closing transport...");
+    // the thread sees the end of the connection and releases the socket
+    std::lock_guard<std::mutex> lk(fd_mutex_);
+    if (fd_ >= 0)
+        ::shutdown(fd_, SHUT_RDWR);
+    log_debug(logger_, "transport closed");
+}
+
+void SocketEndpoint::set_session(const Session& session)
+{
+    frame_size_ = std::max<size_t>(session.max_frame_size, Packet::max_size);
+    std::lock_guard<std::mutex> lk(fd_mutex_);
+    if (fd_ >= 0)
+        resize_buffers(fd_);
+}
+
+void SocketEndpoint::attach(int fd)
+{
+    resize_buffers(fd);
+    fd_ = fd;
+    connected_ = true;
+    log_debug(logger_, "transport opened");
+}
+
+void SocketEndpoint::connect()
+{
+    std::this_thread::sleep_for(time_base_ms);
+}
+
+void SocketEndpoint::accept(int listen_fd)
+{
+    pollfd pfd {listen_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, time_base_ms.count()) <= 0)
+        return;
+    int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+        log_warn(logger_, "accept: {}", std::strerror(errno));
+        return;
+    }
+    attach(fd);
+}
+
+void SocketEndpoint::resize_buffers(int fd)
+{
+    // the system defaults already hold small frames
+    const size_t frame = frame_size_;
+    if (frame <= Packet::max_size)
+        return;
+    int size = socket_buffer_frames * frame;
+    if (::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0 ||
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+        log_warn(logger_, "cannot resize socket buffers: {}", std::strerror(errno));
+    socklen_t len = sizeof(size);
+    if (::getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, &len) == 0 && size_t(size) < frame)
+        log_warn(logger_, "socket buffer of {} bytes, below a frame (net.core.wmem_max)", size);
+}
+
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+
+#include "common/log.h"
+#include "common/thread.h"
+
+#include "transport.h"
+
+namespace hdcp {
+namespace transport {
+
+/*
+ * Connection over a socket driven by a thread of the endpoint, what the local socket and
+ * io_uring transports share: opening and closing, socket buffers sized by the session, and
+ * the accepting of their servers. The thread connects while there is no socket and releases
+ * it once closed.
+ */
+class SocketEndpoint: public common::Log, protected common::Thread, public Transport
+{
+public:
+    void start()   override;
+    void stop()    override;
+    bool is_open() override;
+    void close()   override;
+    /// Large frames get socket buffers holding a few of them
+    void set_session(const Session& session) override;
+    size_t max_frame_size() const override {return Packet::max_frame_size;}
+
+protected:
+    static constexpr size_t socket_buffer_frames = 4;
+
+    std::atomic<int>    fd_        = -1;
+    std::atomic_bool    connected_ = false;
+    std::atomic<size_t> frame_size_ {Packet::max_size}; // of the session
+    std::mutex          fd_mutex_; // fd_ is not closed while shut down
+
+    explicit SocketEndpoint(common::Logger logger): common::Log(logger) {}
+
+    /// Use the connected socket fd
+    virtual void attach(int fd);
+    /// Called by the thread while not connected, returns within a time base
+    virtual void connect();
+    /// Wakes the thread waiting for io, once stopped
+    virtual void interrupt() {}
+    /// Attach the connection accepted on listen_fd, if one comes within a time base
+    void accept(int listen_fd);
+    void resize_buffers(int fd);
+
+private:
+    using common::Thread::start;
+};
+
+} /* namespace transport */
+} /* namespace hdcp */
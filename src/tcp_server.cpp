@@ -74,15 +74,15 @@ bool Server::is_open()
     return socket_.is_open();
 }
 
-void Server::write(Packet&& p)
+void Server::write(Packet&& p, Priority prio)
 {
     if (!is_open())
         throw transport_error(Errc::write_while_closed);
 
     boost::asio::post(io_context_,
-        [this, p] ()
+        [this, p = std::move(p), prio] () mutable
         {
-            if (!write_queue_.try_enqueue(p))
+            if (!enqueue_write(std::move(p), prio))
                 throw transport_error(Errc::write_queue_full);
             if (!write_in_progress_)
                 do_write();
@@ -121,9 +121,37 @@ void Server::run()
 
 void Server::read_header()
 {
-    auto h = read_packet_.header_view();
+    // the version, hence the header size, is known once the shortest header is read
     boost::asio::async_read(socket_,
-                            boost::asio::buffer(const_cast<char*>(h.data()), h.size()),
+                            boost::asio::buffer(read_packet_.data(), Packet::min_header_size),
+        [this](const boost::system::error_code& ec, size_t len)
+        {
+            log_trace(logger_, "read {} bytes", len);
+            errc_ = ec;
+            if (!ec) {
+                read_header_end();
+            } else if (ec == boost::asio::error::operation_aborted) {
+                log_warn(logger_, "{}", ec.message());
+            } else if (ec == boost::asio::error::eof) {
+                log_info(logger_, "{}", ec.message());
+                close();
+                open();
+            } else {
+                throw asio_error(ec);
+            }
+        });
+}
+
+void Server::read_header_end()
+{
+    size_t remaining = read_packet_.header_size() - Packet::min_header_size;
+    if (remaining == 0) {
+        read_payload();
+        return;
+    }
+    boost::asio::async_read(socket_,
+                            boost::asio::buffer(read_packet_.data() + Packet::min_header_size,
+                                                remaining),
         [this](const boost::system::error_code& ec, size_t len)
         {
             log_trace(logger_, "read {} bytes", len);
@@ -149,7 +177,10 @@ void Server::read_payload()
     } catch (hdcp::packet_error& e) {
         log_error(logger_, "{}", e.what());
         read_header();
+        return;
     }
+    // large frames do not fit in the inline buffer
+    read_packet_.reserve(read_packet_.size());
 
     auto pl = read_packet_.payload();
     boost::asio::async_read(socket_,
@@ -180,9 +211,27 @@ void Server::read_payload()
         });
 }
 
+void Server::set_session(const Session& session)
+{
+    // below, the system defaults are already large enough
+    if (session.max_frame_size <= Packet::max_size)
+        return;
+    const int size = socket_buffer_frames * session.max_frame_size;
+    boost::asio::post(io_context_,
+        [this, size]
+        {
+            boost::system::error_code ec;
+            socket_.set_option(boost::asio::socket_base::send_buffer_size(size), ec);
+            if (!ec)
+                socket_.set_option(boost::asio::socket_base::receive_buffer_size(size), ec);
+            if (ec)
+                log_warn(logger_, "cannot resize socket buffers: {}", ec.message());
+        });
+}
+
 void Server::do_write()
 {
-    if (!write_queue_.try_dequeue(write_packet_))
+    if (!dequeue_write(write_packet_))
         return;
     write_in_progress_ = true;
     boost::asio::async_write(socket_,
@@ -192,7 +241,7 @@ void Server::do_write()
             log_trace(logger_, "write {} bytes", len);
             errc_ = ec;
             if (!ec) {
-                if (write_queue_.size_approx() > 0)
+                if (write_queue_size() > 0)
                     do_write();
                 else
                     write_in_progress_ = false;
@@ -16,16 +16,22 @@ public:
     Server(common::Logger logger, uint16_t port);
     ~Server();
 
-    void write(Packet&& p) override;
+    using Transport::write;
+    void write(Packet&& p, Priority prio) override;
     void start()   override;
     void stop()    override;
     bool is_open() override;
     void open()    override;
     void close()   override;
+    /// Large frames get socket buffers holding a few of them
+    void set_session(const Session& session) override;
+    size_t max_frame_size() const override {return Packet::max_frame_size;}
 
 private:
     using common::Thread::start;
 
+    static constexpr size_t socket_buffer_frames = 4;
+
     boost::asio::io_context        io_context_;
     boost::asio::ip::tcp::socket   socket_;
     boost::asio::ip::tcp::acceptor acceptor_;
@@ -36,6 +42,7 @@ private:
 
     void do_write();
     void read_header();
+    void read_header_end();
     void read_payload();
 
     void run() override;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 
 #include "common/readerwriterqueue.h"
@@ -7,6 +8,7 @@
 
 #include "transport_error.h"
 #include "packet.h"
+#include "session.h"
 
 namespace hdcp {
 
@@ -14,28 +16,49 @@ constexpr std::chrono::milliseconds time_base_ms(100);
 constexpr uint64_t timeout_read  = 0; // no timeout when reading
 constexpr uint64_t timeout_write = time_base_ms.count();
 
+/// Write lanes, a higher priority lane is always drained first
+enum class Priority: uint8_t {
+    low,
+    normal,
+    high
+};
+
 class Transport
 {
 public:
-    Transport(): write_queue_(max_queue_size), read_queue_(max_queue_size) {};
+    Transport():
+        read_queue_(max_queue_size),
+        write_queues_{{WriteQueue(max_queue_size), WriteQueue(max_queue_size),
+                       WriteQueue(max_queue_size)}} {};
     virtual ~Transport() = default;
 
-    void write(const Packet& p) {write(Packet(p));}
-    bool read(Packet& p)
+    void write(const Packet& p, Priority prio = Priority::normal) {write(Packet(p), prio);}
+    void write(Packet&& p) {write(std::move(p), Priority::normal);}
+    /// Wait up to a time base for a received packet, transports owning their receive buffer
+    /// read from it instead of the read queue
+    virtual bool read(Packet& p)
     {
         return read_queue_.wait_dequeue_timed(p, time_base_ms);
     }
 
-    void clear_queues()
+    virtual size_t read_queue_size() const {return read_queue_.size_approx();}
+
+    virtual void clear_queues()
     {
         while (read_queue_.pop()) {}
         Packet p;
-        while (write_queue_.try_dequeue(p)) {}
+        while (dequeue_write(p)) {}
     }
 
     const std::error_code& error_code() const {return errc_;}
 
-    virtual void write(Packet&&) = 0;
+    /// Parameters agreed at handshake, the defaults are set back at disconnection
+    virtual void set_session(const Session&) {}
+    /// Largest frame the transport is able to receive, the default of what the application
+    /// advertises at handshake; at least Packet::max_size
+    virtual size_t max_frame_size() const {return Packet::max_size;}
+
+    virtual void write(Packet&&, Priority) = 0;
     virtual void start()   = 0;
     virtual void stop()    = 0;
     virtual bool is_open() = 0;
@@ -45,11 +68,36 @@ public:
 protected:
     std::error_code errc_;
 
-    common::ConcurrentQueue<Packet>           write_queue_;
+    bool enqueue_write(Packet&& p, Priority prio)
+    {
+        return write_queues_[static_cast<size_t>(prio)].try_enqueue(std::move(p));
+    }
+
+    bool dequeue_write(Packet& p)
+    {
+        for (auto it = write_queues_.rbegin(); it != write_queues_.rend(); ++it) {
+            if (it->try_dequeue(p))
+                return true;
+        }
+        return false;
+    }
+
+    size_t write_queue_size() const
+    {
+        size_t size = 0;
+        for (auto& q: write_queues_)
+            size += q.size_approx();
+        return size;
+    }
+
     common::BlockingReaderWriterQueue<Packet> read_queue_;
 
 private:
     static constexpr size_t max_queue_size = 100;
+    static constexpr size_t nb_priorities  = 3;
+
+    using WriteQueue = common::ConcurrentQueue<Packet>;
+    std::array<WriteQueue, nb_priorities> write_queues_;
 
     // disable copy ctor, copy assignment, move ctor & move assignment
     /* TODO: enable move ? <30-09-20, cneyton> */
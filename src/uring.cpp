@@ -0,0 +1,726 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "tcp_client.h"
+#include "tcp_server.h"
+#include "uring.h"
+
+namespace hdcp {
+namespace transport {
+namespace uring {
+
+namespace {
+
+enum Op: uint64_t {
+    op_recv = 1,
+    op_send,
+    op_wake,
+    op_provide,
+};
+
+constexpr uint16_t recv_group = 0;
+
+std::system_error system_error(const std::string& what, int err = errno)
+{
+    return std::system_error(err, std::system_category(), what);
+}
+
+int io_uring_setup(unsigned entries, io_uring_params * p)
+{
+    return ::syscall(__NR_io_uring_setup, entries, p);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                   const void * arg, size_t arg_size)
+{
+    return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+int io_uring_register(int fd, unsigned opcode, const void * arg, unsigned nr_args)
+{
+    return ::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+void * map(size_t size, int fd = -1, off_t offset = 0)
+{
+    void * p = fd < 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0)
+                      : ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED)
+        throw system_error("mmap");
+    return p;
+}
+
+} /* namespace */
+
+/*
+ * Submission and completion queues shared with the kernel, the mapped views of liburing
+ * without the dependency. Used by a single thread.
+ */
+struct Ring
+{
+    int            fd = -1;
+    void         * rings = nullptr;
+    size_t         rings_size = 0;
+    io_uring_sqe * sqes = nullptr;
+    size_t         sqes_size = 0;
+    unsigned     * sq_head;
+    unsigned     * sq_tail;
+    unsigned       sq_mask;
+    unsigned       sq_entries;
+    unsigned       tail;     // of the sqes prepared, published on enter
+    unsigned     * cq_head;
+    unsigned     * cq_tail;
+    unsigned       cq_mask;
+    io_uring_cqe * cqes;
+
+    explicit Ring(unsigned entries)
+    {
+        // completions are run on io_uring_enter by the thread, without interrupting it
+        io_uring_params p {};
+        p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        fd = io_uring_setup(entries, &p);
+        if (fd < 0 && errno == EINVAL) {
+            p = {};
+            fd = io_uring_setup(entries, &p);
+        }
+        if (fd < 0)
+            throw system_error("io_uring_setup");
+        try {
+            if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG))
+                throw system_error("io_uring features", ENOSYS);
+            rings_size = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                                  p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+            rings = map(rings_size, fd, IORING_OFF_SQ_RING);
+            sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(map(sqes_size, fd, IORING_OFF_SQES));
+        } catch (...) {
+            unmap();
+            throw;
+        }
+        auto base = static_cast<char*>(rings);
+        sq_head    = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+        sq_tail    = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+        sq_mask    = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+        sq_entries = p.sq_entries;
+        cq_head    = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+        cq_tail    = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+        cq_mask    = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+        cqes       = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+        // sqe i always sits at index i
+        auto array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; i++)
+            array[i] = i;
+        tail = *sq_tail;
+    }
+    ~Ring() {unmap();}
+
+    void unmap()
+    {
+        if (sqes)
+            ::munmap(sqes, sqes_size);
+        if (rings)
+            ::munmap(rings, rings_size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    /// The sqe is submitted by the next enter, the ring is sized for the requests in flight
+    io_uring_sqe * get_sqe(uint8_t opcode, int sqe_fd, uint64_t user_data)
+    {
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+            throw transport_error(Errc::internal);
+        auto sqe = &sqes[tail++ & sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = opcode;
+        sqe->fd        = sqe_fd;
+        sqe->user_data = user_data;
+        return sqe;
+    }
+
+    /// Submit the sqes prepared and wait up to timeout for wait_nr completions, -errno on
+    /// failure
+    int enter(unsigned wait_nr, std::chrono::nanoseconds timeout)
+    {
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        const unsigned to_submit = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        __kernel_timespec ts {};
+        ts.tv_sec  = timeout.count() / 1000000000;
+        ts.tv_nsec = timeout.count() % 1000000000;
+        io_uring_getevents_arg arg {};
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts         = reinterpret_cast<uint64_t>(&ts);
+        int r = io_uring_enter(fd, to_submit, wait_nr,
+                               IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        return r < 0 ? -errno : r;
+    }
+
+    template<typename F>
+    void reap(F&& f)
+    {
+        unsigned head = *cq_head;
+        const unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != end; head++)
+            f(cqes[head & cq_mask]);
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    bool supports(std::initializer_list<uint8_t> ops)
+    {
+        constexpr unsigned nb_ops = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + nb_ops * sizeof(io_uring_probe_op));
+        auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, nb_ops) < 0)
+            return false;
+        return std::all_of(ops.begin(), ops.end(), [probe](uint8_t op) {
+            return op <= probe->last_op && probe->ops[op].flags & IO_URING_OP_SUPPORTED;
+        });
+    }
+};
+
+/*
+ * Receive buffers the kernel picks from as data arrives, given back once parsed. A provided
+ * buffer ring gives them back without request; before 5.19, a buffer is provided again by a
+ * request submitted with the next ones.
+ */
+struct RecvBuffers
+{
+    Ring             & ring;
+    io_uring_buf_ring* bufs = nullptr;
+    size_t             bufs_size;
+    char             * data = nullptr;
+    size_t             nb;
+    size_t             size;
+    uint16_t           tail = 0;
+
+    RecvBuffers(Ring& r, size_t count, size_t buffer_size, bool use_ring):
+        ring(r), bufs_size(count * sizeof(io_uring_buf)), nb(count), size(buffer_size)
+    {
+        data = static_cast<char*>(map(nb * size));
+        try {
+            bufs = static_cast<io_uring_buf_ring*>(map(bufs_size));
+        } catch (...) {
+            ::munmap(data, nb * size);
+            throw;
+        }
+        io_uring_buf_reg reg {};
+        reg.ring_addr    = reinterpret_cast<uint64_t>(bufs);
+        reg.ring_entries = nb;
+        reg.bgid         = recv_group;
+        if (!use_ring || io_uring_register(ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            ::munmap(bufs, bufs_size);
+            bufs = nullptr;
+            provide(0, nb);
+            return;
+        }
+        for (size_t i = 0; i < nb; i++)
+            recycle(i);
+    }
+    ~RecvBuffers()
+    {
+        if (bufs) {
+            io_uring_buf_reg reg {};
+            reg.bgid = recv_group;
+            io_uring_register(ring.fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            ::munmap(bufs, bufs_size);
+        }
+        ::munmap(data, nb * size);
+    }
+
+    const char * buffer(uint16_t id) const {return data + id * size;}
+
+    void recycle(uint16_t id)
+    {
+        if (!bufs) {
+            provide(id, 1);
+            return;
+        }
+        // the entries start at the ring, not at bufs->bufs which C++ shifts past an empty
+        // struct; the tail overlays resv of the first entry, which is left alone
+        auto& b = reinterpret_cast<io_uring_buf*>(bufs)[tail & (nb - 1)];
+        b.addr = reinterpret_cast<uint64_t>(buffer(id));
+        b.len  = size;
+        b.bid  = id;
+        __atomic_store_n(&bufs->tail, ++tail, __ATOMIC_RELEASE);
+    }
+
+    void provide(uint16_t id, size_t count)
+    {
+        auto sqe = ring.get_sqe(IORING_OP_PROVIDE_BUFFERS, count, op_provide);
+        sqe->addr      = reinterpret_cast<uint64_t>(buffer(id));
+        sqe->len       = size;
+        sqe->buf_group = recv_group;
+        sqe->off       = id;
+    }
+};
+
+bool available()
+{
+    static const bool ok = [] {
+        try {
+            Ring ring(8);
+            return ring.supports({IORING_OP_RECV, IORING_OP_SEND, IORING_OP_WRITE_FIXED,
+                                  IORING_OP_READ, IORING_OP_PROVIDE_BUFFERS});
+        } catch (std::exception&) {
+            return false;
+        }
+    }();
+    return ok;
+}
+
+Endpoint::Endpoint(common::Logger logger):
+    SocketEndpoint(logger)
+{
+    static_assert((nb_recv_buffers & (nb_recv_buffers - 1)) == 0, "power of 2 ring");
+    event_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (event_fd_ < 0)
+        throw system_error("eventfd");
+}
+
+Endpoint::~Endpoint()
+{
+    stop();
+    if (fd_ >= 0)
+        ::close(fd_);
+    ::close(event_fd_);
+}
+
+void Endpoint::write(Packet&& p, Priority prio)
+{
+    if (!connected_)
+        throw transport_error(Errc::write_while_closed);
+    if (!enqueue_write(std::move(p), prio))
+        throw transport_error(Errc::write_queue_full);
+    // a busy io thread picks the packet up without syscall
+    if (sleeping_.exchange(false)) {
+        ::eventfd_write(event_fd_, 1);
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Stats Endpoint::stats() const
+{
+    return {enters_.load(), wakeups_.load(), sends_.load()};
+}
+
+void Endpoint::attach(int fd)
+{
+    read_pos_         = 0;
+    read_need_        = Packet::min_header_size;
+    read_header_done_ = false;
+    SocketEndpoint::attach(fd);
+}
+
+void Endpoint::interrupt()
+{
+    ::eventfd_write(event_fd_, 1);
+}
+
+void Endpoint::setup()
+{
+    ring_         = std::make_unique<Ring>(ring_entries);
+    recv_buffers_ = std::make_unique<RecvBuffers>(*ring_, nb_recv_buffers, recv_buffer_size,
+                                                  buffer_ring_);
+    send_pool_    = static_cast<char*>(map(nb_send_buffers * send_buffer_size));
+    std::vector<iovec> iov(nb_send_buffers);
+    for (size_t i = 0; i < nb_send_buffers; i++)
+        iov[i] = {send_pool_ + i * send_buffer_size, send_buffer_size};
+    if (io_uring_register(ring_->fd, IORING_REGISTER_BUFFERS, iov.data(), iov.size()) < 0)
+        throw system_error("IORING_REGISTER_BUFFERS");
+    free_send_buffers_.clear();
+    for (size_t i = 0; i < nb_send_buffers; i++)
+        free_send_buffers_.push_back(i);
+    recv_armed_ = false;
+    wake_armed_ = false;
+    multishot_  = true;
+}
+
+void Endpoint::teardown()
+{
+    // the buffers stay until the kernel is done with them
+    close();
+    while (ring_ && (recv_armed_ || sends_in_flight_ > 0)) {
+        ring_->enter(1, time_base_ms);
+        ring_->reap([this](const io_uring_cqe& cqe) {complete(cqe);});
+    }
+    release();
+    recv_buffers_.reset();
+    ring_.reset();
+    if (send_pool_)
+        ::munmap(send_pool_, nb_send_buffers * send_buffer_size);
+    send_pool_ = nullptr;
+}
+
+void Endpoint::release()
+{
+    {
+        std::lock_guard<std::mutex> lk(fd_mutex_);
+        connected_ = false;
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+    // what was not sent went with the connection
+    for (auto& s: sends_queued_)
+        free_send_buffers_.push_back(s.buffer);
+    sends_queued_.clear();
+    has_carry_ = false;
+}
+
+void Endpoint::arm_recv()
+{
+    auto sqe = ring_->get_sqe(IORING_OP_RECV, fd_, op_recv);
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = recv_group;
+    sqe->ioprio    = multishot_ ? IORING_RECV_MULTISHOT : 0;
+    recv_armed_ = true;
+}
+
+void Endpoint::arm_wake()
+{
+    auto sqe = ring_->get_sqe(IORING_OP_READ, event_fd_, op_wake);
+    sqe->addr = reinterpret_cast<uint64_t>(&event_);
+    sqe->len  = sizeof(event_);
+    wake_armed_ = true;
+}
+
+void Endpoint::fill_sends()
+{
+    for (;;) {
+        if (!has_carry_ && !(has_carry_ = dequeue_write(carry_)))
+            return;
+        // the packets coalesce in the last buffer not in flight
+        Send * last = nullptr;
+        if (sends_queued_.size() > sends_in_flight_ && !sends_queued_.back().large)
+            last = &sends_queued_.back();
+        const bool large = carry_.size() > send_buffer_size;
+        if (large || !last || last->size + carry_.size() > send_buffer_size) {
+            // a packet too large for the pool is sent from its own memory, it still takes
+            // a buffer to bound the sends queued
+            if (free_send_buffers_.empty())
+                return;
+            sends_queued_.push_back({});
+            last = &sends_queued_.back();
+            last->buffer = free_send_buffers_.back();
+            free_send_buffers_.pop_back();
+        }
+        if (large) {
+            last->large  = true;
+            last->size   = carry_.size();
+            last->packet = std::move(carry_);
+        } else {
+            std::memcpy(send_pool_ + last->buffer * send_buffer_size + last->size,
+                        carry_.data(), carry_.size());
+            last->size += carry_.size();
+        }
+        has_carry_ = false;
+    }
+}
+
+void Endpoint::submit_sends()
+{
+    // one chain in flight keeps the stream in order, the next one gathers what was queued
+    if (sends_in_flight_ > 0 || sends_queued_.empty())
+        return;
+    for (size_t i = 0; i < sends_queued_.size(); i++) {
+        auto& s = sends_queued_[i];
+        io_uring_sqe * sqe;
+        if (s.large) {
+            sqe = ring_->get_sqe(IORING_OP_SEND, fd_, op_send);
+            sqe->addr      = reinterpret_cast<uint64_t>(s.packet.data() + s.offset);
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        } else {
+            sqe = ring_->get_sqe(IORING_OP_WRITE_FIXED, fd_, op_send);
+            sqe->addr      = reinterpret_cast<uint64_t>(send_pool_ + s.buffer * send_buffer_size
+                                                        + s.offset);
+            sqe->buf_index = s.buffer;
+        }
+        sqe->len = s.size - s.offset;
+        if (i + 1 < sends_queued_.size())
+            sqe->flags = IOSQE_IO_LINK;
+    }
+    sends_in_flight_ = sends_queued_.size();
+    sends_completed_ = 0;
+    sends_.fetch_add(sends_in_flight_, std::memory_order_relaxed);
+}
+
+void Endpoint::complete(const io_uring_cqe& cqe)
+{
+    switch (cqe.user_data) {
+    case op_recv:
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+            recv_armed_ = false;
+        if (cqe.res > 0) {
+            const uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            consume(recv_buffers_->buffer(id), cqe.res);
+            recv_buffers_->recycle(id);
+        } else if (cqe.res == 0) {
+            if (connected_)
+                log_info(logger_, "connection closed by the peer");
+            close();
+        } else if (cqe.res == -EINVAL && multishot_) {
+            // before 6.0, one receive per request
+            multishot_ = false;
+        } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            fail(-cqe.res);
+        }
+        break;
+    case op_send: {
+        auto& s = sends_queued_[sends_completed_++];
+        sends_in_flight_--;
+        if (cqe.res > 0)
+            s.offset += cqe.res;
+        else if (cqe.res != -ECANCELED)
+            fail(-cqe.res);
+        // a short write broke the chain, the rest goes with the next one
+        while (!sends_in_flight_ && !sends_queued_.empty() &&
+               sends_queued_.front().offset == sends_queued_.front().size) {
+            free_send_buffers_.push_back(sends_queued_.front().buffer);
+            sends_queued_.pop_front();
+        }
+        break;
+    }
+    case op_wake:
+        wake_armed_ = false;
+        break;
+    case op_provide:
+        if (cqe.res < 0)
+            log_error(logger_, "cannot provide receive buffers: {}", std::strerror(-cqe.res));
+        break;
+    }
+}
+
+void Endpoint::fail(int err)
+{
+    if (!connected_)
+        return;
+    errc_ = std::error_code(err, std::system_category());
+    log_error(logger_, "{}", errc_.message());
+    close();
+}
+
+void Endpoint::consume(const char * data, size_t size)
+{
+    while (size > 0) {
+        const size_t n = std::min(size, read_need_ - read_pos_);
+        std::memcpy(read_packet_.data() + read_pos_, data, n);
+        read_pos_ += n;
+        data      += n;
+        size      -= n;
+        if (read_pos_ < read_need_)
+            return;
+        try {
+            if (!read_header_done_) {
+                // the version, hence the header size, is known once the shortest header is read
+                if (read_need_ < read_packet_.header_size()) {
+                    read_need_ = read_packet_.header_size();
+                    continue;
+                }
+                read_packet_.parse_header();
+                // large frames do not fit in the inline buffer
+                read_packet_.reserve(read_packet_.size());
+                read_header_done_ = true;
+                read_need_        = read_packet_.size();
+                if (read_pos_ < read_need_)
+                    continue;
+            }
+            read_packet_.parse_payload();
+            if (!read_queue_.try_enqueue(std::move(read_packet_)))
+                throw transport_error(Errc::read_queue_full);
+        } catch (std::exception& e) {
+            log_error(logger_, "{}", e.what());
+        }
+        read_pos_         = 0;
+        read_need_        = Packet::min_header_size;
+        read_header_done_ = false;
+    }
+}
+
+void Endpoint::run()
+{
+    notify_running();
+    // a send to a closed socket from the ring must not kill the process
+    sigset_t pipe;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+    try {
+        setup();
+    } catch (std::system_error& e) {
+        errc_ = e.code();
+        log_error(logger_, "{}", e.what());
+        teardown();
+        return;
+    }
+
+    while (is_running()) {
+        if (fd_ < 0) {
+            connect();
+            continue;
+        }
+        if (!wake_armed_)
+            arm_wake();
+        if (connected_) {
+            if (!recv_armed_)
+                arm_recv();
+            fill_sends();
+            submit_sends();
+        }
+
+        // sleep only if the writers would wake us up
+        sleeping_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool pending = connected_ && write_queue_size() > 0 && !free_send_buffers_.empty();
+        int r = ring_->enter(pending ? 0 : 1, time_base_ms);
+        sleeping_ = false;
+        enters_.fetch_add(1, std::memory_order_relaxed);
+        if (r < 0 && r != -ETIME && r != -EINTR && r != -EBUSY)
+            log_error(logger_, "io_uring_enter: {}", std::strerror(-r));
+        ring_->reap([this](const io_uring_cqe& cqe) {complete(cqe);});
+
+        if (!connected_ && !recv_armed_ && !sends_in_flight_)
+            release();
+    }
+    teardown();
+}
+
+Server::Server(common::Logger logger, uint16_t port):
+    Endpoint(logger)
+{
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    listen(AF_INET, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+Server::Server(common::Logger logger, const std::string& path):
+    Endpoint(logger), path_(path)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw system_error(path, ENAMETOOLONG);
+    path.copy(addr.sun_path, path.size());
+    // a socket file left by a previous run
+    ::unlink(path.c_str());
+    listen(AF_UNIX, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+Server::~Server()
+{
+    stop();
+    ::close(listen_fd_);
+    if (!path_.empty())
+        ::unlink(path_.c_str());
+}
+
+void Server::listen(int domain, const sockaddr * addr, size_t size)
+{
+    listen_fd_ = ::socket(domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+        throw system_error("socket");
+    const int on = 1;
+    if (domain == AF_INET) {
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (::bind(listen_fd_, addr, size) < 0 || ::listen(listen_fd_, 1) < 0) {
+        auto e = system_error("bind");
+        ::close(listen_fd_);
+        throw e;
+    }
+}
+
+Client::Client(common::Logger logger, const std::string& host, const std::string& service):
+    Endpoint(logger), host_(host), service_(service)
+{
+}
+
+Client::Client(common::Logger logger, const std::string& path):
+    Endpoint(logger), path_(path)
+{
+}
+
+Client::~Client()
+{
+    stop();
+}
+
+void Client::open()
+{
+    if (is_open())
+        return;
+    log_debug(logger_, "opening transport...");
+    int fd = -1;
+    if (!path_.empty()) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (path_.size() >= sizeof(addr.sun_path))
+            throw system_error(path_, ENAMETOOLONG);
+        path_.copy(addr.sun_path, path_.size());
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+            auto e = system_error(path_);
+            ::close(fd);
+            throw e;
+        }
+    } else {
+        addrinfo hints {};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo * res;
+        if (int err = ::getaddrinfo(host_.c_str(), service_.c_str(), &hints, &res))
+            throw std::system_error(EHOSTUNREACH, std::system_category(),
+                                    fmt::format("{}: {}", host_, ::gai_strerror(err)));
+        int err = ECONNREFUSED;
+        for (auto ai = res; ai && fd < 0; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+                err = errno;
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(res);
+        if (fd < 0)
+            throw system_error(fmt::format("{}:{}", host_, service_), err);
+    }
+    if (fd < 0)
+        throw system_error("socket");
+    attach(fd);
+}
+
+std::unique_ptr<Transport> make_server(common::Logger logger, uint16_t port)
+{
+    if (available())
+        return std::make_unique<Server>(logger, port);
+    log_info(logger, "io_uring unavailable, using asio");
+    return std::make_unique<tcp::Server>(logger, port);
+}
+
+std::unique_ptr<Transport> make_client(common::Logger logger, const std::string& host,
+                                       const std::string& service)
+{
+    if (available())
+        return std::make_unique<Client>(logger, host, service);
+    log_info(logger, "io_uring unavailable, using asio");
+    return std::make_unique<tcp::Client>(logger, host, service);
+}
+
+} /* namespace uring */
+} /* namespace transport */
+} /* namespace hdcp */
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+
+#include "socket_endpoint.h"
+
+struct io_uring_cqe;
+
+namespace hdcp {
+namespace transport {
+namespace uring {
+
+/// Syscalls of an endpoint, to compare with the reactor of the asio transports
+struct Stats
+{
+    uint64_t enters  = 0; // io_uring_enter calls of the io thread
+    uint64_t wakeups = 0; // eventfd writes waking it for writes
+    uint64_t sends   = 0; // send requests, each of coalesced packets
+};
+
+/// Whether the kernel offers what the endpoints use, io_uring with provided buffers
+bool available();
+
+struct Ring;
+struct RecvBuffers;
+
+/*
+ * Stream socket connection driven by an io_uring owned by its io thread. A multishot receive
+ * fills provided buffers, from a buffer ring since 5.19, that the frames are parsed from. The
+ * written packets are coalesced in registered send buffers and sent by linked requests,
+ * several buffers in one submission; a writer only makes a syscall when the io thread sleeps.
+ * The wire format is the one of the tcp transports, either end can be an asio one.
+ */
+class Endpoint: public SocketEndpoint
+{
+public:
+    ~Endpoint();
+
+    using Transport::write;
+    void  write(Packet&& p, Priority prio) override;
+    Stats stats() const;
+
+protected:
+    static constexpr size_t ring_entries         = 64;
+    static constexpr size_t nb_recv_buffers      = 16;
+    static constexpr size_t recv_buffer_size     = 64 << 10;
+    static constexpr size_t nb_send_buffers      = 8;
+    static constexpr size_t send_buffer_size     = 64 << 10;
+
+    /// False provides the receive buffers by request, as before 5.19
+    bool buffer_ring_ = true;
+
+    Endpoint(common::Logger logger);
+
+    void attach(int fd) override;
+    void interrupt() override;
+
+private:
+    // a send request, from a registered buffer or from a packet too large for them
+    struct Send
+    {
+        int    buffer = -1;
+        bool   large  = false; // sent from packet
+        Packet packet;
+        size_t offset = 0;
+        size_t size   = 0;
+    };
+
+    std::atomic_bool      sleeping_  = false; // the io thread waits in io_uring_enter
+    int                   event_fd_  = -1;
+    uint64_t              event_     = 0;     // read from event_fd_ by the ring
+
+    std::atomic<uint64_t> enters_  = 0;
+    std::atomic<uint64_t> wakeups_ = 0;
+    std::atomic<uint64_t> sends_   = 0;
+
+    // owned by the io thread
+    std::unique_ptr<Ring>        ring_;
+    std::unique_ptr<RecvBuffers> recv_buffers_;
+    char                       * send_pool_ = nullptr;
+    std::vector<int>             free_send_buffers_;
+    std::deque<Send>             sends_queued_;
+    size_t                       sends_in_flight_ = 0;
+    size_t                       sends_completed_ = 0;
+    Packet                       carry_;     // dequeued, did not fit in the last buffer
+    bool                         has_carry_ = false;
+    bool                         recv_armed_ = false;
+    bool                         multishot_  = true;
+    bool                         wake_armed_ = false;
+    Packet                       read_packet_;
+    size_t                       read_pos_  = 0;
+    size_t                       read_need_ = Packet::min_header_size;
+    bool                         read_header_done_ = false;
+
+    void setup();
+    void teardown();
+    void release();
+    void arm_recv();
+    void arm_wake();
+    void fill_sends();
+    void submit_sends();
+    void complete(const io_uring_cqe& cqe);
+    void fail(int err);
+    void consume(const char * data, size_t size);
+    void run() override;
+};
+
+/// Accepts one connection at a time, the next one once the peer left
+class Server: public Endpoint
+{
+public:
+    /// TCP on all the IPv4 interfaces, as tcp::Server; throws std::system_error if port
+    /// cannot be bound
+    Server(common::Logger logger, uint16_t port);
+    /// Unix domain stream socket at path
+    Server(common::Logger logger, const std::string& path);
+    ~Server();
+
+    /// The io thread accepts the connection
+    void open() override {}
+
+private:
+    int         listen_fd_ = -1;
+    std::string path_;
+
+    void listen(int domain, const struct sockaddr * addr, size_t size);
+    void connect() override {accept(listen_fd_);}
+};
+
+class Client: public Endpoint
+{
+public:
+    /// TCP, as tcp::Client
+    Client(common::Logger logger, const std::string& host, const std::string& service);
+    /// Unix domain stream socket at path
+    Client(common::Logger logger, const std::string& path);
+    ~Client();
+
+    /// Throws std::system_error if the peer cannot be reached
+    void open() override;
+
+private:
+    std::string host_;
+    std::string service_;
+    std::string path_;
+};
+
+/// io_uring endpoints when available, the asio ones otherwise
+std::unique_ptr<Transport> make_server(common::Logger logger, uint16_t port);
+std::unique_ptr<Transport> make_client(common::Logger logger, const std::string& host,
+                                       const std::string& service);
+
+} /* namespace uring */
+} /* namespace transport */
+} /* namespace hdcp */
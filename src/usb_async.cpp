@@ -51,18 +51,19 @@ void Transfer::notify_cancelled()
     cv_cancel_.notify_all();
 }
 
-RTransfer::RTransfer(libusb_device_handle * device_handle): device_handle_(device_handle)
+RTransfer::RTransfer(libusb_device_handle * device_handle, size_t size):
+    size_(size), device_handle_(device_handle)
 {
     if (!device_handle)
         throw transport_error(Errc::internal);
 
-    if (!(buf_ = libusb_dev_mem_alloc(device_handle, Packet::max_size)))
+    if (!(buf_ = libusb_dev_mem_alloc(device_handle, size_)))
         throw std::bad_alloc();
 }
 
 RTransfer::~RTransfer()
 {
-    libusb_dev_mem_free(device_handle_, buf_, Packet::max_size);
+    libusb_dev_mem_free(device_handle_, buf_, size_);
 }
 
 void WTransfer::submit()
@@ -73,9 +74,9 @@ void WTransfer::submit()
 
 Device::Device(common::Logger logger, int itfc_nb,
                uint16_t vendor_id, uint16_t product_id,
-               uint8_t in_endoint, uint8_t out_endpoint):
+               uint8_t in_endoint, uint8_t out_endpoint, size_t max_frame_size):
     common::Log(logger), itfc_nb_(itfc_nb), vendor_id_(vendor_id), product_id_(product_id),
-    in_endoint_(in_endoint), out_endpoit_(out_endpoint),
+    in_endoint_(in_endoint), out_endpoit_(out_endpoint), max_frame_size_(max_frame_size),
     usb_logger_(logger->clone("usb_logger"))
 {
     int ret;
@@ -118,8 +119,8 @@ void Device::open()
         throw libusb_error(ret);
 
     wtransfer_      = new WTransfer();
-    rtransfer_curr_ = new RTransfer(device_handle_);
-    rtransfer_prev_ = new RTransfer(device_handle_);
+    rtransfer_curr_ = new RTransfer(device_handle_, max_frame_size_);
+    rtransfer_prev_ = new RTransfer(device_handle_, max_frame_size_);
     fill_transfer(rtransfer_curr_);
     fill_transfer(rtransfer_prev_);
 
@@ -153,14 +154,14 @@ void Device::close()
         throw libusb_error(ret);
 }
 
-void Device::write(Packet&& p)
+void Device::write(Packet&& p, Priority prio)
 {
     if (!is_open())
         throw transport_error(Errc::write_while_closed);
 
     std::lock_guard<std::mutex> lk(mutex_wprogress_);
     if (wtransfer_->in_progress()) {
-        if (!write_queue_.try_enqueue(std::forward<Packet>(p)))
+        if (!enqueue_write(std::forward<Packet>(p), prio))
             throw transport_error(Errc::write_queue_full);
     } else {
         wtransfer_->packet() = std::forward<Packet>(p);
@@ -185,7 +186,7 @@ void Device::fill_transfer(RTransfer * transfer)
         throw transport_error(Errc::internal);
 
     libusb_fill_bulk_transfer(transfer->libusb_transfer_ptr(), device_handle_,
-                              in_endoint_, transfer->get_buffer(), Packet::max_size,
+                              in_endoint_, transfer->get_buffer(), transfer->get_size(),
                               &Device::read_cb, this, timeout_read);
 }
 
@@ -200,7 +201,7 @@ void Device::write_cb(libusb_transfer * transfer) noexcept
                 log_trace(usb->get_logger(), "write {} bytes", transfer->actual_length);
 
                 std::lock_guard<std::mutex> lk(usb->mutex_wprogress_);
-                if (usb->write_queue_.try_dequeue(usb->wtransfer_->packet())) {
+                if (usb->dequeue_write(usb->wtransfer_->packet())) {
                     usb->fill_transfer(usb->wtransfer_);
                     usb->wtransfer_->submit();
                 } else {
@@ -35,13 +35,15 @@ private:
 class RTransfer: public Transfer
 {
 public:
-    RTransfer(libusb_device_handle * device_handle);
+    RTransfer(libusb_device_handle * device_handle, size_t size);
     virtual ~RTransfer();
 
     uint8_t * get_buffer() const {return buf_;};
+    size_t    get_size()   const {return size_;};
 
 private:
     uint8_t * buf_ = nullptr;
+    size_t    size_;
     libusb_device_handle * device_handle_ = nullptr;
 };
 
@@ -64,17 +66,22 @@ private:
 class Device: public common::Log, private common::Thread, public Transport
 {
 public:
+    /// max_frame_size sizes the read buffers, above Packet::max_size with Feature::large_frames
     Device(common::Logger logger, int itfc_nb,
              uint16_t vendor_id, uint16_t product_id,
-             uint8_t in_endpoint, uint8_t out_endpoint);
+             uint8_t in_endpoint, uint8_t out_endpoint,
+             size_t max_frame_size = Packet::max_size);
     virtual ~Device();
 
-    void write(Packet&& p) override;
+    using Transport::write;
+    void write(Packet&& p, Priority prio) override;
     void stop()    override;
     void start()   override;
     bool is_open() override;
     void open()    override;
     void close()   override;
+    /// That of the read buffers
+    size_t max_frame_size() const override {return max_frame_size_;}
 
 private:
     using common::Thread::start;
@@ -93,6 +100,7 @@ private:
     int      itfc_nb_;
     uint16_t vendor_id_, product_id_;
     uint8_t  in_endoint_, out_endpoit_;
+    size_t   max_frame_size_;
 
     void fill_transfer(WTransfer * transfer);
     void fill_transfer(RTransfer * transfer);
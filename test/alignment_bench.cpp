@@ -0,0 +1,72 @@
+#include <cstring>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+using namespace hdcp;
+
+constexpr size_t                    alignments[] = {1, 32};
+constexpr std::chrono::milliseconds duration(500);
+
+template<typename F>
+static double calls_per_s(F&& f)
+{
+    size_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        for (int i = 0; i < 100; i++)
+            f();
+        n += 100;
+    }
+    return n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the dsp stage, vectorized by the compiler
+static float energy(const float * s, size_t n)
+{
+    float e = 0;
+    for (size_t i = 0; i < n; i++)
+        e += s[i] * s[i];
+    return e;
+}
+
+int main()
+{
+    // a full v2 packet of float samples, as a slave streams them
+    const size_t n = (Packet::max_pl_size - Packet::block_header_size(Packet::v2) -
+                      Packet::max_alignment - Packet::make_array(0x2854, sizeof(float), {})
+                      .data.size()) / sizeof(float);
+    std::vector<float> samples(n);
+    for (size_t i = 0; i < n; i++)
+        samples[i] = i * 0.001f;
+    std::string_view elements(reinterpret_cast<char*>(samples.data()), n * sizeof(float));
+
+    for (auto alignment: alignments) {
+        std::vector<Packet::Block> blocks = {Packet::make_array(0x2854, sizeof(float), elements)};
+        Packet p = Packet::make_data(1, blocks, Packet::v2, Packet::Checksum::none, false,
+                                     alignment);
+        std::string_view frame(p.data(), p.size());
+
+        // received frame to dsp result, copying the samples out when they are not aligned
+        volatile float sink = 0;
+        std::vector<float> copy(n);
+        bool in_place = false;
+        double rate = calls_per_s([&]{
+            Packet rx(frame);
+            Packet::ArrayView view;
+            if (!Packet::parse_array(rx.blocks().at(0), view))
+                return;
+            const float * s = view.as<float>();
+            in_place = s;
+            if (!s) {
+                std::memcpy(copy.data(), view.data, view.size() * sizeof(float));
+                s = copy.data();
+            }
+            sink = energy(s, view.size());
+        }) * n;
+
+        std::cout << fmt::format("alignment {}: {} bytes frame, {} samples, {}, {:.0f} M "
+                                 "samples/s\n", alignment, p.size(), n,
+                                 in_place ? "in place" : "copied", rate / 1e6);
+    }
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+using namespace hdcp;
+
+constexpr size_t                    sample_sizes[] = {4, 8};
+constexpr std::chrono::milliseconds duration(500);
+
+template<typename F>
+static double calls_per_s(F&& f)
+{
+    size_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        for (int i = 0; i < 100; i++)
+            f();
+        n += 100;
+    }
+    return n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string sample(size_t i, size_t size)
+{
+    std::string s(size, 0);
+    for (size_t k = 0; k < size; k++)
+        s[k] = i + k;
+    return s;
+}
+
+int main()
+{
+    for (auto size: sample_sizes) {
+        // as many samples as a v1 packet holds, one block each
+        const size_t pl_size = Packet::max_size - Packet::header_size(Packet::v1);
+        std::vector<Packet::Block> blocks;
+        for (size_t used = 0; used + size + Packet::block_header_size(Packet::v1) <= pl_size &&
+             blocks.size() < 0xff; used += size + Packet::block_header_size(Packet::v1))
+            blocks.push_back({0x2854, sample(blocks.size(), size)});
+
+        // the same kind of samples behind one array header
+        const size_t n_array = (pl_size - Packet::make_array(0x2854, size, {}).size()) / size;
+        std::string elements;
+        for (size_t i = 0; i < n_array; i++)
+            elements += sample(i, size);
+        std::vector<Packet::Block> array = {Packet::make_array(0x2854, size, elements)};
+
+        Packet p_blocks = Packet::make_data(1, blocks);
+        Packet p_array  = Packet::make_data(1, array);
+
+        // what a data callback does: read every sample
+        volatile uint64_t sink = 0;
+        double blocks_rate = calls_per_s([&]{
+            for (auto& b: p_blocks.blocks())
+                sink = sink + static_cast<uint8_t>(b.data[0]);
+        }) * blocks.size();
+        double array_rate = calls_per_s([&]{
+            Packet::ArrayView view;
+            for (auto& b: p_array.blocks()) {
+                if (!Packet::parse_array(b, view))
+                    continue;
+                for (size_t i = 0; i < view.size(); i++)
+                    sink = sink + static_cast<uint8_t>(view[i][0]);
+            }
+        }) * n_array;
+
+        std::cout << fmt::format("{} bytes samples: one block each {} per packet, {:.1f} M/s; "
+                                 "array {} per packet, {:.1f} M/s\n", size, blocks.size(),
+                                 blocks_rate / 1e6, n_array, array_rate / 1e6);
+    }
+}
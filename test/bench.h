@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "hdcp/hdcp.h"
+
+/*
+ * Ping and throughput run of the transport benchmarks: a is the device end, b the analysis
+ * one answering pings and counting data. Each benchmark only sets up its transports.
+ */
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t nb_pings   = 10000;
+constexpr size_t nb_packets = 200000;
+constexpr size_t block_size = 1000;
+constexpr size_t window     = 64; // packets in flight, below the write queue size
+
+/// Measures more over the throughput run, what it reports is appended to the line
+struct Probe
+{
+    virtual ~Probe() = default;
+    virtual void        start() {}
+    virtual std::string report(uint64_t /* received */, size_t /* packet_size */,
+                               double /* seconds */)
+    {
+        return {};
+    }
+};
+
+/// A full write queue or ring holds the writer back for a time base, then throws
+inline void write(hdcp::Transport& t, hdcp::Packet&& p)
+{
+    for (;;) {
+        try {
+            t.write(hdcp::Packet(p));
+            return;
+        } catch (hdcp::transport_error&) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void run(const std::string& name, hdcp::Transport& a, hdcp::Transport& b,
+                Probe&& probe = Probe())
+{
+    using hdcp::Packet;
+    std::atomic_bool      running  = true;
+    std::atomic<uint64_t> received = 0;
+    std::thread peer([&] {
+        Packet p;
+        while (running) {
+            if (!b.read(p))
+                continue;
+            if (p.type() == Packet::Type::ka)
+                write(b, Packet::make_keepalive_ack(p.id(), Packet::v2));
+            else
+                received++;
+        }
+    });
+
+    std::vector<double> latencies;
+    Packet p;
+    for (size_t i = 0; i < nb_pings; i++) {
+        auto start = Clock::now();
+        write(a, Packet::make_keepalive(i + 1, Packet::v2));
+        while (!a.read(p)) {}
+        latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count() * 1e6);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::vector<Packet::Block> blocks = {{0x2c00, std::string(block_size, 'd')}};
+    Packet data = Packet::make_data(1, blocks, Packet::v2);
+    probe.start();
+    auto start = Clock::now();
+    for (size_t i = 0; i < nb_packets; i++) {
+        while (i - received >= window)
+            std::this_thread::yield();
+        write(a, Packet(data));
+    }
+    while (received < nb_packets && Clock::now() - start < std::chrono::seconds(10))
+        std::this_thread::yield();
+    double s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << fmt::format("{}: round trip p50 {:.1f} us, p99 {:.1f} us, {:.0f} MB/s{} "
+                             "({} of {} packets)\n", name, latencies[nb_pings / 2],
+                             latencies[nb_pings * 99 / 100], received * data.size() / s / 1e6,
+                             probe.report(received, data.size(), s), received.load(),
+                             nb_packets);
+    running = false;
+    peer.join();
+}
+
+} /* namespace bench */
@@ -0,0 +1,75 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+
+struct Sample
+{
+    uint32_t channel;
+    double   value;
+};
+
+static const Packet::BlockType sample_type = 0x0130;
+static const Packet::BlockType raw_type    = 0x0131;
+
+/// Frame read back as received by a transport
+static Packet received(const Packet& p)
+{
+    return Packet(std::string(p.data(), p.size()));
+}
+
+int main()
+{
+    // values encoded in place and sent without intermediate strings
+    EncodedBlock<Sample> a(sample_type, {1, 2.5});
+    EncodedBlock<Sample> b(sample_type, {2, -1.0});
+    std::vector<Packet::BlockView> views = {a, b};
+    for (auto version: {Packet::v1, Packet::v2}) {
+        Packet p = Packet::make_data(7, views, version);
+        Packet q = received(p);
+        check(q.size() == p.size() && q.id() == 7, "frame built in place parsed back");
+        auto blocks = q.blocks();
+        check(blocks.size() == 2 && blocks[1].data == b.data(), "blocks in order");
+        auto s = q.get<Sample>(sample_type);
+        check(s.size() == 1 && s[0].channel == 1 && s[0].value == 2.5, "first block decoded");
+    }
+
+    // blocks aligned for their values
+    std::vector<double> values = {1.0, 2.0, 3.0};
+    std::string raw(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+    std::vector<Packet::Block> aligned = {{raw_type, "x"}, {raw_type, raw}};
+    Packet p = received(Packet::make_data(1, aligned, Packet::v2, Packet::Checksum::crc32c,
+                                          false, alignof(double)));
+    const double * d = p.blocks().at(1).as<double>();
+    check(d && d[2] == 3.0, "aligned block read in place");
+
+    // a trailing partial value is an error, not a silent truncation
+    std::vector<Packet::Block> partial = {{sample_type, raw.substr(0, sizeof(Sample) + 1)}};
+    bool thrown = false;
+    try {
+        received(Packet::make_data(2, partial, Packet::v2)).get<Sample>(sample_type);
+    } catch (application_error&) {
+        thrown = true;
+    }
+    check(thrown, "partial value rejected");
+
+    // large frames and compressed payloads
+    std::string large(Packet::max_size * 3, 'z');
+    std::vector<Packet::Block> big = {{raw_type, large}};
+    Packet l = received(Packet::make_data(3, big, Packet::v2));
+    check(l.blocks().at(0).data == large, "frame above max_size built in place");
+    Packet c = received(Packet::make_data(4, big, Packet::v2, Packet::Checksum::crc32c, true));
+    check(c.compressed() && c.size() < l.size(), "compressed payload");
+    c.decompress();
+    check(c.blocks().at(0).data == large, "decompressed payload");
+
+    // commands go through the same path
+    std::vector<Packet::BlockView> cmd = {a};
+    Packet k = received(Packet::make_command(5, cmd, Packet::v1));
+    check(k.type() == Packet::Type::cmd && k.blocks().at(0).data == a.data(), "command block");
+
+    return check_status();
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+using appli::slave::BulkReceiver;
+
+static Packet::BulkChunk chunk(uint32_t transfer, uint64_t offset, std::string_view data)
+{
+    return {transfer, 0x0140, 1000, offset, data};
+}
+
+int main()
+{
+    auto now = BulkReceiver::Clock::now();
+    std::string data(100, 'b');
+
+    // an idle transfer is forgotten, the master starts it again from 0
+    BulkReceiver r(std::chrono::milliseconds(100), 4);
+    check(r.receive(chunk(1, 0, data), now).offset == 100, "first chunk");
+    r.expire(now + std::chrono::milliseconds(50));
+    check(r.receive(chunk(1, 0, {}), now).offset == 100, "resumed before the timeout");
+    r.expire(now + std::chrono::milliseconds(200));
+    check(r.receive(chunk(1, 0, {}), now).offset == 0, "forgotten after the timeout");
+    check(r.stats().dropped == 1, "idle transfer dropped");
+
+    // incomplete transfers are bounded, the one idle for the longest time makes room
+    BulkReceiver bounded(std::chrono::milliseconds(1000), 2);
+    bounded.receive(chunk(10, 0, data), now);
+    bounded.receive(chunk(11, 0, data), now + std::chrono::milliseconds(2));
+    bounded.receive(chunk(10, 100, data), now + std::chrono::milliseconds(3));
+    bounded.receive(chunk(12, 0, data), now + std::chrono::milliseconds(4));
+    check(bounded.stats().dropped == 1, "one transfer dropped for a third one");
+    check(bounded.receive(chunk(10, 0, {}), now).offset == 200, "recent transfer kept");
+    check(bounded.receive(chunk(11, 0, {}), now).offset == 0, "idle transfer dropped");
+
+    // chunks are framed in place, large ones as well, and parse back as they were sent
+    std::string large(Packet::max_size * 2, 'l');
+    for (auto v: {std::make_pair(Packet::v1, std::string_view(data)),
+                  std::make_pair(Packet::v2, std::string_view(large))}) {
+        Packet::BulkChunk c = {3, 0x0140, 500 + v.second.size(), 500, v.second};
+        Packet sent = Packet::make_bulk(7, c, v.first);
+        Packet p(std::string_view(sent.data(), sent.size()));
+        c = {};
+        auto blocks = p.blocks();
+        check(blocks.size() == 1 && Packet::parse_bulk(blocks[0], c), "bulk chunk parsed");
+        check(c.transfer == 3 && c.offset == 500 && c.data == v.second, "bulk chunk unchanged");
+
+        uint32_t transfer = 0;
+        uint64_t offset   = 0;
+        Packet ack(Packet::make_bulk_ack(8, 3, 600, v.first));
+        check(Packet::parse_bulk_ack(ack.blocks()[0], transfer, offset) && transfer == 3 &&
+              offset == 600, "bulk ack parsed");
+    }
+
+    auto stats = bounded.stats();
+    std::cout << fmt::format("{} bytes, {} dropped\n", stats.bytes, stats.dropped);
+    return check_status();
+}
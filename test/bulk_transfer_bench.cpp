@@ -0,0 +1,88 @@
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr size_t            transfer_size = 8 << 20; // e.g. a firmware image
+constexpr Packet::BlockType image_type    = 0x2900;
+
+enum class Mode {
+    commands, // one command per chunk, each waiting for its ack to keep the order
+    bulk,
+};
+
+static void run(const std::string& name, Mode mode, double loss)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    auto& mt = *master_transport;
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(Feature::bulk_transfer | Feature::extended_id |
+                                  Feature::large_frames);
+
+    std::string image(transfer_size, 0);
+    for (size_t i = 0; i < image.size(); i++)
+        image[i] = i * 7;
+    std::string received;
+    received.reserve(transfer_size);
+    slave.set_cmd_cb([&](const Packet::BlockView& b) {
+        received.append(b.data);
+    });
+    slave.set_bulk_cb([&](const Packet::BulkChunk& c) {received.append(c.data);});
+    slave.start();
+    master.start();
+    master.connect();
+    mt.set_loss(loss);
+
+    auto start = std::chrono::steady_clock::now();
+    if (mode == Mode::bulk) {
+        appli::master::MemorySource source(image);
+        auto r = master.send_bulk(image_type, source);
+        if (r.status != appli::master::BulkResult::Status::completed)
+            std::cout << fmt::format("{}: interrupted at {}\n", name, r.acked);
+    } else {
+        const size_t chunk_size = master.max_frame_size() - Packet::max_header_size -
+                                  Packet::block_header_size(master.session().version);
+        std::mutex              mutex;
+        std::condition_variable cv;
+        for (size_t offset = 0; offset < image.size(); offset += chunk_size) {
+            bool done = false;
+            master.send_command(image_type, image.substr(offset, chunk_size), [&](Request&) {
+                std::lock_guard<std::mutex> lk(mutex);
+                done = true;
+                cv.notify_one();
+            });
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&]{return done;});
+        }
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = slave.bulk_stats();
+    std::cout << fmt::format("{}: {:.1f} MB/s, {} packets, {} dropped, {} out of order, "
+                             "{}\n", name, transfer_size / s / 1e6,
+                             mt.count(Packet::Type::cmd) + mt.count(Packet::Type::bulk),
+                             mt.dropped(), stats.out_of_order,
+                             received == image ? "intact" : "corrupted");
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    run("command per chunk", Mode::commands, 0);
+    run("bulk", Mode::bulk, 0);
+    run("bulk, 1% loss", Mode::bulk, 0.01);
+}
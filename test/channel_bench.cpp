@@ -0,0 +1,114 @@
+#include <iostream>
+#include <mutex>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr size_t                    nb_sends        = 2000;
+constexpr size_t                    stream_blocks   = 8;    // per telemetry sample
+constexpr size_t                    block_size      = 1000;
+constexpr std::chrono::microseconds stream_cost(20);        // processing of a stream packet
+constexpr uint16_t                  stream_channel    = 1;
+constexpr uint16_t                  telemetry_channel = 2;
+constexpr Packet::BlockType         stream_type       = 0x2a00;
+constexpr Packet::BlockType         telemetry_type    = 0x2a01;
+constexpr std::chrono::milliseconds drain_time(2000);
+
+using Clock = std::chrono::steady_clock;
+
+struct Latency
+{
+    std::mutex mutex;
+    double     sum   = 0;
+    double     max   = 0;
+    uint64_t   count = 0;
+
+    void add(const Packet& p)
+    {
+        auto sent = p.get<int64_t>(telemetry_type);
+        if (sent.empty())
+            return;
+        double us = (Clock::now().time_since_epoch().count() - sent[0]) / 1e3;
+        std::lock_guard<std::mutex> lk(mutex);
+        sum += us;
+        max  = std::max(max, us);
+        count++;
+    }
+};
+
+static void busy(std::chrono::microseconds d)
+{
+    auto end = Clock::now() + d;
+    while (Clock::now() < end) {}
+}
+
+static void run(const std::string& name, bool channels)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(Feature::extended_id | Feature::channels);
+
+    Latency latency;
+    std::atomic<uint64_t> streamed = 0;
+    auto on_stream = [&](const Packet&) {
+        busy(stream_cost);
+        streamed++;
+    };
+    if (channels) {
+        appli::master::ChannelOptions stream;
+        stream.cb = on_stream;
+        master.open_channel(stream_channel, stream);
+        appli::master::ChannelOptions telemetry;
+        telemetry.cb = [&](const Packet& p) {latency.add(p);};
+        master.open_channel(telemetry_channel, telemetry);
+        slave.set_channel_priority(telemetry_channel, Priority::high);
+        slave.set_channel_priority(stream_channel, Priority::low);
+    } else {
+        // one callback on the master thread
+        master.set_data_cb([&](const Packet& p) {
+            if (p.get<int64_t>(telemetry_type).empty())
+                on_stream(p);
+            else
+                latency.add(p);
+        });
+    }
+    slave.start();
+    master.start();
+    master.connect();
+
+    std::vector<Packet::Block> stream(stream_blocks, {stream_type, std::string(block_size, 's')});
+    for (size_t i = 0; i < nb_sends; i++) {
+        slave.send_data(stream, stream_channel);
+        int64_t now = Clock::now().time_since_epoch().count();
+        std::vector<Packet::Block> telemetry = {
+            {telemetry_type, std::string(reinterpret_cast<char*>(&now), sizeof(now))}};
+        slave.send_data(telemetry, telemetry_channel);
+    }
+    std::this_thread::sleep_for(drain_time);
+
+    std::lock_guard<std::mutex> lk(latency.mutex);
+    std::cout << fmt::format("{}: telemetry latency mean {:.0f} us, max {:.0f} us, "
+                             "{} telemetry and {} stream packets received\n", name,
+                             latency.sum / std::max<uint64_t>(latency.count, 1), latency.max,
+                             latency.count, streamed.load());
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    run("one data callback", false);
+    run("one thread per channel", true);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+/*
+ * Checks of the benchmarks: a failed one is reported and turns the exit status of the
+ * program into a failure once it returns check_status() from main, so that ctest runs them
+ * as tests.
+ */
+inline int& check_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void check(bool condition, std::string_view what)
+{
+    if (condition)
+        return;
+    std::cerr << "check failed: " << what << std::endl;
+    check_failures()++;
+}
+
+inline int check_status()
+{
+    return check_failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "../src/checksum.h"
+
+using namespace hdcp;
+
+constexpr size_t                    frame_sizes[] = {Packet::max_size, 64 << 10};
+constexpr std::chrono::milliseconds duration(500);
+
+template<typename F>
+static double bytes_per_s(size_t bytes, F&& f)
+{
+    size_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        for (int i = 0; i < 100; i++)
+            f();
+        n += 100;
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return n * bytes / s;
+}
+
+int main()
+{
+    std::cout << fmt::format("crc32c hardware: {}\n", checksum::crc32c_hardware());
+
+    for (auto frame_size: frame_sizes) {
+        const size_t size = frame_size - Packet::max_header_size -
+                            Packet::block_header_size(Packet::v2);
+        std::string data(size, 0);
+        for (size_t i = 0; i < size; i++)
+            data[i] = i * 31;
+
+        // raw algorithms
+        volatile uint32_t sink = 0;
+        double fletcher = bytes_per_s(size, [&]{sink = checksum::fletcher16(data);});
+        double crc_sw   = bytes_per_s(size, [&]{sink = checksum::crc32c_software(data);});
+        double crc      = bytes_per_s(size, [&]{sink = checksum::crc32c(data);});
+        std::cout << fmt::format("{} bytes: fletcher16 {:.0f} MB/s, crc32c software {:.0f} MB/s, "
+                                 "crc32c {:.0f} MB/s\n", size, fletcher / 1e6, crc_sw / 1e6,
+                                 crc / 1e6);
+
+        // whole frames validated as a transport does
+        std::vector<Packet::Block> blocks = {{0x2854, data}};
+        const std::pair<const char*, Packet::Checksum> modes[] = {
+            {"fletcher16", Packet::Checksum::fletcher16},
+            {"crc32c", Packet::Checksum::crc32c},
+            {"none", Packet::Checksum::none},
+        };
+        for (auto& [name, mode]: modes) {
+            Packet p = Packet::make_data(1, blocks, Packet::v2, mode);
+            std::string_view frame(p.data(), p.size());
+            double rate = bytes_per_s(frame.size(), [&]{Packet parsed(frame);});
+            std::cout << fmt::format("  frame {} validated with {}: {:.0f} MB/s\n", frame_size,
+                                     name, rate / 1e6);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "../src/checksum.h"
+
+#include "check.h"
+
+using namespace hdcp;
+
+static Packet data_packet(Packet::Checksum checksum)
+{
+    std::vector<Packet::Block> blocks = {{0x2854, "payload"}};
+    return Packet::make_data(1, blocks, Packet::v2, checksum);
+}
+
+int main()
+{
+    std::cout << fmt::format("crc32c hardware: {}\n", checksum::crc32c_hardware());
+
+    // check values of the reference string
+    check(checksum::crc32c("123456789") == 0xe3069283, "crc32c check value");
+    check(checksum::crc32c_software("123456789") == 0xe3069283, "crc32c software check value");
+    check(checksum::crc32c({}) == 0, "crc32c of nothing");
+
+    // every length and misalignment goes through the hardware head, body and tail loops
+    std::string data(4096 + 64, 0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 31 + 7);
+    bool same = true;
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len = 0; len < 300; len++) {
+            auto v = std::string_view(data).substr(offset, len);
+            same &= checksum::crc32c(v) == checksum::crc32c_software(v);
+        }
+        auto v = std::string_view(data).substr(offset, 4096);
+        same &= checksum::crc32c(v) == checksum::crc32c_software(v);
+    }
+    check(same, "hardware and software crc32c agree");
+    auto whole = std::string_view(data).substr(0, 1000);
+    check(checksum::crc32c(whole.substr(300), checksum::crc32c(whole.substr(0, 300))) ==
+          checksum::crc32c(whole), "crc32c continued");
+
+    // packets are only accepted with a checksum of the session
+    Session session;
+    check(session.accepts(data_packet(Packet::Checksum::fletcher16)), "fletcher16 accepted");
+    check(!session.accepts(data_packet(Packet::Checksum::crc32c)), "crc32c not agreed");
+    check(!session.accepts(data_packet(Packet::Checksum::none)), "none not agreed");
+    session.checksums |= checksum_bit(Packet::Checksum::crc32c);
+    check(session.accepts(data_packet(Packet::Checksum::crc32c)), "crc32c agreed");
+    check(session.accepts(Packet::make_keepalive(1)), "v1 packets accepted");
+
+    // a corrupted payload does not make a packet
+    for (auto c: {Packet::Checksum::fletcher16, Packet::Checksum::crc32c}) {
+        Packet p = data_packet(c);
+        std::string frame(p.data(), p.size());
+        frame.back() ^= 0x01;
+        bool rejected = false;
+        try {
+            Packet q(frame);
+        } catch (packet_error&) {
+            rejected = true;
+        }
+        check(rejected, fmt::format("corruption detected by checksum {}", static_cast<int>(c)));
+    }
+    return check_status();
+}
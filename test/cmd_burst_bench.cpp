@@ -0,0 +1,84 @@
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+#include "check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr int nb_bursts    = 20;
+constexpr int nb_commands  = 500;
+constexpr size_t cmd_size  = 8;
+
+static void run(Features features)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    auto& mt = *master_transport;
+    auto& st = *slave_transport;
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(features);
+    slave.set_cmd_cb([](const Packet::BlockView&) {});
+    slave.start();
+    master.start();
+    master.connect();
+    mt.reset_counters();
+    st.reset_counters();
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    int                     remaining;
+    int                     fulfilled = 0;
+    auto cb = [&](Request& r) {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (r.get_status() == Request::Status::fulfilled)
+            fulfilled++;
+        if (--remaining == 0)
+            cv.notify_one();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nb_bursts; i++) {
+        remaining = nb_commands;
+        std::vector<Command> cmds(nb_commands, {0x0110, std::string(cmd_size, 'c'), cb});
+        if (features & Feature::cmd_batching) {
+            master.send_commands(cmds);
+        } else {
+            for (auto& c: cmds)
+                master.send_command(c.type, c.data, c.cb);
+        }
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&]{return remaining == 0;});
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fmt::format("features {:#x}: {:.0f} commands/s, {} cmd packets, "
+                             "{} cmd_ack packets\n",
+                             master.features(), nb_bursts * nb_commands / s,
+                             mt.count(Packet::Type::cmd), st.count(Packet::Type::cmd_ack));
+    check(fulfilled == nb_bursts * nb_commands, "every command acked");
+    if (features & Feature::cmd_batching) {
+        check(mt.count(Packet::Type::cmd) < nb_bursts * nb_commands / 10, "commands coalesced");
+        check(st.count(Packet::Type::cmd_ack) <= mt.count(Packet::Type::cmd),
+              "at most one ack per command packet");
+    }
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    run(0);
+    run(Feature::cmd_batching);
+    return check_status();
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+using appli::slave::CommandCache;
+
+static Packet batch(Packet::Id id, const std::vector<std::string>& data)
+{
+    std::vector<Packet::Block> blocks;
+    for (auto& d: data)
+        blocks.push_back({0x0110, d});
+    std::vector<Packet::BlockView> views(blocks.begin(), blocks.end());
+    return Packet::make_command(id, views, Packet::v2);
+}
+
+/// Command block of a coalesced packet sent again alone, as the master does
+static Packet retry(Packet::Id id, const Packet& origin, uint8_t block)
+{
+    auto r = Packet::make_cmd_retry(origin.id(), block, Packet::v2);
+    std::vector<Packet::BlockView> views = {Packet::BlockView(r), origin.blocks().at(block)};
+    return Packet::make_command(id, views, Packet::v2);
+}
+
+int main()
+{
+    CommandCache cache(8);
+    std::vector<std::string> responses;
+
+    auto p = batch(1, {"a", "b", "c"});
+    check(cache.lookup(p, responses) == CommandCache::Lookup::miss, "new commands");
+    check(cache.lookup(p, responses) == CommandCache::Lookup::pending, "commands in progress");
+    cache.complete(p, {"ra", "rb", "rc"});
+    check(cache.lookup(p, responses) == CommandCache::Lookup::hit, "executed commands");
+    check(responses == std::vector<std::string>({"ra", "rb", "rc"}), "responses remembered");
+
+    // the retried command keeps its original identity
+    auto q = retry(2, p, 1);
+    check(cache.lookup(q, responses) == CommandCache::Lookup::hit, "retried command executed");
+    check(responses.size() == 2 && responses[0].empty() && responses[1] == "rb",
+          "response of the retried command");
+
+    // a retry of a command never received is executed once
+    auto lost = batch(3, {"d", "e"});
+    auto r = retry(4, lost, 1);
+    check(cache.lookup(r, responses) == CommandCache::Lookup::miss, "retry of a lost command");
+    check(cache.lookup(r, responses) == CommandCache::Lookup::pending, "retry in progress");
+    cache.complete(r, {"", "re"});
+    check(cache.lookup(r, responses) == CommandCache::Lookup::hit && responses[1] == "re",
+          "retry executed");
+    // the rest of the packet would run a command twice
+    check(cache.lookup(lost, responses) == CommandCache::Lookup::pending, "partly executed packet");
+
+    // a wrapped id with another payload is a new command
+    auto wrapped = batch(1, {"x"});
+    check(cache.lookup(wrapped, responses) == CommandCache::Lookup::miss, "wrapped id");
+    check(cache.size() == 4, "wrapped id replaces the entry");
+
+    // replaced and evicted entries leave nothing behind
+    for (Packet::Id id = 10; id < 100; id++) {
+        auto c = batch(id % 20, {std::to_string(id)});
+        cache.lookup(c, responses);
+        cache.complete(c, {"r"});
+    }
+    check(cache.size() == 8, "bounded size");
+    check(cache.lookup(p, responses) == CommandCache::Lookup::miss, "oldest commands evicted");
+
+    auto stats = cache.stats();
+    std::cout << fmt::format("{} lookups, {} hits, {} pending\n", stats.lookups, stats.hits,
+                             stats.pending);
+    return check_status();
+}
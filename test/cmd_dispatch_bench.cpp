@@ -0,0 +1,83 @@
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr int                       nb_commands = 2000;
+constexpr int                       window      = 32;  // commands in flight on the master
+constexpr int                       slow_ratio  = 20;  // one slow command every slow_ratio
+constexpr Packet::BlockType         fast_cmd    = 0x0110;
+constexpr Packet::BlockType         slow_cmd    = 0x0120;
+constexpr std::chrono::milliseconds slow_duration(10);
+
+static void run(const std::string& name, const appli::slave::DispatcherOptions& opts,
+                appli::slave::Ordering ordering)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    slave.set_dispatcher_options(opts);
+    slave.set_default_cmd_ordering(ordering);
+    slave.set_cmd_cb([](const Packet::BlockView& b) {
+        if (b.type == slow_cmd)
+            std::this_thread::sleep_for(slow_duration);
+    });
+    slave.start();
+    master.start();
+    master.connect();
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    int                     in_flight = 0;
+    int                     failed    = 0;
+    auto cb = [&](Request& r) {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (r.get_status() != Request::Status::fulfilled)
+            failed++;
+        in_flight--;
+        cv.notify_one();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nb_commands; i++) {
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&]{return in_flight < window;});
+            in_flight++;
+        }
+        master.send_command(i % slow_ratio ? fast_cmd : slow_cmd, "cmd", cb);
+    }
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]{return in_flight == 0;});
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fmt::format("{}: {:.0f} commands/s, {} failed\n",
+                             name, nb_commands / s, failed);
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    using namespace appli::slave;
+    DispatcherOptions workers;
+    workers.workers = 4;
+    DispatcherOptions on_reception = workers;
+    on_reception.ack = AckPolicy::on_reception;
+    run("synchronous", {}, Ordering::sequential);
+    run("4 workers, sequential per type", workers, Ordering::sequential);
+    run("4 workers, concurrent", workers, Ordering::concurrent);
+    run("4 workers, concurrent, ack on reception", on_reception, Ordering::concurrent);
+}
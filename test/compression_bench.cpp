@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "hdcp/hdcp.h"
+
+using namespace hdcp;
+
+constexpr std::chrono::milliseconds duration(500);
+constexpr double                    usb_fs_rate = 1.0e6; // bulk bytes/s on a full-speed link
+
+template<typename F>
+static double calls_per_s(F&& f)
+{
+    size_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        for (int i = 0; i < 100; i++)
+            f();
+        n += 100;
+    }
+    return n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// slowly varying 16 bit samples with a little noise, as our sensors send
+static std::string sensor_payload(size_t size)
+{
+    std::mt19937 rng(42);
+    std::normal_distribution<double> noise(0, 2);
+    std::string data(size, 0);
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        int16_t v = 1000 * std::sin(i / 200.0) + noise(rng);
+        std::memcpy(&data[i], &v, sizeof(v));
+    }
+    return data;
+}
+
+static std::string random_payload(size_t size)
+{
+    std::mt19937 rng(42);
+    std::string data(size, 0);
+    for (auto& c: data)
+        c = rng();
+    return data;
+}
+
+static void run(const std::string& name, const std::string& data)
+{
+    std::vector<Packet::Block> blocks = {{0x2854, data}};
+    Packet raw  = Packet::make_data(1, blocks, Packet::v2);
+    Packet comp = Packet::make_data(1, blocks, Packet::v2, Packet::Checksum::fletcher16, true);
+    const double ratio = static_cast<double>(comp.size()) / raw.size();
+
+    // cpu cost on each end, per raw byte
+    double encode = calls_per_s([&]{
+        Packet::make_data(1, blocks, Packet::v2, Packet::Checksum::fletcher16, true);
+    }) * data.size();
+    std::string_view frame(comp.data(), comp.size());
+    double decode = calls_per_s([&]{
+        Packet p(frame);
+        p.decompress();
+    }) * data.size();
+
+    // the link or the slowest end limits the stream
+    double effective = std::min({usb_fs_rate / ratio, encode, decode});
+    std::cout << fmt::format("{}: {} -> {} bytes ({:.0f}%), encode {:.0f} MB/s, "
+                             "decode {:.0f} MB/s, full-speed usb {:.2f} -> {:.2f} MB/s\n",
+                             name, raw.size(), comp.size(), 100 * ratio, encode / 1e6,
+                             decode / 1e6, usb_fs_rate / 1e6, effective / 1e6);
+}
+
+int main()
+{
+    const size_t size = Packet::max_pl_size - Packet::block_header_size(Packet::v2);
+    run("sensor", sensor_payload(size));
+    run("random", random_payload(size));
+}
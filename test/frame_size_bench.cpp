@@ -0,0 +1,87 @@
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr size_t                total_bytes = 256 << 20;
+constexpr std::chrono::seconds  max_duration(20);
+constexpr uint16_t              base_port   = 4850;
+
+/*
+ * Streams total_bytes of data from the slave to the master in frames of frame_size bytes and
+ * reports the throughput seen by the master. Frames above Packet::max_size are negotiated
+ * with Feature::large_frames.
+ */
+static void run(const std::string& name, std::unique_ptr<Transport> master_transport,
+                std::unique_ptr<Transport> slave_transport, size_t frame_size)
+{
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    Features features = Feature::extended_id;
+    if (frame_size > Packet::max_size)
+        features |= Feature::large_frames;
+    master.set_requested_features(features);
+    master.set_max_frame_size(frame_size);
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    size_t                  received = 0;
+    master.set_data_cb([&](const Packet& p) {
+        std::lock_guard<std::mutex> lk(mutex);
+        for (auto& b: p.blocks())
+            received += b.data.size();
+        cv.notify_one();
+    });
+    slave.start();
+    master.start();
+    master.connect();
+
+    const size_t block_size = master.max_frame_size() - Packet::max_header_size -
+                              Packet::block_header_size(Packet::v2);
+    std::vector<Packet::Block> blocks = {{0x2854, std::string(block_size, 'a')}};
+    const size_t nb_frames = total_bytes / block_size;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nb_frames; i++)
+        slave.send_data(blocks);
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait_for(lk, max_duration, [&]{return received >= nb_frames * block_size;});
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fmt::format("{}, frame {} (agreed {}): {:.1f} MB/s, {} frames lost\n",
+                             name, frame_size, master.max_frame_size(), received / s / 1e6,
+                             nb_frames - received / block_size);
+    lk.unlock();
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    const std::vector<size_t> frame_sizes = {Packet::max_size, 16 << 10, 64 << 10,
+                                             Packet::max_frame_size};
+    for (auto f: frame_sizes) {
+        auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+        run("loopback", std::move(master_transport), std::move(slave_transport), f);
+    }
+
+    uint16_t port = base_port;
+    for (auto f: frame_sizes) {
+        auto slave_transport  = std::make_unique<transport::tcp::Server>(logger, port);
+        auto master_transport = std::make_unique<transport::tcp::Client>(logger, "localhost",
+                                                                         std::to_string(port));
+        run("tcp loopback", std::move(master_transport), std::move(slave_transport), f);
+        port++;
+    }
+}
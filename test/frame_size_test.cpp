@@ -0,0 +1,77 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+#include "check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+/// Loopback end receiving frames of Packet::max_size at most, as a usb device by default
+class SmallFrames: public Transport
+{
+public:
+    explicit SmallFrames(std::unique_ptr<Transport> t): t_(std::move(t)) {}
+
+    using Transport::write;
+    void write(Packet&& p, Priority prio) override {t_->write(std::move(p), prio);}
+    bool read(Packet& p) override {return t_->read(p);}
+    size_t read_queue_size() const override {return t_->read_queue_size();}
+    void clear_queues() override {t_->clear_queues();}
+    void set_session(const Session& s) override {t_->set_session(s);}
+    void start()   override {t_->start();}
+    void stop()    override {t_->stop();}
+    bool is_open() override {return t_->is_open();}
+    void open()    override {t_->open();}
+    void close()   override {t_->close();}
+
+private:
+    std::unique_ptr<Transport> t_;
+};
+
+static Session run(bool small_slave, size_t requested = 0)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    std::unique_ptr<Transport> st = std::move(slave_transport);
+    if (small_slave)
+        st = std::make_unique<SmallFrames>(std::move(st));
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(st));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(Feature::extended_id | Feature::large_frames |
+                                  Feature::reliable_data);
+    if (requested)
+        master.set_max_frame_size(requested);
+    slave.start();
+    master.start();
+    master.connect();
+    Session s = master.session();
+    std::cout << s << std::endl;
+    check(s.max_frame_size == slave.session().max_frame_size, "both ends agree");
+    master.stop();
+    slave.stop();
+    return s;
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    auto large = run(false);
+    check(large.max_frame_size == Packet::max_frame_size, "default from the transport");
+    check(large.features & Feature::large_frames, "large frames agreed");
+    check(large.window * large.max_frame_size <= data_ring_bytes, "ring bounded in bytes");
+
+    auto small = run(true);
+    check(small.max_frame_size == Packet::max_size, "slave transport limits the frames");
+    check(!(small.features & Feature::large_frames), "large frames refused");
+    check(small.window == data_ring_size, "full ring of small frames");
+
+    auto lowered = run(false, 64 << 10);
+    check(lowered.max_frame_size == 64 << 10, "frame size lowered by the application");
+    return check_status();
+}
@@ -0,0 +1,180 @@
+#include <cstring>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+
+constexpr std::chrono::milliseconds duration(500);
+constexpr size_t                    nb_types  = 8;
+constexpr size_t                    nb_blocks = 64; // data blocks per packet
+constexpr Packet::BlockType         base_type = 0x2800;
+
+struct Sample
+{
+    uint32_t time;
+    float    value;
+};
+
+struct SetGain
+{
+    static constexpr Packet::BlockType block_type = 0x0110;
+    uint8_t channel;
+    float   gain;
+};
+
+template<> struct hdcp::BlockCodec<SetGain>:
+    hdcp::FieldCodec<SetGain, &SetGain::channel, &SetGain::gain> {};
+
+template<typename F>
+static double ns_per_call(F&& f)
+{
+    size_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        for (int i = 0; i < 100; i++)
+            f();
+        n += 100;
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+           .count() / n;
+}
+
+static void data_dispatch()
+{
+    std::vector<Packet::Block> blocks;
+    for (size_t i = 0; i < nb_blocks; i++) {
+        Sample s {static_cast<uint32_t>(i), i * 0.5f};
+        blocks.push_back({static_cast<Packet::BlockType>(base_type + i % nb_types),
+                          std::string(reinterpret_cast<char*>(&s), sizeof(s))});
+    }
+    Packet p = Packet::make_data(1, blocks);
+
+    // what a data callback does today
+    float sums[nb_types] = {};
+    double user = ns_per_call([&]{
+        for (auto& b: p.blocks()) {
+            Sample s;
+            std::memcpy(&s, b.data.data(), sizeof(s));
+            switch (b.type) {
+            case base_type + 0: sums[0] += s.value; break;
+            case base_type + 1: sums[1] += s.value; break;
+            case base_type + 2: sums[2] += s.value; break;
+            case base_type + 3: sums[3] += s.value; break;
+            case base_type + 4: sums[4] += s.value; break;
+            case base_type + 5: sums[5] += s.value; break;
+            case base_type + 6: sums[6] += s.value; break;
+            case base_type + 7: sums[7] += s.value; break;
+            default: break;
+            }
+        }
+    });
+
+    // as Master::on_data<Sample> dispatches
+    HandlerTable<DataHandler> table;
+    for (size_t i = 0; i < nb_types; i++)
+        table.set(base_type + i, make_data_handler<Sample>([&, i](const Sample& s) {
+            sums[i] += s.value;
+        }));
+    double typed = ns_per_call([&]{
+        p.for_each_block([&](const Packet::BlockView& b) {
+            if (auto handler = table.find(b.type))
+                (*handler)(b);
+        });
+    });
+
+    std::cout << fmt::format("data, {} blocks of {} types: switch {:.0f} ns/packet, "
+                             "handler table {:.0f} ns/packet\n", nb_blocks, nb_types, user,
+                             typed);
+}
+
+static void command_dispatch()
+{
+    SetGain cmd {3, 1.5f};
+    std::string arg(BlockCodec<SetGain>::size, '\0');
+    BlockCodec<SetGain>::encode(cmd, arg.data());
+    Packet p = Packet::make_command(1, SetGain::block_type, arg);
+    auto b = p.blocks().at(0);
+
+    float gains[8] = {};
+    volatile size_t sink = 0;
+    double user = ns_per_call([&]{
+        std::string response;
+        switch (b.type) {
+        case SetGain::block_type: {
+            uint8_t channel;
+            float   gain;
+            std::memcpy(&channel, b.data.data(), sizeof(channel));
+            std::memcpy(&gain, b.data.data() + sizeof(channel), sizeof(gain));
+            gains[channel % 8] = gain;
+            response.assign(reinterpret_cast<char*>(&gain), sizeof(gain));
+            break;
+        }
+        default:
+            break;
+        }
+        sink = response.size();
+    });
+
+    // as Slave::on_command<SetGain> dispatches
+    HandlerTable<CommandHandler> table;
+    table.set(SetGain::block_type, make_command_handler<SetGain>([&](const SetGain& c) {
+        gains[c.channel % 8] = c.gain;
+        return c.gain;
+    }));
+    double typed = ns_per_call([&]{
+        if (auto handler = table.find(b.type))
+            sink = (*handler)(b).size();
+    });
+
+    std::cout << fmt::format("command: switch {:.1f} ns, handler table {:.1f} ns\n", user,
+                             typed);
+}
+
+template<typename F>
+static bool throws_invalid_size(F&& f)
+{
+    try {
+        f();
+    } catch (application_error& e) {
+        return e.code() == appli::Errc::invalid_block_size;
+    }
+    return false;
+}
+
+static void table_checks()
+{
+    HandlerTable<DataHandler> table;
+    check(table.empty(), "empty table");
+    table.set(base_type, [](const Packet::BlockView&) {});
+    table.set(base_type, [](const Packet::BlockView&) {});
+    check(table.size() == 1, "replaced handler counted once");
+    table.set(base_type + 1, nullptr);
+    check(table.size() == 1 && !table.find(base_type + 1), "empty handler not registered");
+    table.erase(base_type);
+    check(table.empty() && !table.find(base_type), "empty once erased");
+
+    // blocks not made of whole values are an error for data as for commands
+    auto data = make_data_handler<Sample>([](const Sample&) {});
+    std::vector<Packet::Block> blocks = {{base_type, std::string(sizeof(Sample) + 1, '\0')},
+                                         Packet::make_array(base_type, 2, std::string(8, 0))};
+    Packet p = Packet::make_data(1, blocks);
+    check(throws_invalid_size([&]{data(p.blocks().at(0));}), "partial data value");
+    check(throws_invalid_size([&]{data(p.blocks().at(1));}), "short array elements");
+    auto command = make_command_handler<SetGain>([](const SetGain&) {});
+    Packet c = Packet::make_command(3, SetGain::block_type, "x");
+    check(throws_invalid_size([&]{command(c.blocks().at(0));}), "short command");
+    Packet l = Packet::make_command(4, SetGain::block_type,
+                                    std::string(BlockCodec<SetGain>::size + 1, '\0'));
+    check(throws_invalid_size([&]{command(l.blocks().at(0));}), "trailing command bytes");
+}
+
+int main()
+{
+    table_checks();
+    data_dispatch();
+    command_dispatch();
+    return check_status();
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+#include "check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr std::chrono::seconds      duration(10);
+constexpr std::chrono::microseconds data_period(500);
+constexpr std::chrono::milliseconds cmd_period(20);
+
+/// Keepalives per second while the slave streams, with or without commands from the master
+static double run(Features features, bool commands)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    auto& mt = *master_transport;
+    auto& st = *slave_transport;
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(features);
+    slave.start();
+    master.start();
+    master.connect();
+    // the first ka goes out with the connection
+    std::this_thread::sleep_for(time_base_ms);
+    mt.reset_counters();
+    st.reset_counters();
+
+    std::vector<Packet::Block> blocks = {{0x2854, std::string(1000, 'a')}};
+    auto start = std::chrono::steady_clock::now();
+    auto next_cmd = start;
+    while (std::chrono::steady_clock::now() - start < duration) {
+        slave.send_data(blocks);
+        if (commands && std::chrono::steady_clock::now() >= next_cmd) {
+            master.send_command(0x0110, "set", [](Request&){});
+            next_cmd += cmd_period;
+        }
+        std::this_thread::sleep_for(data_period);
+    }
+
+    double s = std::chrono::duration<double>(duration).count();
+    uint64_t ka     = mt.count(Packet::Type::ka);
+    uint64_t ka_ack = st.count(Packet::Type::ka_ack);
+    std::cout << fmt::format("features {:#x}, {}: data {:.0f}/s, cmd {:.0f}/s, "
+                             "ka {:.1f}/s, ka_ack {:.1f}/s -> control {:.1f}/s\n",
+                             master.features(), commands ? "commands" : "no command",
+                             st.count(Packet::Type::data)/s, mt.count(Packet::Type::cmd)/s,
+                             ka/s, ka_ack/s, (ka + ka_ack)/s);
+    check(master.state() == appli::Master::State::connected, "connection kept");
+
+    master.stop();
+    slave.stop();
+    return ka/s;
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::warn);
+
+    run(0, true);
+    run(Feature::passive_keepalive, true);
+    const double active  = run(0, false);
+    const double passive = run(Feature::passive_keepalive, false);
+    check(active > 0, "ka sent by an idle master in active mode");
+    check(passive == 0, "no ka while the slave streams in passive mode");
+    return check_status();
+}
@@ -0,0 +1,72 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr size_t      bulk_size   = 64 << 20;
+constexpr uint16_t    tcp_port    = 9312;
+constexpr const char* socket_path = "/tmp/hdcp_local_bench.sock";
+
+// a bulk buffer handed off as a memfd, mapped by the peer instead of copied in frames
+static void run_handoff(transport::local::Endpoint& a, transport::local::Endpoint& b)
+{
+    int fd = memfd_create("bulk", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, bulk_size) < 0)
+        throw std::system_error(errno, std::system_category(), "memfd");
+    auto buffer = static_cast<char*>(mmap(nullptr, bulk_size, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED, fd, 0));
+    std::fill(buffer, buffer + bulk_size, 'b');
+
+    auto start = bench::Clock::now();
+    a.write(Packet::make_keepalive(1, Packet::v2), fd);
+    Packet p;
+    while (!b.read(p)) {}
+    int passed = b.take_fd(p.id());
+    auto mapped = static_cast<const char*>(mmap(nullptr, bulk_size, PROT_READ, MAP_SHARED,
+                                                passed, 0));
+    size_t sum = 0;
+    for (size_t i = 0; i < bulk_size; i += 4096)
+        sum += mapped[i];
+    double s = std::chrono::duration<double>(bench::Clock::now() - start).count();
+
+    std::cout << fmt::format("local, {} MiB memfd handoff: {:.1f} us ({})\n", bulk_size >> 20,
+                             s * 1e6, sum == bulk_size / 4096 * 'b' ? "ok" : "corrupted");
+    munmap(const_cast<char*>(mapped), bulk_size);
+    munmap(buffer, bulk_size);
+    close(passed);
+    close(fd);
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    {
+        transport::tcp::Server server(logger, tcp_port);
+        server.start();
+        transport::tcp::Client client(logger, "localhost", std::to_string(tcp_port));
+        client.start();
+        while (!server.is_open())
+            std::this_thread::yield();
+        bench::run("tcp localhost", server, client);
+        client.stop();
+        server.stop();
+    }
+    {
+        transport::local::Server server(logger, socket_path);
+        server.start();
+        transport::local::Client client(logger, socket_path);
+        client.start();
+        while (!server.is_open())
+            std::this_thread::yield();
+        bench::run("local seqpacket", server, client);
+        run_handoff(server, client);
+        client.stop();
+        server.stop();
+    }
+}
@@ -0,0 +1,60 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "transport_check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr const char* socket_path = "/tmp/hdcp_local_test.sock";
+// a frame is one message of the socket buffer, which net.core.wmem_max bounds to 208 KiB by
+// default
+constexpr size_t largest = 100 << 10;
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    transport::local::Server server(logger, socket_path);
+    transport::local::Client client(logger, socket_path);
+    set_large_frames(server);
+    set_large_frames(client);
+    server.start();
+    client.start();
+    check(wait_until([&] {return server.is_open() && client.is_open();}), "connected");
+    check_frames("local", server, client, largest);
+    check_frames("local, other way", client, server, largest);
+
+    // the descriptor travels with its packet, after the ones written before it
+    int fd = memfd_create("bulk", MFD_CLOEXEC);
+    check(fd >= 0 && ::write(fd, "bulk", 4) == 4, "memfd");
+    server.write(make_frame(1, 100));
+    server.write(make_frame(2, 100), fd);
+    close(fd);
+    Packet p;
+    check(wait_until([&] {return client.read(p);}) && p.id() == 1 && client.take_fd(1) < 0,
+          "no descriptor with the packet before");
+    check(wait_until([&] {return client.read(p);}) && p.id() == 2, "packet of the descriptor");
+    int passed = client.take_fd(2);
+    char data[4] = {};
+    check(passed >= 0 && pread(passed, data, sizeof(data), 0) == 4 &&
+          std::string_view(data, 4) == "bulk", "descriptor passed");
+    check(client.take_fd(2) < 0, "descriptor taken once");
+    close(passed);
+
+    // the client leaving is seen by the server, which accepts the next one
+    client.stop();
+    check(wait_until([&] {return !server.is_open();}), "peer close seen");
+    transport::local::Client next(logger, socket_path);
+    set_large_frames(next);
+    next.start();
+    check(wait_until([&] {return server.is_open() && next.is_open();}), "reconnected");
+    check_frames("local, reconnected", next, server, largest);
+
+    next.stop();
+    server.stop();
+    return check_status();
+}
@@ -0,0 +1,77 @@
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr size_t                    nb_commands = 5000;
+constexpr size_t                    nb_data     = 50000;
+constexpr size_t                    block_size  = 200;
+constexpr std::chrono::milliseconds drain_time(500);
+
+// protocol overhead alone: no socket, no io thread, the link model is optional
+static void run(const std::string& name, const transport::loopback::Shaping& shaping,
+                size_t commands, size_t data)
+{
+    auto [master_transport, slave_transport] =
+        transport::loopback::make_pair(logger, shaping, shaping);
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(Feature::extended_id | Feature::cmd_response);
+    slave.set_response_cb([](const Packet::BlockView& b) {return std::string(b.data);});
+    std::atomic<uint64_t> received = 0;
+    master.set_data_cb([&](const Packet&) {received++;});
+    slave.start();
+    master.start();
+    master.connect();
+
+    // one command at a time: the round trip through both ends
+    std::mutex              mutex;
+    std::condition_variable cv;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < commands; i++) {
+        bool done = false;
+        master.send_command(0x0110, "ping", [&](Request&) {
+            std::lock_guard<std::mutex> lk(mutex);
+            done = true;
+            cv.notify_one();
+        });
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&]{return done;});
+    }
+    double cmd_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<Packet::Block> blocks = {{0x2b00, std::string(block_size, 'd')}};
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < data; i++)
+        slave.send_data(blocks);
+    const auto sent = std::chrono::steady_clock::now();
+    while (received < data && std::chrono::steady_clock::now() - sent < drain_time)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    double data_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fmt::format("{}: command round trip {:.1f} us, srtt {} us, {:.0f} data "
+                             "packets/s ({} of {} received)\n", name, cmd_s / commands * 1e6,
+                             master.rtt_stats().srtt.count(), received / data_s,
+                             received.load(), data);
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    using namespace std::chrono_literals;
+    run("loopback", {}, nb_commands, nb_data);
+    run("1 ms, 100 us jitter, 1 MB/s", {1ms, 100us, 1e6}, nb_commands / 20, nb_data / 50);
+}
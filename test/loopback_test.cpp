@@ -0,0 +1,36 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "transport_check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    auto [a, b] = transport::loopback::make_pair(logger);
+    a->start();
+    b->start();
+    check(a->is_open() && b->is_open(), "both ends open");
+    check_frames("loopback", *a, *b);
+    check_frames("loopback, other way", *b, *a);
+
+    // an end closing closes the other one, reopening it reconnects them
+    a->close();
+    check(!b->is_open(), "peer close seen");
+    a->open();
+    check(a->is_open() && b->is_open(), "reconnected");
+    check_frames("loopback, reconnected", *a, *b);
+
+    // shaped links keep the order too
+    transport::loopback::Shaping shaping;
+    shaping.latency = std::chrono::microseconds(200);
+    shaping.jitter  = std::chrono::microseconds(100);
+    auto [c, d] = transport::loopback::make_pair(logger, shaping, shaping);
+    c->start();
+    d->start();
+    check_frames("shaped loopback", *c, *d);
+    return check_status();
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr uint32_t                  nb_packets = 20000;
+constexpr size_t                    data_size  = 1000;
+constexpr std::chrono::microseconds data_period(50);
+constexpr std::chrono::milliseconds drain_time(500);
+
+static void run(double loss, Features features)
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    auto& mt = *master_transport;
+    auto& st = *slave_transport;
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_requested_features(features);
+
+    // every packet carries its sequence number in its first block
+    std::vector<bool> received(nb_packets, false);
+    uint64_t          duplicates = 0;
+    master.set_data_cb([&](const Packet& p) {
+        auto seq = *reinterpret_cast<const uint32_t*>(p.blocks().at(0).data.data());
+        if (received[seq])
+            duplicates++;
+        received[seq] = true;
+    });
+    slave.start();
+    master.start();
+    master.connect();
+    mt.reset_counters();
+    st.reset_counters();
+    mt.set_loss(loss);
+    st.set_loss(loss);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Packet::Block> blocks = {{0x2854, std::string(data_size, 'a')}};
+    for (uint32_t seq = 0; seq < nb_packets; seq++) {
+        blocks[0].data.replace(0, sizeof(seq), reinterpret_cast<char*>(&seq), sizeof(seq));
+        slave.send_data(blocks);
+        std::this_thread::sleep_for(data_period);
+    }
+    std::this_thread::sleep_for(drain_time);
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto delivered = std::count(received.begin(), received.end(), true);
+    auto stats     = master.data_recovery_stats();
+    std::cout << fmt::format("loss {:5.1f}%, features {:#x}: delivered {:.3f}%, {} duplicates, "
+                             "{:.1f} MB/s, {} nacked ids, {} recovered, {} given up\n",
+                             loss * 100, master.features(), 100. * delivered / nb_packets,
+                             duplicates, nb_packets * data_size / s / 1e6, stats.nacks,
+                             stats.recovered, stats.lost);
+
+    master.stop();
+    slave.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    for (double loss: {0.001, 0.01, 0.05}) {
+        run(loss, 0);
+        run(loss, Feature::reliable_data);
+    }
+}
@@ -4,6 +4,17 @@
 
 using namespace hdcp;
 
+struct Sample
+{
+    uint32_t time;
+    int16_t  x;
+    int16_t  y;
+    uint8_t  status;
+};
+
+template<> struct hdcp::BlockCodec<Sample>:
+    hdcp::FieldCodec<Sample, &Sample::time, &Sample::x, &Sample::y, &Sample::status> {};
+
 int main()
 {
     Packet p = Packet::make_keepalive(15);
@@ -24,4 +35,63 @@ int main()
     Packet p_copy2;
     p_copy2 = std::move(p_copy);
     std::cout << "move assignment: address = " << (void*)p_copy2.data() << std::endl;
+
+    // test v2 packets, ids above 16 bits survive a round trip
+    Packet v2 = Packet::make_keepalive(0x12345, Packet::v2);
+    Packet v2_parsed(std::string_view(v2.data(), v2.size()));
+    std::cout << fmt::format("v2: version {}, id {:#x}, header {} bytes", v2_parsed.version(),
+                             v2_parsed.id(), v2_parsed.header_size()) << std::endl;
+
+    // test large frames, the payload is kept out of the inline buffer
+    std::vector<Packet::Block> blocks = {{0x2854, std::string(100000, 'a')}};
+    Packet large = Packet::make_data(1, blocks, Packet::v2);
+    Packet large_parsed(std::string_view(large.data(), large.size()));
+    std::cout << fmt::format("large frame: size {}, block {} bytes", large_parsed.size(),
+                             large_parsed.blocks().at(0).data.size()) << std::endl;
+
+    // test array blocks, elements are read in place
+    std::vector<uint32_t> samples = {1, 2, 3, 0xdeadbeef};
+    std::vector<Packet::Block> array = {Packet::make_array(0x2855, sizeof(uint32_t),
+        std::string_view(reinterpret_cast<char*>(samples.data()),
+                         samples.size() * sizeof(uint32_t)))};
+    Packet with_array = Packet::make_data(2, array);
+    Packet::ArrayView view;
+    if (Packet::parse_array(with_array.blocks().at(0), view))
+        std::cout << fmt::format("array: type {:#x}, {} elements of {} bytes, last {:#x}",
+                                 view.type, view.size(), view.elem_size,
+                                 view.get<uint32_t>(view.size() - 1)) << std::endl;
+
+    // test typed blocks, described structs are packed without strings
+    static_assert(BlockCodec<Sample>::size == 9 && BlockCodec<Sample>::offsets[3] == 8);
+    EncodedBlock<Sample> sample(0x2856, {1000, -3, 4, 1});
+    std::vector<Packet::BlockView> typed = {sample};
+    Packet with_typed = Packet::make_data(3, typed);
+    for (auto s: with_typed.get<Sample>(0x2856))
+        std::cout << fmt::format("typed: time {}, x {}, y {}, status {}", s.time, s.x, s.y,
+                                 s.status) << std::endl;
+    std::cout << fmt::format("typed array: {} values, last {:#x}",
+                             with_array.get<uint32_t>(0x2855).size(),
+                             with_array.get<uint32_t>(0x2855)[3]) << std::endl;
+
+    // test fragments, a block larger than a packet is split and written back in one buffer
+    Packet::Block blob {0x2857, std::string(100000, 'b')};
+    auto fragments = Packet::make_fragments(blob, 1, Packet::max_pl_size);
+    Reassembler reassembler;
+    for (auto& f: fragments) {
+        Packet::Fragment fragment;
+        Packet::parse_fragment(f, fragment);
+        if (auto message = reassembler.add(fragment, Reassembler::Clock::now()))
+            std::cout << fmt::format("fragments: {} reassembled in {} bytes", fragments.size(),
+                                     message->block().data.size()) << std::endl;
+    }
+
+    // test channels, the channel block leads the data packet
+    std::vector<Packet::Block> on_channel = {Packet::make_channel(3, 42),
+                                             {0x2858, "telemetry"}};
+    Packet channel_packet = Packet::make_data(4, on_channel, Packet::v2);
+    uint16_t channel;
+    uint32_t seq;
+    if (channel_packet.channel_of(channel, seq))
+        std::cout << fmt::format("channel: {}, sequence {}, {} blocks", channel, seq,
+                                 channel_packet.nb_block()) << std::endl;
 }
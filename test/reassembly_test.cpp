@@ -0,0 +1,80 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+
+using Clock = Reassembler::Clock;
+
+static const Packet::BlockType type = 0x2857;
+
+static Packet::Fragment fragment(uint32_t message, const std::string& data, uint32_t offset,
+                                 uint32_t size)
+{
+    return {type, message, static_cast<uint32_t>(data.size()), offset,
+            std::string_view(data).substr(offset, size)};
+}
+
+int main()
+{
+    auto now = Clock::now();
+    std::string data(1000, 0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 7);
+
+    // fragments of make_fragments, in reverse order
+    Reassembler r;
+    Packet::Block blob {type, data};
+    auto blocks = Packet::make_fragments(blob, 1, 200);
+    std::optional<Reassembler::Message> m;
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+        Packet::Fragment f;
+        check(Packet::parse_fragment(*it, f), "fragment parsed");
+        check(!m, "complete with the last fragment only");
+        m = r.add(f, now);
+    }
+    check(m && m->block().data == data && m->block().type == type, "reassembled in reverse");
+
+    // overlapping and duplicated fragments are not counted twice
+    check(!r.add(fragment(2, data, 0, 600), now), "first part");
+    check(!r.add(fragment(2, data, 0, 600), now), "duplicate");
+    check(!r.add(fragment(2, data, 400, 500), now), "overlapping part");
+    check(!r.add(fragment(2, data, 100, 100), now), "covered part");
+    m = r.add(fragment(2, data, 900, 100), now);
+    check(m && m->block().data == data, "reassembled from overlapping fragments");
+
+    // fragments out of their message are rejected
+    auto outside = fragment(3, data, 900, 100);
+    outside.offset = 950;
+    check(!r.add(outside, now), "fragment past the end");
+    outside.offset = UINT32_MAX;
+    check(!r.add(outside, now), "offset past the end");
+    check(r.stats().rejected == 2, "rejected fragments");
+
+    // messages reassembled at the same time are bounded in count and bytes
+    Reassembler bounded(reassembly_timeout, 1000, 2, 2500);
+    bounded.add(fragment(10, data, 0, 10), now);
+    bounded.add(fragment(11, data, 0, 10), now + std::chrono::milliseconds(1));
+    bounded.add(fragment(12, data, 0, 10), now + std::chrono::milliseconds(2));
+    check(bounded.stats().evicted == 1, "oldest message evicted for a third one");
+    check(!bounded.add(fragment(10, data, 10, 990), now), "evicted message started again");
+    m = bounded.add(fragment(12, data, 10, 990), now);
+    check(m && m->block().data == data, "message kept reassembled");
+    Reassembler small(reassembly_timeout, 1000, 16, 1500);
+    small.add(fragment(20, data, 0, 10), now);
+    small.add(fragment(21, data, 0, 10), now);
+    check(small.stats().evicted == 1, "oldest message evicted for the bytes");
+
+    // messages without fragment for the timeout expire
+    Reassembler timed(std::chrono::milliseconds(100));
+    timed.add(fragment(30, data, 0, 10), now);
+    timed.expire(now + std::chrono::milliseconds(200));
+    check(timed.stats().expired == 1, "incomplete message expired");
+    check(!timed.add(fragment(30, data, 10, 990), now), "expired message incomplete");
+
+    auto stats = r.stats();
+    std::cout << fmt::format("{} completed, {} rejected\n", stats.completed, stats.rejected);
+    return check_status();
+}
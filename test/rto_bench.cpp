@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "config.h"
+#include "check.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr int    nb_commands = 500;
+constexpr double loss        = 0.05;
+constexpr std::chrono::milliseconds explicit_timeout(200);
+
+struct Result
+{
+    double mean;
+    double max;
+    int    failures;
+};
+
+static Result run(bool adaptive, const CommandOptions& opts = {})
+{
+    auto [master_transport, slave_transport] = transport::loopback::make_pair(logger);
+    auto& mt = *master_transport;
+    auto& st = *slave_transport;
+
+    appli::Slave slave(logger, {"slave", "NA", "NA", HDCP_VERSION}, std::move(slave_transport));
+    appli::Master master(logger, {"master", "NA", "NA", HDCP_VERSION},
+                         std::move(master_transport));
+    master.set_adaptive_command_timeout(adaptive);
+    slave.start();
+    master.start();
+    master.connect();
+    mt.set_loss(loss);
+    st.set_loss(loss);
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::vector<double>     latencies;
+    int                     failures = 0;
+    for (int i = 0; i < nb_commands; i++) {
+        bool done = false;
+        auto start = std::chrono::steady_clock::now();
+        master.send_command(0x0110, "set", [&](Request& r) {
+            std::lock_guard<std::mutex> lk(mutex);
+            if (r.get_status() != Request::Status::fulfilled)
+                failures++;
+            done = true;
+            cv.notify_one();
+        }, opts);
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&]{return done;});
+        latencies.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (auto l: latencies)
+        mean += l / latencies.size();
+    auto stats = master.rtt_stats();
+    std::cout << fmt::format("{}{} timeout, {:.0f}% loss: mean {:.1f} ms, p99 {:.1f} ms, "
+                             "max {:.1f} ms, {} failed (srtt {} us, rto {} us)\n",
+                             adaptive ? "adaptive" : "fixed",
+                             opts.timeout.count() ? " explicit" : "", loss * 100, mean,
+                             latencies[latencies.size() * 99 / 100], latencies.back(), failures,
+                             stats.srtt.count(), stats.rto.count());
+
+    master.stop();
+    slave.stop();
+    return {mean, latencies.back(), failures};
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    auto fixed    = run(false);
+    auto adaptive = run(true);
+    CommandOptions opts;
+    opts.timeout = explicit_timeout;
+    auto given    = run(true, opts);
+    check(adaptive.mean < fixed.mean, "adaptive timeouts recover losses sooner");
+    check(given.max >= std::chrono::duration<double, std::milli>(explicit_timeout).count(),
+          "explicit timeout honored in adaptive mode");
+    // a command fails once the request and its retries are all lost
+    check(fixed.failures + adaptive.failures + given.failures <= 3, "few failed commands");
+    return check_status();
+}
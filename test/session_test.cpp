@@ -0,0 +1,72 @@
+#include <iostream>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+using namespace hdcp;
+
+static bool operator==(const Capabilities& a, const Capabilities& b)
+{
+    return a.features == b.features && a.max_frame_size == b.max_frame_size &&
+           a.checksums == b.checksums && a.codecs == b.codecs && a.window == b.window &&
+           a.alignment == b.alignment;
+}
+
+static Capabilities slave_side()
+{
+    Capabilities c;
+    c.features       = supported_features;
+    c.max_frame_size = Packet::max_frame_size;
+    c.checksums      = default_checksums;
+    c.codecs         = Codec::lz;
+    c.alignment      = Packet::max_alignment;
+    return c;
+}
+
+int main()
+{
+    // encode / decode
+    auto s = slave_side();
+    check(Capabilities::decode(s.encode()) == s, "decoded as encoded");
+    std::string unknown = s.encode();
+    unknown.append("\x42\x00\x02\x00\xaa\xbb", 6);
+    check(Capabilities::decode(unknown) == s, "unknown entries skipped");
+    std::string truncated = s.encode();
+    truncated.resize(truncated.size() - 2);
+    auto t = Capabilities::decode(truncated);
+    check(t.features == s.features && t.alignment == Capabilities().alignment,
+          "truncated entry ignored");
+    check(Capabilities::decode({}) == Capabilities(), "defaults without capabilities");
+
+    // agree
+    Capabilities m;
+    m.features       = Feature::extended_id | Feature::large_frames | Feature::reliable_data;
+    m.max_frame_size = 64 << 10;
+    m.checksums      = default_checksums;
+    m.alignment      = 16;
+    auto a = s.agree(m);
+    check(a.features == m.features, "features requested and supported");
+    check(a.max_frame_size == m.max_frame_size, "smaller frame size");
+    check(a.alignment == 16 && a.codecs == 0, "smaller alignment, no codec");
+    check(a.window == std::min(data_ring_size, data_ring_bytes / a.max_frame_size),
+          "window bounded in bytes");
+    check(m.agree(a) == a, "the master agrees on the dip");
+
+    Session session(a);
+    check(session.version == Packet::v2 && session.max_frame_size == m.max_frame_size,
+          "v2 session with large frames");
+    check(session.checksum == Packet::Checksum::crc32c && session.alignment == 16,
+          "cheapest checksum and alignment");
+
+    // large frames need extended ids
+    m.features = Feature::large_frames;
+    a = s.agree(m);
+    check(!(a.features & Feature::large_frames) && a.max_frame_size == Packet::max_size,
+          "no large frames in v1");
+    check(a.window == data_ring_size, "full window of small frames");
+    check(a.checksums & checksum_bit(Packet::Checksum::fletcher16), "fletcher16 fallback");
+    check(Session(a).version == Packet::v1, "v1 session");
+
+    return check_status();
+}
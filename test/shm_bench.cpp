@@ -0,0 +1,36 @@
+#include "bench.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr uint16_t tcp_port = 9311;
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    {
+        transport::tcp::Server server(logger, tcp_port);
+        server.start();
+        transport::tcp::Client client(logger, "localhost", std::to_string(tcp_port));
+        client.start();
+        while (!server.is_open())
+            std::this_thread::yield();
+        bench::run("tcp localhost", server, client);
+        client.stop();
+        server.stop();
+    }
+    for (auto busy_poll: {std::chrono::microseconds(0), std::chrono::microseconds(50)}) {
+        transport::shm::Options opts;
+        opts.busy_poll = busy_poll;
+        transport::shm::Endpoint owner(logger, "/hdcp_shm_bench",
+                                       transport::shm::Endpoint::Role::owner, opts);
+        transport::shm::Endpoint attached(logger, "/hdcp_shm_bench",
+                                          transport::shm::Endpoint::Role::attach, opts);
+        owner.start();
+        attached.start();
+        bench::run(fmt::format("shm, busy poll {} us", busy_poll.count()), owner, attached);
+    }
+}
@@ -0,0 +1,73 @@
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "transport_check.h"
+
+using namespace hdcp;
+using transport::shm::Endpoint;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr const char* segment_name = "/hdcp_shm_test";
+
+/// Overwrite the record of frame, written and not read yet, as a faulty peer would; false if
+/// the frame is not in the segment
+static bool corrupt(const Packet& frame, uint32_t size)
+{
+    int fd = shm_open(segment_name, O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+        return false;
+    auto base = static_cast<char*>(mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, fd, 0));
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+    // the frame follows its 32 bit size
+    auto pos = static_cast<char*>(memmem(base, st.st_size, frame.data(), frame.size()));
+    if (pos)
+        std::memcpy(pos - sizeof(size), &size, sizeof(size));
+    munmap(base, st.st_size);
+    return pos;
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::off);
+
+    // the smallest ring, each run of frames wraps around it with a padding record
+    transport::shm::Options opts;
+    opts.capacity = 0;
+    Endpoint owner(logger, segment_name, Endpoint::Role::owner, opts);
+    Endpoint attached(logger, segment_name, Endpoint::Role::attach, opts);
+    owner.start();
+    attached.start();
+    check(owner.is_open() && attached.is_open(), "both ends open");
+    for (int i = 0; i < 4; i++) {
+        check_frames("shm", owner, attached);
+        check_frames("shm, other way", attached, owner);
+    }
+
+    // the other end closing is seen, opening it again reconnects them
+    attached.close();
+    check(!owner.is_open(), "peer close seen");
+    attached.open();
+    check(owner.is_open() && attached.is_open(), "reconnected");
+    check_frames("shm, reconnected", owner, attached);
+
+    // a record beyond the ring closes the connection instead of reading out of it
+    Packet frame = make_frame(1, 1000);
+    owner.write(Packet(frame));
+    check(corrupt(frame, 0x7fffff00), "record found");
+    Packet p;
+    check(!attached.read(p), "corrupt record not read");
+    check(!attached.is_open() && !owner.is_open(), "closed on a corrupt record");
+    check(attached.error_code() == std::errc::protocol_error, "protocol error");
+    return check_status();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <thread>
+
+#include "hdcp/hdcp.h"
+
+#include "check.h"
+
+/*
+ * Checks shared by the transport tests: frames of every size written to one end arrive whole
+ * and in order at the other one.
+ */
+using TestClock = std::chrono::steady_clock;
+
+/// Above the 64 KiB receive buffers of the io_uring transport and below Packet::max_frame_size
+constexpr size_t large_frame = 900 << 10;
+
+/// Wait up to a few seconds for condition
+template<typename F>
+bool wait_until(F&& condition)
+{
+    const auto deadline = TestClock::now() + std::chrono::seconds(5);
+    while (!condition()) {
+        if (TestClock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/// Session of the largest frames, for the socket buffers to hold them
+inline void set_large_frames(hdcp::Transport& t)
+{
+    hdcp::Session s;
+    s.version        = hdcp::Packet::v2;
+    s.max_frame_size = hdcp::Packet::max_frame_size;
+    t.set_session(s);
+}
+
+/// Block data of the frame id, of size bytes
+inline std::string frame_data(hdcp::Packet::Id id, size_t size)
+{
+    return std::string(size, char('a' + id % 26));
+}
+
+inline hdcp::Packet make_frame(hdcp::Packet::Id id, size_t size)
+{
+    std::vector<hdcp::Packet::Block> blocks = {{0x2c00, frame_data(id, size)}};
+    return hdcp::Packet::make_data(id, blocks, hdcp::Packet::v2);
+}
+
+/// Frames from a small one to largest, written to a by a thread while b reads them
+inline void check_frames(const std::string& what, hdcp::Transport& a, hdcp::Transport& b,
+                         size_t largest = large_frame)
+{
+    using hdcp::Packet;
+    const std::vector<size_t> sizes = {100, Packet::max_size + 1000, 100 << 10, largest, 100};
+    std::thread writer([&] {
+        const auto deadline = TestClock::now() + std::chrono::seconds(5);
+        for (size_t i = 0; i < sizes.size(); i++) {
+            for (;;) {
+                try {
+                    a.write(make_frame(i + 1, sizes[i]));
+                    break;
+                } catch (hdcp::transport_error&) {
+                    // a full queue or ring holds the writer back
+                    if (TestClock::now() > deadline)
+                        return;
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+
+    size_t received = 0;
+    bool   in_order = true;
+    const auto deadline = TestClock::now() + std::chrono::seconds(5);
+    Packet p;
+    while (received < sizes.size() && TestClock::now() < deadline) {
+        if (!b.read(p))
+            continue;
+        auto blocks = p.blocks();
+        in_order &= p.id() == received + 1 && blocks.size() == 1 &&
+                    blocks[0].data == frame_data(received + 1, sizes[received]);
+        received++;
+    }
+    writer.join();
+    check(received == sizes.size(), what + ": every frame received");
+    check(in_order, what + ": frames whole and in order");
+}
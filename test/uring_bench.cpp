@@ -0,0 +1,139 @@
+#include <fstream>
+#include <functional>
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using namespace hdcp;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr uint16_t port = 9313;
+
+// syscalls of the process and of the threads it starts, where tracefs can be read
+class SyscallCounter
+{
+public:
+    SyscallCounter()
+    {
+        for (auto dir: {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+            std::ifstream f(std::string(dir) + "/events/raw_syscalls/sys_enter/id");
+            uint64_t id;
+            if (!(f >> id))
+                continue;
+            perf_event_attr attr {};
+            attr.type    = PERF_TYPE_TRACEPOINT;
+            attr.size    = sizeof(attr);
+            attr.config  = id;
+            attr.inherit = 1;
+            fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            break;
+        }
+    }
+    ~SyscallCounter() {if (fd_ >= 0) close(fd_);}
+
+    bool     ok() const {return fd_ >= 0;}
+    uint64_t count() const
+    {
+        uint64_t n = 0;
+        return fd_ >= 0 && ::read(fd_, &n, sizeof(n)) == sizeof(n) ? n : 0;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+struct Usage
+{
+    double   cpu;      // user + system seconds
+    uint64_t switches; // context switches, the wakeups of the io threads
+
+    static Usage now()
+    {
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        auto s = [](const timeval& tv) {return tv.tv_sec + tv.tv_usec / 1e6;};
+        return {s(ru.ru_utime) + s(ru.ru_stime),
+                static_cast<uint64_t>(ru.ru_nvcsw + ru.ru_nivcsw)};
+    }
+};
+
+// cpu, context switches and syscalls of the throughput run; own_syscalls gives those counted
+// by the transports when tracefs is unavailable
+class UsageProbe: public bench::Probe
+{
+public:
+    UsageProbe(std::function<uint64_t()> own_syscalls = [] {return uint64_t(0);}):
+        own_syscalls_(std::move(own_syscalls))
+    {
+    }
+
+    void start() override
+    {
+        sys_start_ = syscalls();
+        use_start_ = Usage::now();
+    }
+
+    std::string report(uint64_t received, size_t packet_size, double) override
+    {
+        const Usage    use = Usage::now();
+        const uint64_t sys = syscalls() - sys_start_;
+        const double   gb  = received * packet_size / 1e9;
+        auto out = fmt::format(", cpu {:.2f} s/GB, {:.2f} context switches/packet",
+                               (use.cpu - use_start_.cpu) / gb,
+                               double(use.switches - use_start_.switches) / received);
+        if (counter_.ok() || sys)
+            out += fmt::format(", {:.2f} syscalls/packet{}", double(sys) / received,
+                               counter_.ok() ? "" : " (io_uring_enter and wakeups)");
+        return out;
+    }
+
+private:
+    SyscallCounter            counter_;
+    std::function<uint64_t()> own_syscalls_;
+    uint64_t                  sys_start_ = 0;
+    Usage                     use_start_ {};
+
+    uint64_t syscalls() const {return counter_.ok() ? counter_.count() : own_syscalls_();}
+};
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    {
+        transport::tcp::Server server(logger, port);
+        server.start();
+        transport::tcp::Client client(logger, "localhost", std::to_string(port));
+        client.start();
+        while (!server.is_open())
+            std::this_thread::yield();
+        bench::run("asio tcp", server, client, UsageProbe());
+        client.stop();
+        server.stop();
+    }
+    if (!transport::uring::available()) {
+        std::cout << "io_uring unavailable\n";
+        return 0;
+    }
+    {
+        transport::uring::Server server(logger, port);
+        server.start();
+        transport::uring::Client client(logger, "localhost", std::to_string(port));
+        client.start();
+        while (!server.is_open())
+            std::this_thread::yield();
+        bench::run("io_uring tcp", server, client, UsageProbe([&] {
+            auto a = server.stats();
+            auto b = client.stats();
+            return a.enters + a.wakeups + b.enters + b.wakeups;
+        }));
+        client.stop();
+        server.stop();
+    }
+}
@@ -0,0 +1,67 @@
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "transport_check.h"
+
+using namespace hdcp;
+using transport::uring::Client;
+using transport::uring::Server;
+
+common::Logger logger(spdlog::stderr_color_mt("hdcp"));
+
+constexpr uint16_t    port        = 9314;
+constexpr const char* socket_path = "/tmp/hdcp_uring_test.sock";
+
+/// Receive buffers provided by request, as on kernels without a buffer ring
+template<typename T>
+struct Provided: T
+{
+    template<typename... Args>
+    Provided(Args&&... args): T(std::forward<Args>(args)...) {this->buffer_ring_ = false;}
+};
+
+template<typename F>
+static void run(const std::string& name, Transport& server, F&& make_client)
+{
+    auto client = make_client();
+    server.start();
+    client->start();
+    check(wait_until([&] {return server.is_open() && client->is_open();}),
+          name + ": connected");
+    check_frames(name, server, *client);
+    check_frames(name + ", other way", *client, server);
+
+    // the client leaving is seen by the server, which accepts the next one
+    client->stop();
+    check(wait_until([&] {return !server.is_open();}), name + ": peer close seen");
+    client = make_client();
+    client->start();
+    check(wait_until([&] {return server.is_open() && client->is_open();}),
+          name + ": reconnected");
+    check_frames(name + ", reconnected", *client, server);
+
+    client->stop();
+    server.stop();
+}
+
+int main()
+{
+    logger->set_level(spdlog::level::err);
+
+    if (!transport::uring::available()) {
+        std::cout << "io_uring unavailable\n";
+        return 0;
+    }
+    {
+        Server server(logger, port);
+        run("buffer ring, tcp", server, [] {
+            return std::make_unique<Client>(logger, "localhost", std::to_string(port));
+        });
+    }
+    {
+        Provided<Server> server(logger, std::string(socket_path));
+        run("provided buffers, unix", server, [] {
+            return std::make_unique<Provided<Client>>(logger, std::string(socket_path));
+        });
+    }
+    return check_status();
+}